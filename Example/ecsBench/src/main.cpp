@@ -0,0 +1,1099 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+// Headless micro benchmarks for the archetype registry. Only the registry is
+// touched, so no window or renderer is created. Results are written as JSON,
+// one record per measurement, to compare runs between engine versions.
+#include "CoreFiles/FrameArena.h"
+#include "CoreFiles/LogWrapper.h"
+#include "ECS/Registry/ArcheRegistry.h"
+#include "ECS/Registry/EntityPool.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <span>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace
+{
+namespace tag
+{
+struct Position;
+struct Velocity;
+struct Health;
+struct Team;
+struct Sleep;
+struct Flash;
+template <std::size_t Bit> struct Marker;
+struct TextureRef;
+struct Material;
+} // namespace tag
+
+struct Position {
+  using tag = tag::Position;
+  static constexpr std::string_view layoutId = "Position/1";
+  float x = 0.f;
+  float y = 0.f;
+};
+struct Velocity {
+  using tag = tag::Velocity;
+  static constexpr std::string_view layoutId = "Velocity/1";
+  float x = 0.f;
+  float y = 0.f;
+};
+struct Health {
+  using tag = tag::Health;
+  static constexpr std::string_view layoutId = "Health/1";
+  int value = 100;
+};
+struct Team {
+  using tag = tag::Team;
+  static constexpr std::string_view layoutId = "Team/1";
+  int id = 0;
+};
+struct Sleep {
+  using tag = tag::Sleep;
+  static constexpr std::string_view layoutId = "Sleep/1";
+  float timer = 0.f;
+};
+// same status as Sleep, kept in a sparse set instead of the archetypes
+struct Flash {
+  using tag = tag::Flash;
+  static constexpr bool sparse = true;
+  float timer = 0.f;
+};
+// Only there to tell archetypes apart, see spawnArchetypes
+template <std::size_t Bit> struct Marker {
+  using tag = tag::Marker<Bit>;
+  std::uint8_t value = 0;
+};
+
+// A texture the way a sprite points at it, directly or through a sheet, as
+// SpriteComponent::m_tex does. slot stands for Texture::m_slot
+struct FakeTexture {
+  std::uint32_t slot = 0;
+};
+struct SheetRef {
+  FakeTexture *texture = nullptr;
+  std::uint16_t id = 0;
+};
+struct TextureRef {
+  using tag = tag::TextureRef;
+  std::variant<FakeTexture *, SheetRef> source;
+};
+// the same texture as a shared component
+struct Material {
+  using tag = tag::Material;
+  static constexpr bool shared = true;
+  FakeTexture *texture = nullptr;
+  bool operator==(const Material &) const = default;
+};
+
+using BenchComponents = reg::CompileTimeBitMask<
+    tag::Position, tag::Velocity, tag::Health, tag::Team, tag::Sleep,
+    tag::Flash, tag::Marker<0>, tag::Marker<1>, tag::Marker<2>,
+    tag::Marker<3>, tag::Marker<4>, tag::Marker<5>, tag::Marker<6>,
+    tag::TextureRef, tag::Material>;
+using Registry = reg::ArcheRegistry<BenchComponents>;
+
+using Clock = std::chrono::steady_clock;
+
+double nanosPerEntity(Clock::time_point start, Clock::time_point end,
+                      std::size_t entities)
+{
+  const auto ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+  return static_cast<double>(ns) / static_cast<double>(entities);
+}
+
+// Every result read back from the registry ends up here and in the report,
+// so the compiler can't drop the loops measured
+double g_checksum = 0.0;
+
+// ---------------------------------------------------- //
+// Report
+// ---------------------------------------------------- //
+
+struct Result {
+  std::string name;
+  std::size_t entities;
+  // archetypes the entities are spread over, 0 when it doesn't apply
+  std::size_t archetypes;
+  double value;
+  std::string unit;
+};
+
+std::string jsonString(const std::string &text)
+{
+  std::string quoted = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\')
+      quoted += '\\';
+    quoted += c;
+  }
+  return quoted + '"';
+}
+
+// Collects the results, echoed on stderr as they come so a long run shows
+// progress, and written as JSON at the end
+class Report
+{
+public:
+  void add(std::string name, std::size_t entities, std::size_t archetypes,
+           double value, std::string unit)
+  {
+    std::fprintf(stderr, "%-26s %8zu entities %4zu archetypes %12.2f %s\n",
+                 name.c_str(), entities, archetypes, value, unit.c_str());
+    m_results.push_back(
+        {std::move(name), entities, archetypes, value, std::move(unit)});
+  }
+
+  void write(std::FILE *out, std::size_t workers,
+             std::size_t maxEntities) const
+  {
+#if defined(__clang__) || defined(__GNUC__)
+    const std::string compiler = __VERSION__;
+#elif defined(_MSC_VER)
+    const std::string compiler = "MSVC " + std::to_string(_MSC_VER);
+#else
+    const std::string compiler = "unknown";
+#endif
+    std::fprintf(out,
+                 "{\n  \"benchmark\": \"pain_ecs_bench\",\n"
+                 "  \"version\": 1,\n  \"compiler\": %s,\n"
+                 "  \"workers\": %zu,\n  \"max_entities\": %zu,\n"
+                 "  \"results\": [\n",
+                 jsonString(compiler).c_str(), workers, maxEntities);
+    for (std::size_t i = 0; i < m_results.size(); ++i) {
+      const Result &result = m_results[i];
+      std::fprintf(out,
+                   "    {\"name\": %s, \"entities\": %zu, \"archetypes\": "
+                   "%zu, \"value\": %.4f, \"unit\": %s}%s\n",
+                   jsonString(result.name).c_str(), result.entities,
+                   result.archetypes, result.value,
+                   jsonString(result.unit).c_str(),
+                   i + 1 < m_results.size() ? "," : "");
+    }
+    std::fprintf(out, "  ],\n  \"checksum\": %.6g\n}\n", g_checksum);
+  }
+
+private:
+  std::vector<Result> m_results;
+};
+
+// ---------------------------------------------------- //
+// Worlds
+// ---------------------------------------------------- //
+
+struct World {
+  Registry registry;
+  std::vector<reg::Entity> entities;
+};
+
+constexpr std::size_t MarkerCount = 7;
+
+// The markers whose bit is set in Combination
+template <std::size_t Combination, std::size_t... Bits>
+auto markersOf(std::index_sequence<Bits...>)
+{
+  return std::tuple_cat(
+      std::conditional_t<((Combination >> Bits) & 1) != 0,
+                         std::tuple<Marker<Bits>>, std::tuple<>>{}...);
+}
+
+template <std::size_t Combination>
+void spawnArchetype(World &world, std::size_t count)
+{
+  std::apply(
+      [&world, count](const auto &...markers) {
+        std::vector<reg::Entity> spawned = world.registry.createEntities(
+            count, Position{}, Velocity{1.f, 1.f}, Health{}, markers...);
+        world.entities.insert(world.entities.end(), spawned.begin(),
+                              spawned.end());
+      },
+      markersOf<Combination>(std::make_index_sequence<MarkerCount>{}));
+}
+
+// One spawn function per combination of markers. Every entity has Position,
+// Velocity and Health, the markers put it in one of 128 archetypes
+using SpawnArchetype = void (*)(World &, std::size_t);
+constexpr auto spawnArchetypes =
+    []<std::size_t... Combinations>(std::index_sequence<Combinations...>) {
+      return std::array<SpawnArchetype, sizeof...(Combinations)>{
+          &spawnArchetype<Combinations>...};
+    }(std::make_index_sequence<std::size_t{1} << MarkerCount>{});
+
+// count entities split evenly over the first archetypes
+void spread(World &world, std::size_t count, std::size_t archetypes)
+{
+  world.entities.reserve(world.entities.size() + count);
+  for (std::size_t a = 0; a < archetypes; ++a)
+    spawnArchetypes[a](world, count * (a + 1) / archetypes -
+                                  count * a / archetypes);
+}
+
+// Spread entities among a few archetypes that all share Position, Velocity and
+// Health, the same shape a gameplay world usually has
+std::vector<reg::Entity> populate(Registry &registry, std::size_t count)
+{
+  std::vector<reg::Entity> entities;
+  entities.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    reg::Entity e = registry.createEntity();
+    const float f = static_cast<float>(i);
+    const int id = static_cast<int>(i);
+    switch (i % 4) {
+    case 0:
+      registry.createComponents(e, Position{f, f}, Velocity{1.f, 1.f},
+                                Health{});
+      break;
+    case 1:
+      registry.createComponents(e, Position{f, f}, Velocity{1.f, 1.f},
+                                Health{}, Team{id});
+      break;
+    case 2:
+      registry.createComponents(e, Position{f, f}, Velocity{1.f, 1.f},
+                                Health{}, Sleep{});
+      break;
+    default:
+      registry.createComponents(e, Position{f, f}, Velocity{1.f, 1.f},
+                                Health{}, Team{id}, Sleep{});
+      break;
+    }
+    entities.push_back(e);
+  }
+  return entities;
+}
+
+// Fastest of reps runs, in ns per entity. Each run gets a new world set up by
+// prepare(), only measure() is timed. Worlds are destroyed outside the timer
+template <typename Prepare, typename Measure>
+double fastest(int reps, std::size_t entities, Prepare &&prepare,
+               Measure &&measure)
+{
+  double best = 1e30;
+  for (int r = 0; r < reps; ++r) {
+    auto world = std::make_unique<World>();
+    prepare(*world);
+    const auto start = Clock::now();
+    measure(*world);
+    best = std::min(best, nanosPerEntity(start, Clock::now(), entities));
+  }
+  return best;
+}
+
+// ---------------------------------------------------- //
+// Sweep over world sizes
+// ---------------------------------------------------- //
+
+// Entities created one by one, without any component, then given their
+// components, then created all at once with createEntities and from a prefab
+void benchCreate(Report &report, std::size_t count, int reps)
+{
+  auto reserve = [count](World &world) { world.entities.reserve(count); };
+  report.add("create", count, 0,
+             fastest(reps, count, reserve,
+                     [count](World &world) {
+                       for (std::size_t i = 0; i < count; ++i)
+                         world.entities.push_back(
+                             world.registry.createEntity());
+                     }),
+             "ns/entity");
+
+  auto createEntities = [count](World &world) {
+    world.entities.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+      world.entities.push_back(world.registry.createEntity());
+  };
+  report.add("createComponents", count, 1,
+             fastest(reps, count, createEntities,
+                     [](World &world) {
+                       float f = 0.f;
+                       for (reg::Entity e : world.entities)
+                         world.registry.createComponents(
+                             e, Position{f, f}, Velocity{1.f, 1.f}, Health{});
+                     }),
+             "ns/entity");
+
+  report.add("createEntities", count, 1,
+             fastest(reps, count, [](World &) {},
+                     [count](World &world) {
+                       world.entities = world.registry.createEntities(
+                           count, Position{}, Velocity{1.f, 1.f}, Health{});
+                     }),
+             "ns/entity");
+
+  // the same rows copied from a prefab, then with a Position per entity
+  const auto prefab = reg::Prefab<BenchComponents>::of(
+      Position{}, Velocity{1.f, 1.f}, Health{});
+  report.add("instantiate", count, 1,
+             fastest(reps, count, [](World &) {},
+                     [count, &prefab](World &world) {
+                       world.entities =
+                           world.registry.instantiate(prefab, count);
+                     }),
+             "ns/entity");
+  std::vector<Position> positions(count);
+  for (std::size_t i = 0; i < count; ++i)
+    positions[i] = Position{static_cast<float>(i), 0.f};
+  report.add("instantiateOverride", count, 1,
+             fastest(reps, count, [](World &) {},
+                     [count, &prefab, &positions](World &world) {
+                       world.entities = world.registry.instantiate(
+                           prefab, count, std::span(positions));
+                     }),
+             "ns/entity");
+}
+
+// Linear update of every Position, first with a plain query loop and then
+// split over the thread pool with forEachParallel. The more archetypes, the
+// shorter the runs of contiguous rows
+void benchQuery(Report &report, ThreadPool &pool, std::size_t count,
+                std::size_t archetypes, int reps)
+{
+  World world;
+  spread(world, count, archetypes);
+  auto update = [](auto chunk) {
+    auto *__restrict p = std::get<0>(chunk.arrays);
+    auto *__restrict v = std::get<1>(chunk.arrays);
+    for (size_t i = 0; i < chunk.count; ++i) {
+      p[i].x += v[i].x * 0.016f;
+      p[i].y += v[i].y * 0.016f;
+    }
+  };
+
+  double serial = 1e30;
+  double parallel = 1e30;
+  for (int r = 0; r < reps; ++r) {
+    auto start = Clock::now();
+    for (auto chunk : world.registry.query<Position, const Velocity>())
+      update(chunk);
+    serial = std::min(serial, nanosPerEntity(start, Clock::now(), count));
+
+    start = Clock::now();
+    world.registry.forEachParallel<Position, const Velocity>(pool, update);
+    parallel = std::min(parallel, nanosPerEntity(start, Clock::now(), count));
+  }
+  for (auto chunk : world.registry.query<const Position>())
+    g_checksum += std::get<0>(chunk.arrays)[0].x;
+  report.add("query", count, archetypes, serial, "ns/entity");
+  report.add("forEachParallel", count, archetypes, parallel, "ns/entity");
+}
+
+// Random access through getComponents, the pattern used by narrow phase
+// collision and by scripts that hold entity ids
+void benchGetComponents(Report &report, std::size_t count, int reps)
+{
+  constexpr std::size_t Archetypes = 10;
+  World world;
+  spread(world, count, Archetypes);
+  std::mt19937 rng(42);
+  std::shuffle(world.entities.begin(), world.entities.end(), rng);
+
+  double best = 1e30;
+  float checksum = 0.f;
+  for (int r = 0; r < reps; ++r) {
+    const auto start = Clock::now();
+    for (reg::Entity e : world.entities) {
+      auto [p, v, h] =
+          world.registry.getComponents<Position, const Velocity, Health>(e);
+      p.x += v.x;
+      checksum += p.x + static_cast<float>(h.value);
+    }
+    best = std::min(best, nanosPerEntity(start, Clock::now(), count));
+  }
+  g_checksum += checksum;
+  report.add("getComponents", count, Archetypes, best, "ns/entity");
+}
+
+// Every entity moved to the archetype with one more component, then back,
+// one by one and in a single batch
+void benchTransitions(Report &report, std::size_t count, int reps)
+{
+  report.add("addComponents", count, 1,
+             fastest(
+                 reps, count,
+                 [count](World &world) {
+                   world.entities = world.registry.createEntities(
+                       count, Position{}, Velocity{1.f, 1.f}, Health{});
+                 },
+                 [](World &world) {
+                   int id = 0;
+                   for (reg::Entity e : world.entities)
+                     world.registry.addComponents(e, Team{++id});
+                 }),
+             "ns/entity");
+  report.add("removeComponents", count, 1,
+             fastest(
+                 reps, count,
+                 [count](World &world) {
+                   world.entities = world.registry.createEntities(
+                       count, Position{}, Velocity{1.f, 1.f}, Health{},
+                       Team{});
+                 },
+                 [](World &world) {
+                   for (reg::Entity e : world.entities)
+                     world.registry.removeComponents<Team>(e);
+                 }),
+             "ns/entity");
+  report.add("removeComponentsBatch", count, 1,
+             fastest(
+                 reps, count,
+                 [count](World &world) {
+                   world.entities = world.registry.createEntities(
+                       count, Position{}, Velocity{1.f, 1.f}, Health{},
+                       Team{});
+                 },
+                 [](World &world) {
+                   world.registry.removeComponents<Team>(
+                       std::span<const reg::Entity>(world.entities));
+                 }),
+             "ns/entity");
+}
+
+// Every entity removed in random order, one by one and then by batches the
+// size of what a frame usually culls
+void benchRemove(Report &report, std::size_t count, int reps)
+{
+  constexpr std::size_t Archetypes = 10;
+  static constexpr std::size_t BatchSize = 64;
+  auto prepare = [count](World &world) {
+    spread(world, count, Archetypes);
+    std::mt19937 rng(7);
+    std::shuffle(world.entities.begin(), world.entities.end(), rng);
+  };
+  report.add("remove", count, Archetypes,
+             fastest(reps, count, prepare,
+                     [](World &world) {
+                       for (reg::Entity e : world.entities)
+                         world.registry.remove(e);
+                     }),
+             "ns/entity");
+  report.add("removeBatch", count, Archetypes,
+             fastest(reps, count, prepare,
+                     [](World &world) {
+                       std::span<const reg::Entity> all = world.entities;
+                       for (std::size_t i = 0; i < all.size(); i += BatchSize)
+                         world.registry.removeBatch(all.subspan(
+                             i, std::min(BatchSize, all.size() - i)));
+                     }),
+             "ns/entity");
+}
+
+// ---------------------------------------------------- //
+// Fixed scenarios
+// ---------------------------------------------------- //
+
+// Cull a few dozen entities per frame out of the whole world, then spawn them
+// back so the world keeps its size. The cost must not depend on the world size
+void benchRemoveBatchRespawn(Report &report, std::size_t count)
+{
+  constexpr std::size_t BatchSize = 64;
+  constexpr int Frames = 1000;
+  Registry registry;
+  std::vector<reg::Entity> entities = populate(registry, count);
+  std::mt19937 rng(7);
+  std::vector<reg::Entity> batch(BatchSize);
+
+  const auto start = Clock::now();
+  for (int frame = 0; frame < Frames; ++frame) {
+    for (std::size_t i = 0; i < BatchSize; ++i) {
+      std::swap(entities[rng() % (entities.size() - i)],
+                entities[entities.size() - 1 - i]);
+      batch[i] = entities[entities.size() - 1 - i];
+    }
+    registry.removeBatch(batch);
+    std::vector<reg::Entity> spawned = registry.createEntities(
+        BatchSize, Position{}, Velocity{1.f, 1.f}, Health{});
+    std::copy(spawned.begin(), spawned.end(), entities.end() - BatchSize);
+  }
+  report.add("removeBatch64+respawn", count, 4,
+             nanosPerEntity(start, Clock::now(), Frames), "ns/frame");
+}
+
+// Frames of parallel updates whose scratch lives in a frame arena. Once the
+// arena grew to the size of a frame, frames never reach the global allocator
+void benchFrameAllocations(Report &report, ThreadPool &pool,
+                           std::size_t count)
+{
+  constexpr int Frames = 100;
+  Registry registry;
+  populate(registry, count);
+  pain::FrameArena arena(pool);
+  auto frame = [&] {
+    arena.reset();
+    registry.forEachParallel<Position, const Velocity>(
+        pool,
+        [](auto chunk) {
+          auto [p, v] = chunk.arrays;
+          for (size_t i = 0; i < chunk.count; ++i)
+            p[i].x += v[i].x * 0.016f;
+        },
+        {}, {.grainSize = 1024, .scratch = arena.resource()});
+  };
+  for (int r = 0; r < 3; ++r)
+    frame();
+
+  const uint64_t before = pain::globalAllocationCount();
+  for (int r = 0; r < Frames; ++r)
+    frame();
+  const uint64_t allocations = pain::globalAllocationCount() - before;
+  report.add("frameHeapAllocations", count, 4,
+             static_cast<double>(allocations) / Frames, "allocations/frame");
+  report.add("frameArenaBytes", count, 4,
+             static_cast<double>(arena.stats().bytesUsed), "bytes");
+}
+
+// Status components toggled every frame. Sleep moves the entity through a
+// cached archetype edge, Flash only touches its sparse set
+void benchStatusToggle(Report &report)
+{
+  constexpr std::size_t Toggled = 1'000;
+  constexpr int Frames = 100;
+  Registry registry;
+  std::vector<reg::Entity> entities = registry.createEntities(
+      Toggled * 10, Position{}, Velocity{1.f, 1.f}, Health{});
+
+  const auto start = Clock::now();
+  for (int frame = 0; frame < Frames; ++frame) {
+    for (std::size_t i = 0; i < Toggled; ++i)
+      registry.addComponents(entities[i * 10], Sleep{1.f});
+    for (std::size_t i = 0; i < Toggled; ++i)
+      registry.removeComponents<Sleep>(entities[i * 10]);
+  }
+  report.add("toggleArchetype", Toggled, 2,
+             nanosPerEntity(start, Clock::now(), Toggled * Frames),
+             "ns/entity");
+
+  const auto sparseStart = Clock::now();
+  for (int frame = 0; frame < Frames; ++frame) {
+    for (std::size_t i = 0; i < Toggled; ++i)
+      registry.addComponents(entities[i * 10], Flash{1.f});
+    for (std::size_t i = 0; i < Toggled; ++i)
+      registry.removeComponents<Flash>(entities[i * 10]);
+  }
+  report.add("toggleSparse", Toggled, 1,
+             nanosPerEntity(sparseStart, Clock::now(), Toggled * Frames),
+             "ns/entity");
+
+  const auto enabledStart = Clock::now();
+  for (int frame = 0; frame < Frames; ++frame) {
+    for (std::size_t i = 0; i < Toggled; ++i)
+      registry.setEnabled(entities[i * 10], false);
+    for (std::size_t i = 0; i < Toggled; ++i)
+      registry.setEnabled(entities[i * 10], true);
+  }
+  report.add("toggleEnabled", Toggled, 1,
+             nanosPerEntity(enabledStart, Clock::now(), Toggled * Frames),
+             "ns/entity");
+
+  // a tenth of the world paused, scattered over every chunk
+  for (std::size_t i = 0; i < Toggled; ++i)
+    registry.setEnabled(entities[i * 10 + 5], false);
+  float enabledSum = 0.f;
+  const auto disabledStart = Clock::now();
+  for (int frame = 0; frame < Frames; ++frame)
+    for (auto chunk : registry.query<const Position>())
+      for (std::size_t i = 0; i < chunk.count; ++i)
+        enabledSum += std::get<0>(chunk.arrays)[i].x;
+  g_checksum += enabledSum;
+  report.add("queryWithDisabled", Toggled * 10, 1,
+             nanosPerEntity(disabledStart, Clock::now(), Toggled * 10 * Frames),
+             "ns/entity");
+  for (std::size_t i = 0; i < Toggled; ++i)
+    registry.setEnabled(entities[i * 10 + 5], true);
+
+  for (std::size_t i = 0; i < Toggled; ++i)
+    registry.addComponents(entities[i * 10], Flash{1.f});
+  float checksum = 0.f;
+  const auto eachStart = Clock::now();
+  for (int frame = 0; frame < Frames; ++frame)
+    registry.each<const Position, Flash>(
+        [&checksum](reg::Entity, const Position &position, Flash &flash) {
+          flash.timer -= 0.01f;
+          checksum += position.x + flash.timer;
+        });
+  g_checksum += checksum;
+  report.add("eachSparse", Toggled, 1,
+             nanosPerEntity(eachStart, Clock::now(), Toggled * Frames),
+             "ns/entity");
+}
+
+// A mostly static world: a few entities move every frame and a reader only
+// wants the ones that did, like broad phase collision
+void benchChangedOnly(Report &report, std::size_t count)
+{
+  constexpr std::size_t Moved = 100;
+  constexpr int Frames = 200;
+  Registry registry;
+  std::vector<reg::Entity> entities = populate(registry, count);
+  std::mt19937 rng(11);
+  float checksum = 0.f;
+
+  auto readAll = [&] {
+    for (auto chunk : registry.query<const Position>())
+      for (std::size_t i = 0; i < chunk.count; ++i)
+        checksum += std::get<0>(chunk.arrays)[i].x;
+  };
+  reg::ChangeTick lastRead = registry.changeTick();
+  auto readChanged = [&] {
+    for (auto chunk : registry.queryChanged<const Position>(lastRead))
+      for (std::size_t i = 0; i < chunk.count; ++i)
+        checksum += std::get<0>(chunk.arrays)[i].x;
+    lastRead = registry.advanceChangeTick();
+  };
+
+  for (int read = 0; read < 2; ++read) {
+    const auto start = Clock::now();
+    for (int frame = 0; frame < Frames; ++frame) {
+      for (std::size_t i = 0; i < Moved; ++i)
+        registry.getComponent<Position>(entities[rng() % entities.size()]).x +=
+            1.f;
+      registry.advanceChangeTick();
+      if (read == 0)
+        readAll();
+      else
+        readChanged();
+    }
+    report.add(read == 0 ? "queryAllRows" : "queryChangedRows", count, 4,
+               nanosPerEntity(start, Clock::now(), Frames) / 1000.0,
+               "us/frame");
+  }
+  g_checksum += checksum;
+}
+
+// Load a level saved as a snapshot instead of creating its entities again one
+// by one, the way scripts build a level at startup
+void benchSnapshot(Report &report, std::size_t count, int reps)
+{
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "pain_ecs_bench.snapshot")
+          .string();
+  auto start = Clock::now();
+  Registry level;
+  populate(level, count);
+  const double replay = nanosPerEntity(start, Clock::now(), count);
+
+  start = Clock::now();
+  {
+    std::ofstream file(path, std::ios::binary);
+    level.saveSnapshot<Position, Velocity, Health, Team, Sleep>(file);
+  }
+  const double save = nanosPerEntity(start, Clock::now(), count);
+
+  double load = 1e30;
+  for (int r = 0; r < reps; ++r) {
+    start = Clock::now();
+    Registry registry;
+    reg::SnapshotFile file(path.c_str());
+    registry.loadSnapshot<Position, Velocity, Health, Team, Sleep>(
+        file.bytes());
+    load = std::min(load, nanosPerEntity(start, Clock::now(), count));
+    g_checksum +=
+        static_cast<double>(registry.iteratorSize<Position, Health>());
+  }
+  std::filesystem::remove(path);
+  report.add("levelCreateComponents", count, 4, replay, "ns/entity");
+  report.add("levelSaveSnapshot", count, 4, save, "ns/entity");
+  report.add("levelLoadSnapshot", count, 4, load, "ns/entity");
+}
+
+// Autosave of a big world: the main thread only copies the registry into a
+// staging buffer, a worker writes the file. The copy is the frame stall
+void benchAutosave(Report &report, ThreadPool &pool, std::size_t count)
+{
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "pain_ecs_autosave.snapshot")
+          .string();
+  Registry registry;
+  std::vector<reg::Entity> entities = populate(registry, count);
+  reg::SnapshotStaging staging;
+
+  double first = 0.0;
+  double pause = 1e30;
+  double write = 1e30;
+  for (int r = 0; r < 5; ++r) {
+    // the world keeps changing between autosaves
+    for (size_t i = 0; i < entities.size(); i += 97)
+      registry.getComponent<Position>(entities[i]).x += 1.f;
+    auto start = Clock::now();
+    registry.captureSnapshot<Position, Velocity, Health, Team, Sleep>(
+        staging.bytes, &pool);
+    const double ms = nanosPerEntity(start, Clock::now(), 1) / 1e6;
+    if (r == 0)
+      first = ms;
+    else
+      pause = std::min(pause, ms);
+
+    start = Clock::now();
+    pool.enqueue([&] { reg::writeSnapshotFile(path, staging.bytes); });
+    pool.wait();
+    write = std::min(write, nanosPerEntity(start, Clock::now(), 1) / 1e6);
+  }
+  std::filesystem::remove(path);
+  report.add("autosaveFirstPause", count, 4, first, "ms");
+  report.add("autosavePause", count, 4, pause, "ms");
+  report.add("autosaveWrite", count, 4, write, "ms");
+  report.add("autosaveStaged", count, 4,
+             static_cast<double>(staging.bytes.size()), "bytes");
+}
+
+// A wave of enemies is gone: half the archetypes are left empty and the others
+// with a fifth of their rows. Compaction gives the memory back within a budget
+// per frame, sorting the rows that are left by position on the way
+void benchCompact(Report &report, std::size_t count)
+{
+  constexpr std::size_t Archetypes = 128;
+  constexpr std::size_t FrameBudget = 256 * 1024;
+  World world;
+  spread(world, count, Archetypes);
+  std::vector<reg::Entity> despawned;
+  for (std::size_t i = 0; i < world.entities.size(); ++i)
+    if (i < world.entities.size() / 2 || i % 5 != 0)
+      despawned.push_back(world.entities[i]);
+  world.registry.removeBatch(despawned);
+
+  std::size_t frames = 0;
+  std::size_t reclaimed = 0;
+  std::size_t dropped = 0;
+  double worst = 0.0;
+  for (bool passCompleted = false; !passCompleted; ++frames) {
+    const auto start = Clock::now();
+    const reg::CompactReport<BenchComponents::Bitmask> compacted =
+        world.registry.compact<Position>(
+            [](const Position &a, const Position &b) { return a.x < b.x; },
+            {.budgetBytes = FrameBudget});
+    worst = std::max(worst, nanosPerEntity(start, Clock::now(), 1) / 1e6);
+    reclaimed += compacted.bytesReclaimed;
+    for (const auto &archetype : compacted.archetypes)
+      dropped += archetype.dropped ? 1 : 0;
+    passCompleted = compacted.passCompleted;
+  }
+  report.add("compactReclaimed", count, Archetypes,
+             static_cast<double>(reclaimed), "bytes");
+  report.add("compactDropped", count, Archetypes,
+             static_cast<double>(dropped), "archetypes");
+  report.add("compactFrames", count, Archetypes, static_cast<double>(frames),
+             "frames");
+  report.add("compactWorstFrame", count, Archetypes, worst, "ms");
+}
+
+// Sprites of a few textures spawned in random order, written every frame as
+// one vertex each into a batch. Either every sprite resolves its own texture,
+// visiting the variant and looking the slot up as Renderer2d::allocateTextures
+// does, or the texture is a shared component resolved once per chunk view,
+// after compact() grouped the rows
+void benchSharedMaterial(Report &report, std::size_t count)
+{
+  constexpr std::size_t Textures = 16;
+  constexpr int Frames = 50;
+  struct Vertex {
+    float x = 0.f;
+    float y = 0.f;
+    float texIndex = 0.f;
+  };
+  std::array<FakeTexture, Textures> textures = {};
+  std::uint32_t nextSlot = 1;
+  auto slotOf = [&nextSlot](FakeTexture &texture) {
+    if (texture.slot == 0)
+      texture.slot = nextSlot++;
+    return static_cast<float>(texture.slot);
+  };
+  auto resolve = [&slotOf](const TextureRef &ref) {
+    return std::visit(
+        [&slotOf](const auto &source) {
+          if constexpr (std::is_same_v<std::decay_t<decltype(source)>,
+                                       SheetRef>)
+            return slotOf(*source.texture);
+          else
+            return slotOf(*source);
+        },
+        ref.source);
+  };
+  std::mt19937 rng(17);
+  Registry perEntity;
+  Registry shared;
+  for (std::size_t i = 0; i < count; ++i) {
+    FakeTexture *texture = &textures[rng() % Textures];
+    const float x = static_cast<float>(i);
+    TextureRef ref{texture};
+    if (rng() % 2 != 0)
+      ref.source = SheetRef{texture, static_cast<std::uint16_t>(i)};
+    perEntity.createComponents(perEntity.createEntity(), Position{x, 0.f},
+                               std::move(ref));
+    shared.createComponents(shared.createEntity(), Position{x, 0.f},
+                            Material{texture});
+  }
+
+  std::vector<Vertex> batch(count);
+  float checksum = 0.f;
+  auto start = Clock::now();
+  for (int frame = 0; frame < Frames; ++frame) {
+    Vertex *vertex = batch.data();
+    for (auto chunk : perEntity.queryConst<Position, TextureRef>()) {
+      const Position *p = std::get<0>(chunk.arrays);
+      const TextureRef *t = std::get<1>(chunk.arrays);
+      for (std::size_t i = 0; i < chunk.count; ++i)
+        *vertex++ = {p[i].x, p[i].y, resolve(t[i])};
+    }
+    checksum += batch[static_cast<std::size_t>(frame)].texIndex;
+  }
+  report.add("spritesPerEntityTexture", count, 1,
+             nanosPerEntity(start, Clock::now(), count * Frames), "ns/entity");
+
+  start = Clock::now();
+  shared.compact();
+  report.add("sharedRegroup", count, 1,
+             nanosPerEntity(start, Clock::now(), count), "ns/entity");
+  std::size_t views = 0;
+  start = Clock::now();
+  for (int frame = 0; frame < Frames; ++frame) {
+    Vertex *vertex = batch.data();
+    for (auto chunk : shared.queryConst<Position, Material>()) {
+      const Position *p = std::get<0>(chunk.arrays);
+      const float texIndex = slotOf(*std::get<1>(chunk.arrays)[0].texture);
+      for (std::size_t i = 0; i < chunk.count; ++i)
+        *vertex++ = {p[i].x, p[i].y, texIndex};
+      ++views;
+    }
+    checksum += batch[static_cast<std::size_t>(frame)].texIndex;
+  }
+  report.add("spritesSharedMaterial", count, 1,
+             nanosPerEntity(start, Clock::now(), count * Frames), "ns/entity");
+  report.add("sharedMaterialViews", count, 1,
+             static_cast<double>(views / Frames), "views");
+  g_checksum += checksum;
+}
+
+// Projectiles at 10k spawns and despawns per second at 60 frames per second,
+// each living one second, next to a world of count entities. Despawning
+// either removes the entity and spawning creates it again, or both go through
+// an EntityPool. Frame times are reported once the bullet count is steady
+using Bullet = Marker<0>;
+template <typename Spawn, typename Despawn>
+void benchProjectileFrames(Report &report, std::size_t count,
+                           const char *name, Spawn &&spawn, Despawn &&despawn)
+{
+  constexpr std::size_t SpawnsPerFrame = 10'000 / 60;
+  constexpr std::size_t Lifetime = 60;
+  constexpr std::size_t Frames = 11 * Lifetime;
+  Registry registry;
+  populate(registry, count);
+  std::vector<reg::Entity> alive(SpawnsPerFrame * Lifetime);
+  std::vector<double> times;
+  for (std::size_t frame = 0; frame < Frames; ++frame) {
+    std::span<reg::Entity> slot(
+        alive.data() + (frame % Lifetime) * SpawnsPerFrame, SpawnsPerFrame);
+    const auto start = Clock::now();
+    if (frame >= Lifetime)
+      despawn(registry, std::span<const reg::Entity>(slot));
+    for (std::size_t i = 0; i < SpawnsPerFrame; ++i)
+      slot[i] = spawn(registry, Position{static_cast<float>(i), 0.f});
+    for (auto chunk : registry.query<Position, const Velocity, Bullet>()) {
+      auto [p, v, bullet] = chunk.arrays;
+      for (size_t i = 0; i < chunk.count; ++i)
+        p[i].x += v[i].x * 0.016f;
+    }
+    if (frame >= Lifetime)
+      times.push_back(nanosPerEntity(start, Clock::now(), 1) / 1e3);
+  }
+
+  double mean = 0.0;
+  for (double time : times)
+    mean += time / static_cast<double>(times.size());
+  double variance = 0.0;
+  for (double time : times)
+    variance += (time - mean) * (time - mean);
+  variance /= static_cast<double>(times.size());
+  const std::string prefix = name;
+  report.add(prefix + "FrameMean", count, 5, mean, "us/frame");
+  report.add(prefix + "FrameStddev", count, 5, std::sqrt(variance),
+             "us/frame");
+  report.add(prefix + "FrameWorst", count, 5,
+             *std::max_element(times.begin(), times.end()), "us/frame");
+}
+void benchProjectiles(Report &report, std::size_t count)
+{
+  benchProjectileFrames(
+      report, count, "projectileRemove",
+      [](Registry &registry, const Position &position) {
+        reg::Entity e = registry.createEntity();
+        registry.createComponents(e, Position{position}, Velocity{1.f, 0.f},
+                                  Bullet{});
+        return e;
+      },
+      [](Registry &registry, std::span<const reg::Entity> entities) {
+        registry.removeBatch(entities);
+      });
+
+  reg::EntityPool<BenchComponents> pool(
+      reg::Prefab<BenchComponents>::of(Position{}, Velocity{1.f, 0.f},
+                                       Bullet{}));
+  benchProjectileFrames(
+      report, count, "projectilePool",
+      [&pool](Registry &registry, const Position &position) {
+        reg::Entity e = pool.acquire(registry);
+        registry.getComponent<Position>(e) = position;
+        return e;
+      },
+      [&pool](Registry &registry, std::span<const reg::Entity> entities) {
+        pool.release(registry, entities);
+      });
+}
+
+// The cull and respawn frames of removeBatch64+respawn with the registry
+// recording component events, delivered once per frame. observe(registry)
+// subscribes whatever the variant observes
+template <typename Observe>
+void benchObservedFrames(Report &report, std::size_t count, const char *name,
+                         Observe &&observe)
+{
+  constexpr std::size_t BatchSize = 64;
+  constexpr int Frames = 1000;
+  Registry registry;
+  std::vector<reg::Entity> entities = populate(registry, count);
+  observe(registry);
+  registry.deliverEvents();
+  std::mt19937 rng(7);
+  std::vector<reg::Entity> batch(BatchSize);
+
+  const auto start = Clock::now();
+  for (int frame = 0; frame < Frames; ++frame) {
+    for (std::size_t i = 0; i < BatchSize; ++i) {
+      std::swap(entities[rng() % (entities.size() - i)],
+                entities[entities.size() - 1 - i]);
+      batch[i] = entities[entities.size() - 1 - i];
+    }
+    registry.removeBatch(batch);
+    std::vector<reg::Entity> spawned = registry.createEntities(
+        BatchSize, Position{}, Velocity{1.f, 1.f}, Health{});
+    std::copy(spawned.begin(), spawned.end(), entities.end() - BatchSize);
+    registry.deliverEvents();
+  }
+  report.add(name, count, 4, nanosPerEntity(start, Clock::now(), Frames),
+             "ns/frame");
+}
+// Nothing observed, a component nobody adds or removes observed, and an
+// index of the entities holding Velocity kept by its add and remove events
+void benchObservers(Report &report, std::size_t count)
+{
+  benchObservedFrames(report, count, "churnUnobserved", [](Registry &) {});
+  benchObservedFrames(report, count, "churnOtherObserved",
+                      [](Registry &registry) {
+                        registry.onAdded<Bullet>(
+                            [](std::span<const reg::Entity>) {});
+                        registry.onRemoved<Bullet>(
+                            [](std::span<const reg::Entity>) {});
+                      });
+  std::vector<std::uint8_t> indexed;
+  auto slot = [&indexed](reg::Entity entity) -> std::uint8_t & {
+    const std::size_t index = reg::entityIndex(entity);
+    if (index >= indexed.size())
+      indexed.resize(index + 1, 0);
+    return indexed[index];
+  };
+  benchObservedFrames(
+      report, count, "churnObserved", [&slot](Registry &registry) {
+        registry.onAdded<Velocity>(
+            [&slot](std::span<const reg::Entity> entities) {
+              for (reg::Entity e : entities)
+                slot(e) = 1;
+            });
+        registry.onRemoved<Velocity>(
+            [&slot](std::span<const reg::Entity> entities) {
+              for (reg::Entity e : entities)
+                slot(e) = 0;
+            });
+      });
+  g_checksum +=
+      static_cast<double>(std::count(indexed.begin(), indexed.end(), 1));
+}
+
+int usage(const char *program)
+{
+  std::fprintf(stderr,
+               "usage: %s [--max-entities N] [--output FILE]\n"
+               "  --max-entities  largest world measured, from 1000 to "
+               "1000000 (default)\n"
+               "  --output        write the JSON report to FILE instead of "
+               "stdout\n",
+               program);
+  return 1;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+  std::size_t maxEntities = 1'000'000;
+  const char *output = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--max-entities") == 0 && i + 1 < argc)
+      maxEntities = std::strtoull(argv[++i], nullptr, 10);
+    else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+      output = argv[++i];
+    else
+      return usage(argv[0]);
+  }
+  if (maxEntities < 1'000)
+    return usage(argv[0]);
+
+  pain::logWrapper::InitLogger();
+  // the report goes to stdout, logs must not end up in the middle of it.
+  // Written to a file, only the warnings are kept: every archetype the bench
+  // creates would log otherwise
+  pain::logWrapper::GetCoreLogger()->set_level(
+      output == nullptr ? spdlog::level::off : spdlog::level::warn);
+
+  Report report;
+  ThreadPool pool;
+  for (std::size_t count = 1'000; count <= maxEntities; count *= 10) {
+    // as many runs as it takes to measure about a million entities
+    const int reps = static_cast<int>(
+        std::clamp<std::size_t>(1'000'000 / count, 3, 50));
+    benchCreate(report, count, reps);
+    for (std::size_t archetypes : {1, 10, 100})
+      benchQuery(report, pool, count, archetypes, reps);
+    benchGetComponents(report, count, reps);
+    benchTransitions(report, count, reps);
+    benchRemove(report, count, reps);
+  }
+
+  const std::size_t worldSize = std::min<std::size_t>(maxEntities, 100'000);
+  benchRemoveBatchRespawn(report, worldSize);
+  benchFrameAllocations(report, pool, worldSize);
+  benchStatusToggle(report);
+  benchChangedOnly(report, worldSize);
+  benchSnapshot(report, worldSize, 20);
+  benchAutosave(report, pool, std::min<std::size_t>(maxEntities, 500'000));
+  benchCompact(report, worldSize);
+  benchProjectiles(report, worldSize);
+  benchSharedMaterial(report, worldSize);
+  benchObservers(report, worldSize);
+
+  std::FILE *out = output != nullptr ? std::fopen(output, "w") : stdout;
+  if (out == nullptr) {
+    std::fprintf(stderr, "couldn't open %s\n", output);
+    return 1;
+  }
+  report.write(out, pool.size(), maxEntities);
+  if (out != stdout)
+    std::fclose(out);
+  return 0;
+}
@@ -42,6 +42,8 @@ public:
   reg::Entity getChunk(int x, int y) const;
 
 private:
+  // rings of disabled chunks kept around the visible ones
+  static constexpr int PausedChunksRing = 2;
   int m_radius = 2;
   int m_numDiv = 32;
   float m_chunkSize = 4.f;
@@ -111,19 +111,26 @@ void MainMap::updateSurroundingChunks(const glm::vec2 &playerPos,
   PROFILE_FUNCTION()
   if (m_chunkAt != getChunkCoordinate(playerPos, m_chunkSize)) {
     m_chunkAt = getChunkCoordinate(playerPos, m_chunkSize);
+    // chunks just out of sight are only paused, walking back to them doesn't
+    // recreate them. Far away ones are removed to bound memory
     for (auto it = m_chunks.begin(); it != m_chunks.end();) {
       Chunk::Script &cs = scene.getNativeScript<Chunk::Script>(it->second);
 
-      if (cs.isOutsideRadius(m_chunkAt, m_radius + 1)) {
+      if (cs.isOutsideRadius(m_chunkAt, m_radius + 1 + PausedChunksRing)) {
         scene.removeEntity(it->second);
         it = m_chunks.erase(it); // it now will be the next iterator
       } else {
+        if (cs.isOutsideRadius(m_chunkAt, m_radius + 1))
+          scene.setEnabled(it->second, false);
         ++it;
       }
     }
     for (int x = m_chunkAt.x - m_radius; x <= m_chunkAt.x + m_radius; x++) {
       for (int y = m_chunkAt.y - m_radius; y <= m_chunkAt.y + m_radius; y++) {
-        if (!m_chunks.contains({x, y})) {
+        auto it = m_chunks.find({x, y});
+        if (it != m_chunks.end()) {
+          scene.setEnabled(it->second, true);
+        } else {
           reg::Entity e =
               Chunk::create(scene, {x, y}, m_numDiv, m_chunkSize, *this);
           m_chunks.emplace(std::make_pair(x, y), e);
@@ -48,7 +48,7 @@ void Player::Script::onRender(pain::Renderers &renderer, bool isMinimized,
 
 void Player::Script::onCreate()
 {
-  getComponent<pain::Movement2dComponent>().m_rotationSpeed = 1.f;
+  getComponent<pain::RotationComponent>().m_rotationSpeed = 1.f;
 
   getEventDispatcher().subscribe<pain::CollisionEvent>(
       [&](const pain::CollisionEvent &e) {
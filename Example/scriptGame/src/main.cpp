@@ -180,6 +180,7 @@ pain::Application *pain::createApplication()
   scene.addSystem<Systems::NativeScript>();
   scene.addSystem<Systems::LuaScript>();
   scene.addSystem<Systems::Kinematics>();
+  scene.addSystem<Systems::TransformHierarchy>();
   scene.addSystem<Systems::LuaSchedulerSys>();
   scene.addSystem<Systems::ParticleSys>();
 
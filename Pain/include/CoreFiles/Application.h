@@ -15,6 +15,7 @@
 #include "Assets/DeltaTime.h"
 #include "Core.h"
 #include "CoreFiles/EndGameFlags.h"
+#include "CoreFiles/FrameArena.h"
 #include "CoreRender/Renderer/Renderer2d.h"
 #include "Debugging/DebuggingImGui.h"
 #include "GUI/ImGuiSys.h"
@@ -143,6 +144,13 @@ public:
   /** Returns the 2D renderer instance. */
   Renderers &getRenderers() { return m_renderers; }
 
+  /** Returns the per-frame allocator, reset at every iteration of the loop. */
+  FrameArena &getFrameArena() { return m_frameArena; }
+
+  /** Returns the heap allocations made by the previous iteration of the loop.
+   * Once warmed up, a frame of the engine systems should make none. */
+  uint64_t getFrameAllocations() const { return m.frameAllocations; }
+
   /** Returns the framebuffer specification used by the render pipeline. */
   const FrameBufferCreationInfo &getFrameInfo() const
   {
@@ -208,7 +216,8 @@ public:
   template <typename... Components> UIScene &createUIScene(Components... args)
   {
     m_uiScene =
-        std::make_unique<UIScene>(m_eventDispatcher, m_luaState, m_threadPool);
+        std::make_unique<UIScene>(m_eventDispatcher, m_luaState, m_threadPool,
+                                  m_frameArena);
     m_uiScene->createComponents(m_uiScene->getEntity(),
                                 std::forward<Components>(args)...);
     m_uiScene->addSystem<Systems::ImGuiSys>(m_sdlContext, m_window);
@@ -238,6 +247,11 @@ private:
     constexpr static int FPS_SAMPLE_COUNT = 64;
     double fpsSamples[FPS_SAMPLE_COUNT] = {0};
     int currentSample = 1;
+    /** Global allocations counted when the current frame started. */
+    uint64_t frameStartAllocations = 0;
+    /** Global allocations and arena bytes of the previous frame. */
+    uint64_t frameAllocations = 0;
+    size_t frameArenaBytes = 0;
     AppContext context;
   };
 
@@ -249,6 +263,7 @@ private:
   std::unique_ptr<UIScene> m_uiScene = nullptr;
   Renderers m_renderers;
   ThreadPool m_threadPool;
+  FrameArena m_frameArena;
   sol::state m_luaState;
   reg::EventDispatcher m_eventDispatcher;
   Scene m_worldScene;
@@ -0,0 +1,110 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+
+#pragma once
+
+#include "Core.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+class ThreadPool;
+
+namespace pain
+{
+
+/**
+ * @brief Linear allocator for data that only lives during one frame.
+ *
+ * Allocating only moves a pointer forward and freeing does nothing, the whole
+ * arena is rewound by reset(), which the application calls once per
+ * iteration of its loop. Every thread of the scene thread pool, and the
+ * thread that owns the pool, allocate from their own sub-arena, so no lock is
+ * taken. Any other thread gets the heap.
+ *
+ * Sub-arenas are exposed as std::pmr::memory_resource, so standard containers
+ * can live in them:
+ * @code
+ * std::pmr::vector<Pair> pairs(frameResource());
+ * @endcode
+ *
+ * A frame asking for more than a sub-arena holds gets extra blocks from the
+ * heap. They are merged into one bigger block on the next reset, so after a
+ * few frames a steady workload stops allocating at all.
+ *
+ * @warning Memory from the arena must not be used after the reset that ends
+ * its frame, so containers allocated from it must never outlive the frame.
+ */
+class FrameArena
+{
+public:
+  /** @brief Bytes of a sub-arena before it ever grows. */
+  static constexpr size_t DefaultBlockBytes = 64 * 1024;
+
+  /** @brief Usage of all sub-arenas. */
+  struct Stats {
+    /** Bytes handed out since the last reset. */
+    size_t bytesUsed = 0;
+    /** Bytes reserved by the sub-arenas, extra blocks included. */
+    size_t bytesReserved = 0;
+    /** Heap allocations made by the arena since it was created. */
+    size_t heapAllocations = 0;
+  };
+
+  /**
+   * @brief Creates one sub-arena per thread of pool.
+   *
+   * @param pool Pool whose workers, and the thread owning it, allocate from
+   * the arena, see ThreadPool::threadIndex.
+   * @param blockBytes Initial size of every sub-arena.
+   */
+  explicit FrameArena(const ThreadPool &pool,
+                      size_t blockBytes = DefaultBlockBytes);
+  ~FrameArena();
+  NONCOPYABLE(FrameArena);
+  NONMOVABLE(FrameArena);
+
+  /** @brief Sub-arena of the calling thread, the heap outside the pool. */
+  std::pmr::memory_resource *resource();
+
+  /**
+   * @brief Sub-arena of a thread, see ThreadPool::threadIndex.
+   *
+   * ThreadPool::NotInPool gets std::pmr::new_delete_resource().
+   */
+  std::pmr::memory_resource *resource(size_t thread);
+
+  /**
+   * @brief Rewinds every sub-arena, invalidating all the memory handed out.
+   *
+   * Must not overlap with any allocation from the arena.
+   */
+  void reset();
+
+  /** @brief Current usage, not synchronized with allocating threads. */
+  Stats stats() const;
+
+private:
+  class Block;
+  const ThreadPool &m_pool;
+  std::vector<std::unique_ptr<Block>> m_blocks;
+};
+
+/**
+ * @brief Number of calls to the global operator new since the program started.
+ *
+ * Counted by the engine replacement of operator new, so the difference between
+ * two frames tells whether a frame allocated. Over-aligned allocations are
+ * counted as well. The replacement is only compiled with
+ * PAIN_COUNT_ALLOCATIONS, set by debug builds, the CMake option of the same
+ * name and pain_ecs_bench. Without it the count stays 0.
+ */
+uint64_t globalAllocationCount();
+
+} // namespace pain
@@ -6,9 +6,12 @@
 
 // LogWrapper.h
 #pragma once
-#include "pch.h"
 
+// only the standard library and spdlog, so headless targets like the ECS
+// benchmark can log without SDL or glm
 #include "Core.h"
+#include <cassert>
+#include <memory>
 #include <spdlog/logger.h>
 
 namespace pain
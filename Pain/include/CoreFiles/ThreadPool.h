@@ -2,10 +2,14 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <cstdint>
+#include <exception>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <thread>
+#include <type_traits>
 #include <vector>
 
 /**
@@ -56,16 +60,84 @@ public:
   /** @brief Blocks until all queued and active jobs are finished. */
   void wait();
 
+  /**
+   * @brief Runs job(i) for every i in [0, count) and blocks until all of them
+   * returned.
+   *
+   * Indices are claimed one by one by the workers and by the calling thread,
+   * which takes part in the work. Unlike wait(), only the indices of this
+   * call are awaited, so unrelated background jobs never stall it.
+   *
+   * Nothing is allocated: the call publishes its job to the idle workers
+   * instead of queuing it. A call made while another one is running, e.g.
+   * from inside its job, runs its indices on the calling thread alone.
+   *
+   * If a job throws, the indices not started yet are skipped and the first
+   * exception is rethrown here, once every worker has left the call.
+   *
+   * @param count Number of indices to run.
+   * @param job Callable invoked once per index, possibly concurrently.
+   */
+  template <typename Fn> void parallelFor(size_t count, Fn &&job)
+  {
+    using Job = std::remove_reference_t<Fn>;
+    const void *fn = std::addressof(job);
+    runParallel(count, {const_cast<void *>(fn), [](void *erased, size_t i) {
+                          (*static_cast<Job *>(erased))(i);
+                        }});
+  }
+
+  /** @brief Number of worker threads, the calling thread not included. */
+  size_t size() const { return m_workers.size(); }
+
+  /** @brief threadIndex() of the threads that don't belong to the pool. */
+  static constexpr size_t NotInPool = SIZE_MAX;
+
+  /**
+   * @brief Index of the calling thread among the threads of this pool.
+   *
+   * 0 for the thread that created the pool, 1 + the worker number for its
+   * workers, and NotInPool for any other thread, workers of other pools
+   * included. Used to give every thread its own slot in per-thread data, see
+   * FrameArena.
+   */
+  size_t threadIndex() const;
+
 private:
+  /** @brief Job of parallelFor, erased without allocating. */
+  struct ParallelJob {
+    void *fn;
+    void (*call)(void *fn, size_t index);
+  };
+  /** @brief parallelFor in progress, lives on the stack of its caller. */
+  struct ParallelRun {
+    ParallelJob job;
+    size_t count;
+    std::atomic<size_t> next{0};
+    /** Workers inside the run, guarded by m_mutex. */
+    size_t helpers = 0;
+    /** First exception thrown by a worker, guarded by m_mutex. */
+    std::exception_ptr error = nullptr;
+  };
+
+  void runParallel(size_t count, ParallelJob job);
+  /** @brief Runs indices until none is left, returns what a job threw. */
+  static std::exception_ptr drain(ParallelRun &run);
+
   /**
    * @brief Main execution loop for worker threads.
    *
    * Each worker waits for jobs to become available and executes them until
-   * the pool is stopped.
+   * the pool is stopped. Workers join a published parallelFor before taking
+   * queued jobs.
+   *
+   * @param index Worker number, see threadIndex().
    */
-  void workerLoop();
+  void workerLoop(size_t index);
 
 private:
+  /** Thread that created the pool, index 0. */
+  std::thread::id m_owner;
   /** Worker threads owned by the pool. */
   std::vector<std::thread> m_workers;
   /** Queue of pending jobs. */
@@ -80,4 +152,8 @@ private:
   std::atomic<bool> m_stopping{false};
   /** Number of jobs currently being executed. */
   std::atomic<size_t> m_activeJobs{0};
+  /** parallelFor open to idle workers, guarded by m_mutex. */
+  ParallelRun *m_parallel = nullptr;
+  /** Counts parallelFor calls, so a worker joins each of them only once. */
+  uint64_t m_parallelGeneration = 0;
 };
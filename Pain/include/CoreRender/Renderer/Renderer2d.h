@@ -135,6 +135,31 @@ struct Renderer2d {
                     glm::vec2(0.0f, 0.0f), glm::vec2(1.0f, 0.0f),
                     glm::vec2(1.0f, 1.0f), glm::vec2(0.0f, 1.0f)});
 
+  /**
+   * @brief Slot of a texture inside the quad batches, allocated on first use.
+   *
+   * Resolve it once, then draw every quad of that texture with the overloads
+   * taking a texture index, e.g. once per chunk of sprites sharing a material.
+   */
+  float textureIndex(Texture &texture) { return allocateTextures(texture); }
+
+  /// @brief Draw an axis-aligned quad of a texture index from textureIndex().
+  void drawQuad(const glm::vec2 &position, const glm::vec2 &size,
+                const Color &tintColor, RenderLayer layer, float texIndex,
+                const float tilingFactor = 1.0f,
+                const std::array<glm::vec2, 4> &textureCoordinate = {
+                    glm::vec2(0.0f, 0.0f), glm::vec2(1.0f, 0.0f),
+                    glm::vec2(1.0f, 1.0f), glm::vec2(0.0f, 1.0f)});
+
+  /// @brief Draw a rotated quad of a texture index from textureIndex().
+  void drawQuad(const glm::vec2 &position, const glm::vec2 &size,
+                const Color &tintColor, const float rotationRadians,
+                RenderLayer layer, float texIndex,
+                const float tilingFactor = 1.0f,
+                const std::array<glm::vec2, 4> &textureCoordinate = {
+                    glm::vec2(0.0f, 0.0f), glm::vec2(1.0f, 0.0f),
+                    glm::vec2(1.0f, 1.0f), glm::vec2(0.0f, 1.0f)});
+
   // ================================================================= //
   // Draw Triangles
   // ================================================================= //
@@ -56,6 +56,11 @@ struct NativeScript;
 struct ImGuiScript;
 struct Collider;
 struct SAPCollider;
+struct Parent;
+struct LocalTransform2d;
+struct WorldTransform2d;
+struct BatchedSprite;
+struct SpriteMaterial;
 } // namespace tag
 
 /**
@@ -84,7 +89,12 @@ using WorldComponents = reg::CompileTimeBitMask< //
     tag::Triangule,                              // 2048
     tag::LuaScript,                              // 4096
     tag::SAPCollider,                            // 8192
-    tag::LuaScheduleTask                         // 16384
+    tag::LuaScheduleTask,                        // 16384
+    tag::Parent,                                 // 32768
+    tag::LocalTransform2d,                       // 65536
+    tag::WorldTransform2d,                       // 131072
+    tag::BatchedSprite,                          // 262144
+    tag::SpriteMaterial                          // 524288
     >;
 
 /**
@@ -238,6 +238,62 @@ struct SpriteComponent {
   }
 };
 
+/**
+ * @brief Texture, layer and tiling shared by a group of batched sprites.
+ *
+ * A shared component: queries asking for it split their chunk views wherever
+ * its value changes, and Scene::compact() regroups entities of the same
+ * material, so the renderer resolves the texture once per view instead of
+ * once per sprite. Entities using it carry a BatchedSpriteComponent instead
+ * of a SpriteComponent.
+ */
+struct SpriteMaterialComponent {
+  using tag = tag::SpriteMaterial;
+  static constexpr bool shared = true;
+
+  /** @brief Texture drawn, the texture of the sheet for sheet materials. */
+  Texture *m_texture = &TextureManager::getDefaultTexture(
+      TextureManager::DefaultTexture::Error);
+  /** @brief Sheet the sprites pick their entry from, null for a texture. */
+  TextureSheet *m_sheet = nullptr;
+  RenderLayer layer = RenderLayer::Default; /**< Rendering order layer. */
+  float m_tilingFactor = 1.f;               /**< Texture tiling multiplier. */
+
+  bool operator==(const SpriteMaterialComponent &) const = default;
+
+  /** @brief Creates a material drawing a whole texture. */
+  static SpriteMaterialComponent
+  create(Texture &texture, RenderLayer layer = RenderLayer::Default,
+         float tilingFactor = 1.f)
+  {
+    return SpriteMaterialComponent{.m_texture = &texture,
+                                   .layer = layer,
+                                   .m_tilingFactor = tilingFactor};
+  }
+
+  /** @brief Creates a material drawing entries of a texture sheet. */
+  static SpriteMaterialComponent
+  create(TextureSheet &sheet, RenderLayer layer = RenderLayer::Default)
+  {
+    return SpriteMaterialComponent{
+        .m_texture = &sheet.getTexture(), .m_sheet = &sheet, .layer = layer};
+  }
+};
+
+/**
+ * @brief Per entity part of a sprite drawn with a SpriteMaterialComponent.
+ *
+ * Holds what differs between the sprites of one material, the texture and
+ * layer come from the material.
+ */
+struct BatchedSpriteComponent {
+  using tag = tag::BatchedSprite;
+
+  glm::vec2 m_size{0.1f, 0.1f};       /**< Sprite size in world units. */
+  Color color = {255, 255, 255, 255}; /**< Tint color. */
+  unsigned short m_sheetId = 0;       /**< Entry of the material sheet. */
+};
+
 /**
  * @brief ECS component representing a non-textured primitive shape.
  *
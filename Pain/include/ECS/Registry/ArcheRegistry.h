@@ -8,29 +8,317 @@
 #pragma once
 
 #include "CoreFiles/LogWrapper.h"
+#include "CoreFiles/ThreadPool.h"
 #include "ECS/Registry/Archetype.h"
 #include "ECS/Registry/Bitmask.h"
 #include "ECS/Registry/ExcludeComponents.h"
+#include "ECS/Registry/MaskTable.h"
+#include "ECS/Registry/Observers.h"
+#include "ECS/Registry/Prefab.h"
+#include "ECS/Registry/Snapshot.h"
+#include "ECS/Registry/SparseSet.h"
 
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <deque>
+#include <functional>
 #include <iostream>
-#include <queue>
+#include <map>
+#include <memory_resource>
+#include <mutex>
+#include <numeric>
+#include <optional>
 #include <span>
 #include <typeindex>
 
 namespace reg
 {
 
+// A ChunkView is a run of enabled rows inside one memory chunk of an
+// archetype, the whole chunk unless some of its entities are disabled: every
+// array holds exactly count rows and entities[i] owns the i-th row of each
+// array
 template <typename... Components> struct ChunkView {
   std::tuple<Components *...> arrays = {};
-  std::vector<reg::Entity> &entities;
+  std::span<reg::Entity> entities;
   size_t count = 0;
 };
 template <typename... Components> struct ChunkViewConst {
   std::tuple<Components *...> arrays = {};
-  const std::vector<reg::Entity> &entities;
+  std::span<const reg::Entity> entities;
   size_t count;
 };
 
+// ---------------------------------------------------- //
+// Cached query result
+// ---------------------------------------------------- //
+
+// Range over the chunks of the archetypes that matched a query. The archetype
+// list is owned by the registry and only grows when a new archetype is
+// created. Chunks are built on dereference, so holding or iterating a
+// QueryView never allocates. Disabled rows are skipped: a chunk holding some
+// is split into one view per run of enabled rows, found 64 rows at a time.
+// When the query asks for a SharedComponent, runs are also split wherever its
+// value changes, so every view holds one value of each it asks for.
+//
+// Dereferencing a mutable view stamps the chunk of every non const component
+// with the tick the view was made at. A view made with changedSince only
+// yields the chunks where one of its components was stamped after that tick
+template <typename ArchetypeT, typename... Components> class QueryView
+{
+public:
+  using Chunk = std::conditional_t<std::is_const_v<ArchetypeT>,
+                                   ChunkViewConst<Components...>,
+                                   ChunkView<Components...>>;
+  using ArchetypeList = std::vector<std::remove_const_t<ArchetypeT> *>;
+
+  // What a view does besides yielding chunks
+  struct Tracking {
+    // tick stamped on the chunks handed out as mutable
+    ChangeTick tick = 0;
+    // skip chunks whose components weren't written after changedSince
+    bool changedOnly = false;
+    ChangeTick changedSince = 0;
+  };
+
+  class Iterator
+  {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Chunk;
+    using difference_type = std::ptrdiff_t;
+
+    Iterator() = default;
+    Iterator(const ArchetypeList *archetypes, size_t archetype,
+             Tracking tracking)
+        : m_archetypes(archetypes), m_archetype(archetype),
+          m_tracking(tracking)
+    {
+      skipEmpty();
+    }
+    Chunk operator*() const
+    {
+      return makeChunk(*(*m_archetypes)[m_archetype], m_chunk, m_row, m_count,
+                       m_tracking.tick);
+    }
+    Iterator &operator++()
+    {
+      m_row += m_count;
+      skipEmpty();
+      return *this;
+    }
+    Iterator operator++(int)
+    {
+      Iterator it = *this;
+      ++(*this);
+      return it;
+    }
+    bool operator==(const Iterator &other) const
+    {
+      return m_archetype == other.m_archetype && m_chunk == other.m_chunk &&
+             m_row == other.m_row;
+    }
+
+  private:
+    const ArchetypeList *m_archetypes = nullptr;
+    size_t m_archetype = 0;
+    size_t m_chunk = 0;
+    // run of enabled rows inside the chunk
+    size_t m_row = 0;
+    size_t m_count = 0;
+    Tracking m_tracking = {};
+
+    static constexpr bool SplitsShared = (SharedComponent<Components> || ...);
+
+    // First row of the chunk in (row, end) where a shared C changes value,
+    // end for other components. Rows are compared inline, a block at a time
+    // without branching inside the block, since runs are usually long
+    template <typename C>
+    static size_t sharedRunEnd(const ArchetypeT &archetype, size_t chunk,
+                               size_t row, size_t end)
+    {
+      if constexpr (SharedComponent<C>) {
+        constexpr size_t Block = 8;
+        const C *values =
+            archetype.template getComponent<std::remove_const_t<C>>()
+                .chunkData(chunk);
+        const C &value = values[row];
+        size_t next = row + 1;
+        for (; next + Block <= end; next += Block) {
+          bool same = true;
+          for (size_t i = 0; i < Block; ++i)
+            same &= values[next + i] == value;
+          if (!same)
+            break;
+        }
+        while (next < end && values[next] == value)
+          ++next;
+        return next;
+      } else {
+        return end;
+      }
+    }
+
+    // move to the next run of enabled rows, the next chunk once the runs of
+    // the current one are over and the next archetype after its last chunk.
+    // Unchanged chunks are skipped when only changes are wanted
+    void skipEmpty()
+    {
+      while (m_archetype < m_archetypes->size()) {
+        const ArchetypeT &archetype = *(*m_archetypes)[m_archetype];
+        if (m_chunk >= archetype.chunkCount()) {
+          ++m_archetype;
+          m_chunk = 0;
+          m_row = 0;
+          continue;
+        }
+        const size_t size = archetype.chunkSize(m_chunk);
+        if (m_row >= size ||
+            (m_tracking.changedOnly &&
+             !(archetype.template changedSince<
+                   std::remove_const_t<Components>>(
+                   m_chunk, m_tracking.changedSince) ||
+               ...))) {
+          ++m_chunk;
+          m_row = 0;
+          continue;
+        }
+        const size_t first = m_chunk * archetype.rowsPerChunk();
+        if (archetype.disabledCount() == 0) {
+          m_count = size - m_row;
+        } else {
+          const size_t begin = archetype.findRow(first + m_row, first + size,
+                                                 false);
+          m_row = begin - first;
+          if (m_row >= size)
+            continue;
+          m_count = archetype.findRow(begin, first + size, true) - begin;
+        }
+        if constexpr (SplitsShared)
+          m_count = std::min({sharedRunEnd<Components>(archetype, m_chunk,
+                                                       m_row,
+                                                       m_row + m_count)...}) -
+                    m_row;
+        return;
+      }
+      m_count = 0;
+    }
+  };
+
+  explicit QueryView(const ArchetypeList &archetypes, Tracking tracking = {})
+      : m_archetypes(&archetypes), m_tracking(tracking)
+  {
+  }
+  Iterator begin() const { return Iterator(m_archetypes, 0, m_tracking); }
+  Iterator end() const
+  {
+    return Iterator(m_archetypes, m_archetypes->size(), m_tracking);
+  }
+  bool empty() const { return begin() == end(); }
+  // number of chunks, O(archetypes), or O(chunks) when only changes are wanted
+  // or some rows are disabled
+  size_t size() const
+  {
+    size_t chunks = 0;
+    if (m_tracking.changedOnly ||
+        std::ranges::any_of(*m_archetypes, [](const auto *archetype) {
+          return archetype->disabledCount() != 0;
+        })) {
+      for (Iterator it = begin(); it != end(); ++it)
+        ++chunks;
+      return chunks;
+    }
+    for (const auto *archetype : *m_archetypes)
+      chunks += archetype->chunkCount();
+    return chunks;
+  }
+  // number of matching archetypes, without creating any chunk
+  size_t archetypeCount() const { return m_archetypes->size(); }
+
+private:
+  const ArchetypeList *m_archetypes;
+  Tracking m_tracking;
+
+  template <typename C>
+  static C *columnData(ArchetypeT &archetype, size_t chunk, ChangeTick tick)
+  {
+    if constexpr (!std::is_const_v<ArchetypeT> && !std::is_const_v<C>)
+      archetype.template markChanged<C>(chunk, tick);
+    return archetype.template getComponent<std::remove_const_t<C>>()
+        .chunkData(chunk);
+  }
+  static Chunk makeChunk(ArchetypeT &archetype, size_t chunk, size_t row,
+                         size_t count, ChangeTick tick)
+  {
+    return Chunk{std::tuple<Components *...>{
+                     columnData<Components>(archetype, chunk, tick) + row...},
+                 archetype.chunkEntities(chunk).subspan(row, count), count};
+  }
+};
+
+// A query resolved once by ArcheRegistry::makeQuery(). It points at the
+// archetype list the registry keeps for its masks, which lives as long as the
+// registry and gains the archetypes created later. Views made from it skip
+// the lookup of the mask pair and only read the registry, so worker threads
+// can make them as long as no archetype is being created
+template <typename ArchetypeT, typename... Components> struct CachedQuery {
+  const std::vector<ArchetypeT *> *archetypes = nullptr;
+};
+
+// ---------------------------------------------------- //
+// Parallel iteration
+// ---------------------------------------------------- //
+
+struct ParallelOptions {
+  // Rows handed to one job. Ranges never cross a chunk, so anything bigger
+  // than a chunk means one job per chunk. 0 picks a grain from the number of
+  // threads, unless deterministic is set, in which case it means whole chunks
+  size_t grainSize = 0;
+  // Partition only by grainSize and never by the number of threads, so the
+  // ranges and their indices are the same on every run and every machine
+  bool deterministic = false;
+  // Where the list of ranges is allocated, the default resource when null.
+  // Systems pass the frame arena of their scene
+  std::pmr::memory_resource *scratch = nullptr;
+};
+// smallest grain picked automatically, below it scheduling costs dominate
+inline constexpr size_t MinParallelGrain = 256;
+// jobs per thread when picking a grain automatically, to balance uneven chunks
+inline constexpr size_t ParallelJobsPerThread = 4;
+
+// ---------------------------------------------------- //
+// Compaction
+// ---------------------------------------------------- //
+
+struct CompactOptions {
+  // Bytes a call may free or move before it stops, the next call resumes
+  // with the following archetype. At least one archetype is done per call.
+  // 0 goes over every archetype at once
+  size_t budgetBytes = 0;
+  // Empty blocks kept at the end of every column, so an archetype that fills
+  // up again right away doesn't allocate them back
+  size_t spareChunks = 0;
+  // Destroy the archetypes left without any entity
+  bool dropEmpty = true;
+};
+template <typename BitmaskT> struct CompactedArchetype {
+  BitmaskT mask;
+  size_t bytesReclaimed = 0;
+  // the archetype was empty and doesn't exist anymore
+  bool dropped = false;
+};
+// What a call to compact() did, only archetypes that gave memory back are
+// listed
+template <typename BitmaskT> struct CompactReport {
+  std::vector<CompactedArchetype<BitmaskT>> archetypes = {};
+  size_t bytesReclaimed = 0;
+  // bytes of the rows moved by sorting
+  size_t bytesMoved = 0;
+  // the call reached the last archetype, the next one starts a new pass
+  bool passCompleted = false;
+};
+
 template <typename... Ts>
 concept IsNoneType = (sizeof...(Ts) == 0);
 
@@ -44,23 +332,59 @@ template <typename ComponentManagerT>
   requires(is_compile_time_bitmask_v<ComponentManagerT>)
 class ArcheRegistry
 {
+  using Bitmask = typename ComponentManagerT::Bitmask;
+  using Record = reg::Record<Bitmask>;
+  using Archetype = reg::Archetype<ComponentManagerT>;
   std::map<Bitmask, Archetype> m_archetypes = {};
+  // Masks of m_archetypes in creation order, scanned when a query is first
+  // made, along with the archetype each one belongs to
+  MaskTable<Bitmask> m_archetypeMasks;
+  std::vector<Archetype *> m_archetypeList;
+  // Archetypes matching each query made so far, keyed by its include and
+  // exclude masks. Updated only when a new archetype is created. Entries are
+  // never erased, CachedQuery points at them. The lock only guards the map,
+  // const queries may be made from worker threads
+  mutable std::map<std::pair<Bitmask, Bitmask>, std::vector<Archetype *>>
+      m_queries = {};
+  mutable std::mutex m_queriesMutex;
   std::vector<Record> m_records;
-  std::queue<reg::Entity> m_availableEntities = {};
+  // recycled ids, the oldest removal is reused first
+  std::deque<reg::Entity> m_availableEntities = {};
   std::int32_t numberOfEntities = -1;
+  // stamped on every chunk written from now on, see advanceChangeTick()
+  ChangeTick m_changeTick = 1;
+  // Sets of the sparse components, indexed like archetype columns and created
+  // on first use. m_sparseInUse lists the created ones
+  using ErasedSparseSet = std::unique_ptr<void, void (*)(void *)>;
+  struct SparseSlot {
+    ErasedSparseSet set = {nullptr, nullptr};
+    bool (*tryRemove)(void *set, Entity entity) = nullptr;
+  };
+  std::array<SparseSlot, Archetype::NumberOfColumns> m_sparseSets = {};
+  std::vector<size_t> m_sparseInUse;
+  // last archetype compacted by a pass in progress, see compact()
+  std::optional<Bitmask> m_compactCursor = {};
+  // component events waiting for deliverEvents()
+  ObserverTable<Bitmask, Archetype::NumberOfColumns> m_observers;
+  // archetypes touched by the batch being removed or moved, along with the
+  // rows it moves. Kept so batches don't allocate
+  std::vector<Archetype *> m_batchArchetypes;
+  std::vector<size_t> m_batchRows;
+  // room for the largest column reordered so far, see Archetype::reorderRows()
+  std::vector<std::byte> m_reorderScratch;
 
 public:
   ArcheRegistry() : m_archetypes() {};
 
-  Entity createEntity(Bitmask archetype = reg::Bitmask{-1})
+  Entity createEntity(Bitmask archetype = Bitmask{-1})
   {
     reg::Entity id;
     if (m_availableEntities.empty()) {
-      id = reg::Entity(++numberOfEntities);
+      id = newEntity();
       addRecord(archetype, Column{-1});
     } else {
       id = m_availableEntities.front();
-      m_availableEntities.pop();
+      m_availableEntities.pop_front();
     }
     return id;
   }
@@ -77,19 +401,68 @@ public:
                                                Components &&...comps)
   {
     Bitmask bitMask = getMultipleBitmask<Components...>();
-    P_ASSERT(m_records.at((size_t)entity).bitmask == bitMask ||
-                 m_records.at((size_t)entity).bitmask == -1,
+    P_ASSERT(recordOf(entity).bitmask == bitMask ||
+                 recordOf(entity).bitmask == Bitmask{-1},
              "Component reset isn't implemented yet. TODO: need to remove "
              "component of old archetype");
-    Archetype &archetype =
-        m_archetypes[bitMask]; // this will create an empty map
+    Archetype &archetype = getOrCreateArchetype(bitMask);
     Column column =
         archetype.pushComponents(entity, std::forward<Components>(comps)...);
 
     updateRecord(entity, bitMask, column);
+    markRowChanged(archetype, column);
+    m_observers.recordAdded(entity, bitMask);
 
     return std::tie<Components &...>(
-        archetype.fetchComponent<Components>(column)...);
+        archetype.template fetchComponent<Components>(column)...);
+  }
+
+  // ---------------------------------------------------- //
+  // bulk create
+  // ---------------------------------------------------- //
+
+  // The bulk versions allocate every entity id at once and land the whole
+  // batch in a single archetype with one lookup. Each column is reserved once
+  // and then filled, instead of one push per component of every entity
+
+  // Create one entity per row, moving its components out of the spans
+  template <ECSComponent... Components>
+  std::vector<Entity> createEntities(std::span<Components>... columns)
+  {
+    const size_t count = std::get<0>(std::tie(columns...)).size();
+    P_ASSERT(((columns.size() == count) && ...),
+             "createEntities expects columns of the same size");
+    return createBatch<Components...>(
+        count, [&columns...](Archetype &archetype,
+                             std::span<const Entity> entities) {
+          return archetype.template pushColumns<Components...>(
+              entities, moveFrom(columns)...);
+        });
+  }
+  // Create count entities, each one with a copy of the given components
+  template <ECSComponent... Components>
+  std::vector<Entity> createEntities(size_t count,
+                                     const Components &...prototypes)
+  {
+    return createBatch<Components...>(
+        count, [&prototypes...](Archetype &archetype,
+                                std::span<const Entity> entities) {
+          return archetype.template pushColumns<Components...>(
+              entities, copyOf(prototypes)...);
+        });
+  }
+  // Create count entities, generator(i) returns a std::tuple with the
+  // components of the i-th entity. Called once per entity, in order
+  template <ECSComponent... Components, typename Generator>
+    requires std::invocable<Generator &, size_t>
+  std::vector<Entity> createEntities(size_t count, Generator &&generator)
+  {
+    return createBatch<Components...>(
+        count,
+        [&generator](Archetype &archetype, std::span<const Entity> entities) {
+          return archetype.template pushRows<Components...>(entities,
+                                                            generator);
+        });
   }
 
   // use this in case you want to create a single component for an entity, not
@@ -98,143 +471,694 @@ public:
   Component &createComponent(Entity entity, Component &&args)
   {
     Bitmask bitMask = getSingleBitmask<Component>();
-    P_ASSERT(m_records.at(entity).bitmask == bitMask ||
-                 m_records.at((size_t)entity).bitmask == -1,
+    P_ASSERT(recordOf(entity).bitmask == bitMask ||
+                 recordOf(entity).bitmask == Bitmask{-1},
              "Component reset isn't implemented yet. TODO: need to remove "
              "component of old archetype");
-    Archetype &archetype = m_archetypes[bitMask];
-    size_t column =
-        archetype.pushComponent<Component>(std::forward<Component>(args));
+    Archetype &archetype = getOrCreateArchetype(bitMask);
+    archetype.setRowBytes(sizeof(Component));
+    size_t column = archetype.template pushComponent<Component>(
+        std::forward<Component>(args));
     updateRecord(entity, bitMask, column);
+    markRowChanged(archetype, Column{static_cast<int32_t>(column)});
+    m_observers.recordAdded(entity, bitMask);
 
-    return archetype.fetchComponent<Component>(column);
+    return archetype.template fetchComponent<Component>(column);
   }
 
   // ---------------------------------------------------- //
   // add
   // ---------------------------------------------------- //
 
-  // Expand the components of an entity, changing its "type". This is to make
-  // the objects more flexible but can also be used as a feature of the engine.
-  // Slow process because we are also moving all its N components to N new
-  // vectors
+  // Expand the components of an entity, changing its "type". The first move
+  // between two archetypes caches an edge between them, later ones only copy
+  // the row over the columns both share, so adding a status component per
+  // frame is cheap
   template <ECSComponent... Components>
   std::tuple<Components &...> addComponents(Entity entity,
                                             Components &&...comps)
   {
-    Bitmask oldBitmask = m_records[static_cast<unsigned>(entity)].bitmask;
-    int oldColumn = m_records[static_cast<unsigned>(entity)].column;
-    Bitmask newBitMask = getMultipleBitmask<Components...>();
-    Archetype &archetype = m_archetypes[oldBitmask];
-    Archetype &newArchetype = m_archetypes[newBitMask];
+    // sparse components never move the entity, see SparseComponent
+    if constexpr ((SparseComponent<Components> && ...)) {
+      P_ASSERT(isAlive(entity), "Entity {} is stale or was never created",
+               entity);
+      m_observers.recordAdded(
+          entity, ComponentManagerT::template multiComponentBitmask<
+                      std::remove_const_t<Components>...>());
+      return std::tie<Components &...>(sparseSet<Components>().emplace(
+          entity, std::forward<Components>(comps))...);
+    } else {
+      const Bitmask added = getMultipleBitmask<Components...>();
+      Record &record = recordOf(entity);
+      if (record.bitmask == Bitmask{-1})
+        return createComponents(entity, std::forward<Components>(comps)...);
+      P_ASSERT((record.bitmask & added).none(),
+               "Entity {} already has some of the components being added",
+               entity);
 
-    Column newColumn =
-        moveEntity<Components...>(archetype, newArchetype, entity, newBitMask,
-                                  oldColumn, std::forward(comps)...);
-    return std::tie<Components &...>(
-        newArchetype.fetchComponent<Components>(newColumn)...);
+      Archetype &from = m_archetypes.at(record.bitmask);
+      const typename Archetype::Edge &edge =
+          transition(from, record.bitmask | added, from.m_addEdges, added,
+                     (size_t{0} + ... + sizeof(std::decay_t<Components>)));
+      Archetype &to = *edge.target;
+      const Column newColumn = from.moveRowTo(to, record.column, edge);
+      (..., to.template pushComponent<std::decay_t<Components>>(
+                std::forward<Components>(comps)));
+
+      leaveArchetype(from, record.column);
+      record.bitmask = record.bitmask | added;
+      record.column = newColumn;
+      markRowChanged(to, newColumn);
+      m_observers.recordAdded(entity, added);
+      return std::tie<Components &...>(
+          to.template fetchComponent<Components>(newColumn)...);
+    }
+  }
+
+  // Shrink the components of an entity, the counterpart of addComponents.
+  // Removing the last components leaves an entity without any archetype
+  template <ECSComponent... Components> void removeComponents(Entity entity)
+  {
+    if constexpr ((SparseComponent<Components> && ...)) {
+      P_ASSERT(isAlive(entity), "Entity {} is stale or was never created",
+               entity);
+      (..., sparseSet<Components>().remove(entity));
+      m_observers.recordRemoved(
+          entity, ComponentManagerT::template multiComponentBitmask<
+                      std::remove_const_t<Components>...>());
+    } else {
+      const Bitmask removed = getMultipleBitmask<Components...>();
+      Record &record = recordOf(entity);
+      P_ASSERT(record.bitmask != Bitmask{-1} &&
+                   (record.bitmask & removed) == removed,
+               "Entity {} doesn't have all the components being removed",
+               entity);
+
+      Archetype &from = m_archetypes.at(record.bitmask);
+      const Bitmask remaining = record.bitmask & ~removed;
+      m_observers.recordRemoved(entity, removed);
+      if (remaining.none()) {
+        leaveArchetype(from, record.column);
+        record.bitmask = Bitmask{-1};
+        record.column = Column{-1};
+        return;
+      }
+      const typename Archetype::Edge &edge =
+          transition(from, remaining, from.m_removeEdges, removed, 0);
+      const Column newColumn =
+          from.moveRowTo(*edge.target, record.column, edge);
+
+      leaveArchetype(from, record.column);
+      record.bitmask = remaining;
+      record.column = newColumn;
+      markRowChanged(*edge.target, newColumn);
+    }
+  }
+
+  // removeComponents for many entities. The rows of each archetype move
+  // together, one call per column rather than per entity
+  template <ECSComponent... Components>
+  void removeComponents(std::span<const Entity> entities)
+  {
+    if constexpr ((SparseComponent<Components> && ...)) {
+      for (Entity entity : entities)
+        removeComponents<Components...>(entity);
+    } else {
+      const Bitmask removed = getMultipleBitmask<Components...>();
+      for (Entity entity : entities) {
+        const Record &record = recordOf(entity);
+        P_ASSERT(record.bitmask != Bitmask{-1} &&
+                     (record.bitmask & removed) == removed,
+                 "Entity {} doesn't have all the components being removed",
+                 entity);
+        m_observers.recordRemoved(entity, removed);
+        Archetype &from = m_archetypes.at(record.bitmask);
+        if (from.m_batchEntities.empty())
+          m_batchArchetypes.push_back(&from);
+        from.m_batchEntities.push_back(entity);
+      }
+      for (Archetype *archetype : m_batchArchetypes) {
+        Archetype &from = *archetype;
+        std::vector<Entity> &moved = from.m_batchEntities;
+        const Bitmask remaining = recordOf(moved.front()).bitmask & ~removed;
+        Column column = Column{-1};
+        if (remaining.any()) {
+          m_batchRows.clear();
+          for (Entity entity : moved)
+            m_batchRows.push_back(
+                static_cast<size_t>(recordOf(entity).column));
+          const typename Archetype::Edge &edge =
+              transition(from, remaining, from.m_removeEdges, removed, 0);
+          column = from.moveRowsTo(*edge.target, m_batchRows, edge);
+          edge.target->markRowsChanged(static_cast<size_t>(column),
+                                       moved.size(), m_changeTick);
+        }
+        for (Entity entity : moved) {
+          Record &record = recordOf(entity);
+          P_ASSERT((record.bitmask & removed) == removed,
+                   "Entity {} appears twice in the batch", entity);
+          queueLeave(from, record.column);
+          record.bitmask = remaining.any() ? remaining : Bitmask{-1};
+          record.column = column;
+          if (remaining.any())
+            ++column.value;
+        }
+        from.flushRemovals();
+        moved.clear();
+      }
+      m_batchArchetypes.clear();
+    }
+  }
+
+  // Size the chunks of the archetype of bitmask for rows of rowBytes, the
+  // size of all its components. manualPush fills an archetype one component
+  // at a time, so a new one must be told the size of its rows first
+  void declareRowBytes(Bitmask bitmask, size_t rowBytes)
+  {
+    getOrCreateArchetype(bitmask).setRowBytes(rowBytes);
   }
 
   // If bitmask is known, you can manually push components into the archetype
   template <ECSComponent C>
   void manualPush(Entity entity, Bitmask bitmask, C &&comps)
   {
-    Archetype &archetype = m_archetypes[bitmask];
-    Column column = m_records[static_cast<unsigned long>(entity)].column;
+    Archetype &archetype = getOrCreateArchetype(bitmask);
+    P_ASSERT(archetype.rowsPerChunk() != 0 ||
+                 bitmask == getSingleBitmask<C>(),
+             "Call declareRowBytes before pushing into a new archetype");
+    Column column = recordOf(entity).column;
     if (column == -1) {
-      m_records[static_cast<unsigned long>(entity)].column =
-          archetype.pushComponents(entity, std::forward<C>(comps));
+      column = archetype.pushComponents(entity, std::forward<C>(comps));
+      // recycled ids didn't get the mask from createEntity
+      recordOf(entity).bitmask = bitmask;
+      recordOf(entity).column = column;
+      m_observers.recordAdded(entity, bitmask);
     } else {
       archetype.pushComponents(std::forward<C>(comps));
     }
+    markRowChanged(archetype, column);
   }
 
-private:
+public:
+  // ==================================================== //
+  // iterate chunks
+  // ==================================================== //
+
+  // Return the chunks of every archetype containing all Components and none
+  // of the ExcludeComponents. The matching archetypes are cached per mask
+  // pair, each call looks its pair up under a lock
+  template <ECSComponent... Components, ECSComponent... ExcludeComponents>
+  QueryView<Archetype, Components...>
+  query(exclude_t<ExcludeComponents...> = {})
+  {
+    return QueryView<Archetype, Components...>(
+        cachedQuery(getMultipleBitmask<Components...>(),
+                    getMultipleBitmask<ExcludeComponents...>()),
+        {.tick = m_changeTick});
+  }
+  // Same as query, but only the chunks where at least one of Components was
+  // written after the tick since. Components only read should be const, so
+  // iterating doesn't mark them as changed for the next reader
+  template <ECSComponent... Components, ECSComponent... ExcludeComponents>
+  QueryView<Archetype, Components...>
+  queryChanged(ChangeTick since, exclude_t<ExcludeComponents...> = {})
+  {
+    return QueryView<Archetype, Components...>(
+        cachedQuery(getMultipleBitmask<Components...>(),
+                    getMultipleBitmask<ExcludeComponents...>()),
+        {.tick = m_changeTick, .changedOnly = true, .changedSince = since});
+  }
+  template <ECSComponent... Components, ECSComponent... ExcludeComponents>
+  QueryView<const Archetype, const Components...>
+  queryConst(const exclude_t<ExcludeComponents...> = {}) const
+  {
+    return QueryView<const Archetype, const Components...>(
+        cachedQuery(getMultipleBitmask<Components...>(),
+                    getMultipleBitmask<ExcludeComponents...>()));
+  }
+  template <ECSComponent... Components, ECSComponent... ExcludeComponents>
+  QueryView<const Archetype, const Components...>
+  queryChangedConst(ChangeTick since,
+                    const exclude_t<ExcludeComponents...> = {}) const
+  {
+    return QueryView<const Archetype, const Components...>(
+        cachedQuery(getMultipleBitmask<Components...>(),
+                    getMultipleBitmask<ExcludeComponents...>()),
+        {.changedOnly = true, .changedSince = since});
+  }
+
+  // Resolve a query once, for the code running it every update. Views made
+  // from the result cost no lookup, and the const ones can be made from
+  // worker threads
+  template <ECSComponent... Components, ECSComponent... ExcludeComponents>
+  CachedQuery<Archetype, Components...>
+  makeQuery(exclude_t<ExcludeComponents...> = {})
+  {
+    return {&cachedQuery(getMultipleBitmask<Components...>(),
+                         getMultipleBitmask<ExcludeComponents...>())};
+  }
   template <ECSComponent... Components>
-  Column moveEntity(Archetype &from, Archetype &to, Entity entity,
-                    Bitmask newBitMask, Column oldColumn, Components &&...comps)
-  {
-    std::tuple<Components &...> oldComponents =
-        from.extractColumn<Components...>(oldColumn);
-
-    Column newColumnIndex;
-    // add old ones
-    std::apply(
-        [&](auto &...oldComps) {
-          newColumnIndex = (to.pushComponent<std::decay_t<decltype(oldComps)>>(
-                                std::move(oldComps)),
-                            ...);
-        },
-        oldComponents);
+  QueryView<Archetype, Components...>
+  query(CachedQuery<Archetype, Components...> cached)
+  {
+    return QueryView<Archetype, Components...>(*cached.archetypes,
+                                               {.tick = m_changeTick});
+  }
+  template <ECSComponent... Components>
+  QueryView<Archetype, Components...>
+  queryChanged(CachedQuery<Archetype, Components...> cached, ChangeTick since)
+  {
+    return QueryView<Archetype, Components...>(
+        *cached.archetypes,
+        {.tick = m_changeTick, .changedOnly = true, .changedSince = since});
+  }
+  template <ECSComponent... Components>
+  QueryView<const Archetype, const Components...>
+  queryConst(CachedQuery<Archetype, Components...> cached) const
+  {
+    return QueryView<const Archetype, const Components...>(*cached.archetypes);
+  }
 
-    // add new ones
-    (..., to.pushComponent<Components>(std::forward<Components>(comps)));
+  // ==================================================== //
+  // iterate entities
+  // ==================================================== //
 
-    m_records[static_cast<unsigned>(entity)].bitmask = newBitMask;
-    m_records[static_cast<unsigned>(entity)].column = newColumnIndex;
-    from.remove<Components...>(oldColumn);
-    return newColumnIndex;
+  // Call fn(entity, components &...) for every entity with all Components and
+  // none of ExcludeComponents, sparse ones included. Without sparse
+  // Components this walks the chunks of the dense ones, otherwise the smallest
+  // set among the sparse Components, looking the rest up per entity. fn must
+  // not add or remove the iterated components, defer that to a CommandBuffer
+  template <ECSComponent... Components, ECSComponent... ExcludeComponents,
+            typename Fn>
+  void each(Fn &&fn, exclude_t<ExcludeComponents...> = {})
+  {
+    static_assert(std::invocable<Fn &, Entity, Components &...>,
+                  "each expects fn(Entity, Components &...)");
+    const Bitmask include = denseMask<Components...>();
+    const Bitmask excluded = denseMask<ExcludeComponents...>();
+    if constexpr (!anySparse<Components...>()) {
+      for (ChunkView<Components...> chunk :
+           QueryView<Archetype, Components...>(
+               cachedQuery(include, excluded), {.tick = m_changeTick}))
+        for (size_t i = 0; i < chunk.count; ++i)
+          if (!inAnySparse<ExcludeComponents...>(chunk.entities[i]))
+            fn(chunk.entities[i], std::get<Components *>(chunk.arrays)[i]...);
+    } else {
+      std::span<const Entity> driver;
+      bool missing = false;
+      (..., pickDriver<Components>(driver, missing));
+      if (missing)
+        return;
+      for (size_t i = 0; i < driver.size(); ++i) {
+        const Entity entity = driver[i];
+        const Bitmask mask = m_records[entityIndex(entity)].bitmask;
+        const bool dense = mask != Bitmask{-1};
+        if ((dense ? !matchesQuery(mask, include, excluded) : include.any()) ||
+            !(inSparse<Components>(entity) && ...) ||
+            inAnySparse<ExcludeComponents...>(entity))
+          continue;
+        Archetype *archetype = dense ? &m_archetypes.at(mask) : nullptr;
+        const Column column = m_records[entityIndex(entity)].column;
+        if (dense && !archetype->isEnabled(static_cast<size_t>(column)))
+          continue;
+        fn(entity, eachComponent<Components>(entity, archetype, column)...);
+      }
+    }
   }
 
-public:
   // ==================================================== //
-  // iterate chunks
+  // change ticks
   // ==================================================== //
 
-  // return vector of chunks
-  template <ECSComponent... Components, ECSComponent... ExcludeComponents>
-  std::vector<ChunkView<Components...>>
-  query(exclude_t<ExcludeComponents...> = {})
+  // Writes are stamped with the current tick. A reader remembers the tick it
+  // ran at and asks for changes after it, so the tick must move past it
+  // before anyone else writes. Scenes advance it before every system
+  ChangeTick changeTick() const { return m_changeTick; }
+  ChangeTick advanceChangeTick() { return ++m_changeTick; }
+
+  // Run fn over every row matching the query, splitting the chunks into
+  // ranges that run on the thread pool. Returns once every range ran. fn is
+  // called as fn(ChunkView) or fn(ChunkView, rangeIndex) and must only write
+  // to the rows of its own range
+  template <ECSComponent... Components, ECSComponent... ExcludeComponents,
+            typename Fn>
+  void forEachParallel(ThreadPool &pool, Fn &&fn,
+                       exclude_t<ExcludeComponents...> = {},
+                       ParallelOptions options = {})
   {
-    int bitMask = getMultipleBitmask<Components...>();
-    int excludeBitMask = getMultipleBitmask<ExcludeComponents...>();
-    // for each component, extract the target vectors of that component in each
-    // Archetype (SoA), then get its address (ChunkView)
+    using View = ChunkView<Components...>;
+    static_assert(std::invocable<Fn &, View> ||
+                      std::invocable<Fn &, View, size_t>,
+                  "forEachParallel expects fn(ChunkView) or "
+                  "fn(ChunkView, size_t rangeIndex)");
+    QueryView<Archetype, Components...> chunks =
+        query<Components...>(exclude<ExcludeComponents...>);
 
-    std::vector<ChunkView<Components...>> chunks;
-    chunks.reserve(m_archetypes.size());
+    size_t grain = options.grainSize;
+    if (grain == 0 && !options.deterministic) {
+      size_t rows = 0;
+      for (View chunk : chunks)
+        rows += chunk.count;
+      grain = std::max(MinParallelGrain,
+                       rows / ((pool.size() + 1) * ParallelJobsPerThread));
+    }
 
-    for (auto &[mask, archetype] : m_archetypes) {
-      if ((mask & bitMask) != bitMask)
-        continue;
-      if ((mask & excludeBitMask) != 0)
-        continue;
+    std::pmr::vector<View> ranges(options.scratch != nullptr
+                                      ? options.scratch
+                                      : std::pmr::get_default_resource());
+    for (View chunk : chunks) {
+      const size_t step = grain == 0 ? chunk.count : grain;
+      for (size_t begin = 0; begin < chunk.count; begin += step)
+        ranges.push_back(
+            subView(chunk, begin, std::min(step, chunk.count - begin)));
+    }
+
+    pool.parallelFor(ranges.size(), [&](size_t index) {
+      if constexpr (std::invocable<Fn &, View, size_t>)
+        fn(ranges[index], index);
+      else
+        fn(ranges[index]);
+    });
+  }
+
+  // ==================================================== //
+  // observers
+  // ==================================================== //
+
+  // Subscribe fn to the entities that gained C, lost it, or whose C was
+  // written. Nothing is called right away: events are kept until
+  // deliverEvents(), which scenes call at their sync points, and fn then gets
+  // every entity of its event in one call. Removed entities may be stale by
+  // then and their components are gone. Changes are read from the change
+  // ticks a chunk at a time, so every row of a chunk where C was written is
+  // reported, rows created or moved there included
+  template <ECSComponent C> ObserverId onAdded(ObserverFn fn)
+  {
+    return m_observers.add(ComponentManagerT::template componentIndex<C>(),
+                           ComponentEvent::Added, std::move(fn));
+  }
+  template <ECSComponent C> ObserverId onRemoved(ObserverFn fn)
+  {
+    return m_observers.add(ComponentManagerT::template componentIndex<C>(),
+                           ComponentEvent::Removed, std::move(fn));
+  }
+  template <ECSComponent C> ObserverId onChanged(ObserverFn fn)
+  {
+    static_assert(!SparseComponent<C>,
+                  "Sparse components have no change ticks to observe");
+    // only the writes made from now on are reported
+    const ChangeTick since = m_changeTick;
+    advanceChangeTick();
+    return m_observers.add(
+        ComponentManagerT::template componentIndex<C>(),
+        ComponentEvent::Changed, std::move(fn),
+        [](const void *registry, ChangeTick after,
+           std::vector<Entity> &entities) {
+          for (auto chunk : static_cast<const ArcheRegistry *>(registry)
+                                ->template queryChangedConst<C>(after))
+            entities.insert(entities.end(), chunk.entities.begin(),
+                            chunk.entities.end());
+        },
+        since);
+  }
+  void unobserve(ObserverId id) { m_observers.erase(id); }
+
+  // Hand the events recorded since the previous call to their observers.
+  // Must not overlap with any chunk iteration, handlers may change the
+  // registry: what they do is delivered by the next call
+  void deliverEvents()
+  {
+    if (m_observers.empty())
+      return;
+    // writes made by the handlers are stamped after the delivered ones
+    const ChangeTick delivered = m_changeTick;
+    advanceChangeTick();
+    m_observers.deliver(this, delivered);
+  }
 
-      ChunkView<Components...> chunk{
-          std::tuple<Components *...>{
-              archetype.getComponent<Components>().data()...},
-          archetype.m_entities, archetype.m_entities.size()};
-      chunks.emplace_back(chunk);
+  // ==================================================== //
+  // sort
+  // ==================================================== //
+
+  // Reorder the rows of every archetype holding C, so chunks are visited in
+  // the order of compare(const C &, const C &), within each archetype. Rows
+  // move, so references and chunk views taken before are invalidated. Rows
+  // of equal shared values are then regrouped, keeping that order
+  template <ECSComponent C, typename Compare> void sort(Compare &&compare)
+  {
+    std::vector<size_t> order;
+    for (Archetype *archetype : cachedQuery(getSingleBitmask<C>(), Bitmask{})) {
+      sortRows<C>(*archetype, compare, order);
+      groupRows(*archetype, order);
     }
+  }
 
-    return chunks;
+  // ==================================================== //
+  // compact
+  // ==================================================== //
+
+  // Give back the memory left over by entities that are gone: blocks of the
+  // columns past the rows in use, spare capacity, and archetypes without any
+  // entity, along with every cached query and edge pointing to them. With a
+  // budget, a pass is spread over several calls, e.g. one per frame.
+  // Archetypes created or emptied in the meantime are seen by the next pass.
+  // Rows of archetypes holding shared components are regrouped by value, the
+  // moved rows count towards the budget. Chunk views, queries being iterated
+  // and references to components of archetypes that shrank are invalidated
+  CompactReport<Bitmask> compact(CompactOptions options = {})
+  {
+    std::vector<size_t> order;
+    return compactArchetypes(options, [&](Bitmask, Archetype &archetype) {
+      return groupRows(archetype, order) * archetype.rowBytes();
+    });
   }
-  template <ECSComponent... Components, ECSComponent... ExcludeComponents>
-  std::vector<ChunkViewConst<const Components...>>
-  queryConst(const exclude_t<ExcludeComponents...> = {}) const
+  // Same, also sorting the rows of each archetype holding C as sort() does,
+  // so entities used together end up in the same chunks. The moved rows
+  // count towards the budget
+  template <ECSComponent C, typename Compare>
+  CompactReport<Bitmask> compact(Compare &&compare, CompactOptions options = {})
   {
-    int bitMask = getMultipleBitmask<Components...>();
-    int excludeBitMask = getMultipleBitmask<ExcludeComponents...>();
+    static_assert(!SparseComponent<C>, "Sparse components have no rows");
+    std::vector<size_t> order;
+    return compactArchetypes(
+        options, [&](Bitmask mask, Archetype &archetype) {
+          size_t moved = 0;
+          if (mask.test(ComponentManagerT::template componentIndex<C>()))
+            moved = sortRows<C>(archetype, compare, order);
+          return (moved + groupRows(archetype, order)) * archetype.rowBytes();
+        });
+  }
 
-    std::vector<ChunkViewConst<const Components...>> chunks;
-    chunks.reserve(m_archetypes.size());
+  // ==================================================== //
+  // prefab
+  // ==================================================== //
 
-    for (auto &[mask, archetype] : m_archetypes) {
-      if ((mask & bitMask) != bitMask)
-        continue;
-      if ((mask & excludeBitMask) != 0)
+  // A prefab with a copy of the components of entity, to instantiate it
+  // again. Components that can't be copied are left out with a warning, as
+  // are sparse ones
+  Prefab<ComponentManagerT> makePrefab(Entity entity) const
+  {
+    using Field = typename Prefab<ComponentManagerT>::Field;
+    const Record &record = recordOf(entity);
+    if (record.bitmask == Bitmask{-1})
+      return {};
+    const Archetype &archetype = m_archetypes.at(record.bitmask);
+    std::vector<Field> fields;
+    for (size_t c = 0; c < Archetype::NumberOfColumns; ++c) {
+      if (!record.bitmask.test(c))
         continue;
+      const typename Archetype::ColumnOps *ops = archetype.columnOps(c);
+      if (ops->copyRow == nullptr)
+        PLOG_W("Component {} can't be copied, it is left out of the prefab",
+               c);
+      else
+        fields.push_back({c, 0, ops});
+    }
+    const size_t row = static_cast<size_t>(record.column);
+    return Prefab<ComponentManagerT>::assemble(
+        std::move(fields), [&archetype, row](const Field &field, void *slot) {
+          field.ops->copyRow(archetype.columnData(field.component), row, slot);
+        });
+  }
+  // Create count entities from a prefab, each one a copy of its row. The
+  // archetype is found once and every column is filled on its own. overrides
+  // hold per entity values of some components of the prefab, one span of
+  // count values per component, copied in place of the default
+  template <ECSComponent... Overrides>
+  std::vector<Entity> instantiate(const Prefab<ComponentManagerT> &prefab,
+                                  size_t count,
+                                  std::span<Overrides>... overrides)
+  {
+    P_ASSERT(!prefab.empty(), "Can't instantiate an empty prefab");
+    P_ASSERT(((overrides.size() == count) && ...),
+             "instantiate expects one override per entity");
+    const Bitmask overridden =
+        getMultipleBitmask<std::remove_const_t<Overrides>...>();
+    P_ASSERT((overridden & ~prefab.mask()).none(),
+             "Overridden components must be part of the prefab");
+    return createBatch(
+        prefab.mask(), count,
+        [&](Archetype &archetype, std::span<const Entity> entities) {
+          const Column first = archetype.lastColumn();
+          archetype.setRowBytes(prefab.rowBytes());
+          for (const auto &field : prefab.fields())
+            if (!overridden.test(field.component))
+              archetype.appendCopies(field.component, *field.ops,
+                                     prefab.value(field), count);
+          (..., archetype
+                    .template createComponent<std::remove_const_t<Overrides>>()
+                    .append(count, copyFrom(overrides)));
+          archetype.m_entities.insert(archetype.m_entities.end(),
+                                      entities.begin(), entities.end());
+          return first;
+        });
+  }
 
-      ChunkViewConst<const Components...> chunk{
-          std::tuple<const Components *...>{
-              std::as_const(archetype).getComponent<Components>().data()...},
-          archetype.m_entities, archetype.m_entities.size()};
+  // Whether entity has exactly the components of prefab, sparse ones aside
+  bool isInstanceOf(Entity entity,
+                    const Prefab<ComponentManagerT> &prefab) const
+  {
+    return recordOf(entity).bitmask == prefab.mask();
+  }
+  // Bring entities of the prefab archetype back as new instances, without
+  // moving them: their components are reset to the prefab row and they are
+  // enabled again. Used by EntityPool on entities it disabled
+  void respawn(std::span<const Entity> entities,
+               const Prefab<ComponentManagerT> &prefab)
+  {
+    if (entities.empty())
+      return;
+    Archetype &archetype = m_archetypes.at(prefab.mask());
+    for (Entity entity : entities) {
+      P_ASSERT(isInstanceOf(entity, prefab),
+               "Entity {} left the archetype of the prefab", entity);
+      const size_t row = static_cast<size_t>(recordOf(entity).column);
+      for (const auto &field : prefab.fields())
+        archetype.assignRow(field.component, row, prefab.value(field));
+      archetype.setEnabled(row, true);
+      archetype.markRowsChanged(row, 1, m_changeTick);
+    }
+  }
 
-      chunks.emplace_back(chunk);
+  // ==================================================== //
+  // snapshot
+  // ==================================================== //
+
+  // Copy every entity into bytes, in the layout of Snapshot.h. Components
+  // lists the components saved, they must be trivially copyable and hold
+  // nothing that only means something in this run, like pointers. Entities
+  // owning other components are saved without any, so their handles stay
+  // valid and their components can be added again after loading, their count
+  // is returned. Sparse components aren't saved.
+  // Capturing only copies memory and bytes keeps its capacity from one
+  // capture to the next, the file can then be written from another thread.
+  // With a pool, the copies of the columns run on it
+  template <ECSComponent... Components>
+  size_t captureSnapshot(std::vector<std::byte> &bytes,
+                         ThreadPool *pool = nullptr) const
+  {
+    static_assert((std::is_trivially_copyable_v<Components> && ...),
+                  "Only trivially copyable components can be saved");
+    SnapshotWriter measure;
+    const size_t dropped = writeSnapshot<Components...>(measure);
+    bytes.resize(measure.size());
+    SnapshotWriter writer(bytes, pool != nullptr);
+    writeSnapshot<Components...>(writer);
+    if (pool != nullptr)
+      pool->parallelFor(writer.deferred().size(),
+                        [&writer](size_t i) { writer.copyDeferred(i); });
+    return dropped;
+  }
+  // Same as captureSnapshot, written to out right away
+  template <ECSComponent... Components>
+  bool saveSnapshot(std::ostream &out) const
+  {
+    std::vector<std::byte> bytes;
+    if (const size_t dropped = captureSnapshot<Components...>(bytes))
+      PLOG_W("Snapshot saved {} entities without their components, some of "
+             "them aren't in the saved list",
+             dropped);
+    out.write(reinterpret_cast<const char *>(bytes.data()),
+              static_cast<std::streamsize>(bytes.size()));
+    return out.good();
+  }
+
+  // Fill an empty registry from a snapshot saved with the same Components.
+  // Each column is copied with one memcpy per chunk, no component is created
+  // entity by entity. Returns false, leaving the registry untouched, when
+  // bytes isn't a snapshot of this registry layout or its records, recycled
+  // ids and archetypes don't agree with each other
+  template <ECSComponent... Components>
+  bool loadSnapshot(std::span<const std::byte> bytes)
+  {
+    static_assert((std::is_trivially_copyable_v<Components> && ...),
+                  "Only trivially copyable components can be loaded");
+    if (!m_records.empty()) {
+      PLOG_E("Snapshots can only be loaded into an empty registry");
+      return false;
     }
+    SnapshotReader reader(bytes);
+    SnapshotHeader header;
+    if (!reader.read(header) || header.magic != SnapshotMagic ||
+        header.version != SnapshotVersion ||
+        header.components != Archetype::NumberOfColumns ||
+        header.layout !=
+            ComponentManagerT::template layoutHash<Components...>() ||
+        header.recordBytes != sizeof(Record)) {
+      PLOG_E("Snapshot wasn't saved with this registry layout");
+      return false;
+    }
+    reader.align();
+    const std::byte *records = reader.take(header.records, sizeof(Record));
+    reader.align();
+    const std::byte *available =
+        reader.take(header.freeEntities, sizeof(Entity));
+    reader.align();
+    const std::byte *dropped =
+        reader.take(header.droppedEntities, sizeof(Entity));
 
-    return chunks;
+    // everything is checked before anything is created
+    std::array<size_t, Archetype::NumberOfColumns> rowBytes = {};
+    (..., (rowBytes[ComponentManagerT::template componentIndex<Components>()] =
+               sizeof(Components)));
+    bool valid = !reader.failed() &&
+                 header.records <= static_cast<size_t>(EntityIndexMask) + 1 &&
+                 header.archetypes <=
+                     bytes.size() / sizeof(SnapshotArchetype<Bitmask>);
+    std::vector<SnapshotBlock> blocks(valid ? header.archetypes : 0);
+    for (SnapshotBlock &block : blocks)
+      if (!(valid = readSnapshotBlock(reader, rowBytes, block)))
+        break;
+    std::vector<Record> loaded(valid ? header.records : 0);
+    if (valid) {
+      std::memcpy(static_cast<void *>(loaded.data()), records,
+                  header.records * sizeof(Record));
+      valid = checkSnapshotEntities(loaded, blocks, available,
+                                    header.freeEntities, dropped,
+                                    header.droppedEntities);
+    }
+    if (!valid) {
+      PLOG_E("Snapshot is truncated or doesn't match its components");
+      return false;
+    }
+
+    m_records = std::move(loaded);
+    numberOfEntities = static_cast<std::int32_t>(header.records) - 1;
+    for (size_t i = 0; i < header.freeEntities; ++i)
+      m_availableEntities.push_back(snapshotEntity(available, i));
+    for (const SnapshotBlock &block : blocks) {
+      Archetype &archetype = getOrCreateArchetype(block.mask);
+      archetype.setRowBytes(block.rowBytes);
+      (..., loadColumn<Components>(archetype, block));
+      archetype.m_entities.resize(block.rows);
+      std::memcpy(static_cast<void *>(archetype.m_entities.data()),
+                  block.entities, block.rows * sizeof(Entity));
+      archetype.markRowsChanged(0, block.rows, m_changeTick);
+      m_observers.recordAdded(archetype.m_entities, block.mask);
+    }
+    return true;
   }
+
   // ==================================================== //
   // size
   // ==================================================== //
@@ -244,11 +1168,12 @@ public:
     requires IsMultipleTypes<Components...>
   size_t iteratorSize(exclude_t<ExcludeComponents...> = {})
   {
-    int bitMask = getMultipleBitmask<Components...>();
-    int excludeBitMask = getMultipleBitmask<ExcludeComponents...>();
-    // NOTE: altough all components are necessary for the bitmasks, we only need
-    // to see one for the size
-    return sizeOfComponent<Components...>(bitMask, excludeBitMask);
+    size_t size = 0;
+    for (const Archetype *archetype :
+         cachedQuery(getMultipleBitmask<Components...>(),
+                     getMultipleBitmask<ExcludeComponents...>()))
+      size += archetype->m_entities.size() - archetype->disabledCount();
+    return size;
   }
 
   // ==================================================== //
@@ -260,14 +1185,21 @@ public:
     static_assert(hasAllBitmask<TargetComponents...>(),
                   "When using getComponent some component didn't exist inside  "
                   "the CompileTimeBitMask");
-    const Bitmask b = m_records[static_cast<unsigned>(entity)].bitmask;
-    P_ASSERT((b & getMultipleBitmask<TargetComponents...>()) ==
-                 getMultipleBitmask<TargetComponents...>(),
-             "Entity {} does not have all components requested", entity);
-    Archetype &archetype =
-        m_archetypes[m_records[static_cast<unsigned>(entity)].bitmask];
-    return archetype.extractColumn<TargetComponents...>(
-        m_records[static_cast<unsigned>(entity)].column);
+    if constexpr (anySparse<TargetComponents...>()) {
+      return std::tie<TargetComponents &...>(
+          getComponent<TargetComponents>(entity)...);
+    } else {
+      const Record &record = recordOf(entity);
+      P_ASSERT((record.bitmask & getMultipleBitmask<TargetComponents...>()) ==
+                   getMultipleBitmask<TargetComponents...>(),
+               "Entity {} does not have all components requested", entity);
+      Archetype &archetype = m_archetypes[record.bitmask];
+      const size_t chunk = chunkOf(archetype, record.column);
+      (..., archetype.template markChanged<TargetComponents>(chunk,
+                                                            m_changeTick));
+      return archetype.template extractColumn<TargetComponents...>(
+          record.column);
+    }
   }
   template <ECSComponent... TargetComponents>
   const std::tuple<TargetComponents &...> getComponents(Entity entity) const
@@ -275,24 +1207,44 @@ public:
     static_assert(hasAllBitmask<TargetComponents...>(),
                   "When using getComponent some component didn't exist inside "
                   "the CompileTimeBitMask");
-    const Archetype &archetype =
-        m_archetypes.at(m_records[static_cast<unsigned>(entity)].bitmask);
-    return archetype.extractColumn<TargetComponents...>(
-        m_records[static_cast<unsigned>(entity)].column);
+    if constexpr (anySparse<TargetComponents...>()) {
+      return std::tie<TargetComponents &...>(
+          getComponent<TargetComponents>(entity)...);
+    } else {
+      const Record &record = recordOf(entity);
+      const Archetype &archetype = m_archetypes.at(record.bitmask);
+      return archetype.template extractColumn<TargetComponents...>(
+          record.column);
+    }
   }
   template <ECSComponent T> T &getComponent(Entity entity)
   {
-    Archetype &archetype =
-        m_archetypes.at(m_records[static_cast<unsigned>(entity)].bitmask);
-    return archetype.fetchComponent<T>(
-        m_records[static_cast<unsigned>(entity)].column);
+    if constexpr (SparseComponent<T>) {
+      P_ASSERT(isAlive(entity), "Entity {} is stale or was never created",
+               entity);
+      return sparseSet<T>().get(entity);
+    } else {
+      const Record &record = recordOf(entity);
+      Archetype &archetype = m_archetypes.at(record.bitmask);
+      archetype.template markChanged<T>(chunkOf(archetype, record.column),
+                                        m_changeTick);
+      return archetype.template fetchComponent<T>(record.column);
+    }
   }
   template <ECSComponent T> const T &getComponent(Entity entity) const
   {
-    const Archetype &archetype =
-        m_archetypes.at(m_records[static_cast<unsigned>(entity)].bitmask);
-    return archetype.fetchComponent<T>(
-        m_records[static_cast<unsigned>(entity)].column);
+    if constexpr (SparseComponent<T>) {
+      P_ASSERT(isAlive(entity), "Entity {} is stale or was never created",
+               entity);
+      const SparseSetOf<T> *set = findSparseSet<T>();
+      P_ASSERT(set != nullptr, "Entity {} doesn't have this sparse component",
+               entity);
+      return set->get(entity);
+    } else {
+      const Record &record = recordOf(entity);
+      const Archetype &archetype = m_archetypes.at(record.bitmask);
+      return archetype.template fetchComponent<T>(record.column);
+    }
   }
 
   // ==================================================== //
@@ -303,93 +1255,114 @@ public:
   template <ECSComponent... ObjectComponents>
   constexpr bool containsAll(Entity entity) const
   {
-    Bitmask targetBitMask = m_records[static_cast<unsigned>(entity)].bitmask;
-    int objectBitMask = getMultipleBitmask<ObjectComponents...>();
+    Bitmask targetBitMask = recordOf(entity).bitmask;
+    Bitmask objectBitMask = getMultipleBitmask<ObjectComponents...>();
     return (targetBitMask | objectBitMask) == objectBitMask;
   }
   // Targeted has at least one component that a specific archetype also has
   template <ECSComponent... TargetComponents> bool hasAny(Entity entity) const
   {
-    Bitmask specificBitMask = m_records[static_cast<unsigned>(entity)].bitmask;
-    if constexpr (sizeof...(TargetComponents) == 1) {
-      int targetBitMask = getSingleBitmask<TargetComponents...>();
-      return (targetBitMask & specificBitMask) != 0;
+    if constexpr (anySparse<TargetComponents...>()) {
+      return (hasComponent<TargetComponents>(entity) || ...);
     } else {
-      int targetBitMask = getMultipleBitmask<TargetComponents...>();
-      return (targetBitMask & specificBitMask) != 0;
+      Bitmask specificBitMask = recordOf(entity).bitmask;
+      if (specificBitMask == Bitmask{-1}) // no components at all
+        return false;
+      if constexpr (sizeof...(TargetComponents) == 1) {
+        Bitmask targetBitMask = getSingleBitmask<TargetComponents...>();
+        return (targetBitMask & specificBitMask).any();
+      } else {
+        Bitmask targetBitMask = getMultipleBitmask<TargetComponents...>();
+        return (targetBitMask & specificBitMask).any();
+      }
     }
   }
 
+  // ==================================================== //
+  // enable
+  // ==================================================== //
+
+  // A disabled entity keeps its row, its components and its handle, but
+  // queries, forEachParallel and each() skip it until it is enabled again.
+  // Toggling only flips a bit of its archetype. Moving it to another archetype
+  // keeps it disabled, snapshots don't. Entities without any dense component
+  // can't be disabled
+  void setEnabled(Entity entity, bool enabled)
+  {
+    const Record &record = recordOf(entity);
+    P_ASSERT(record.bitmask != Bitmask{-1},
+             "Entity {} has no row to disable, it has no dense component",
+             entity);
+    m_archetypes.at(record.bitmask)
+        .setEnabled(static_cast<size_t>(record.column), enabled);
+  }
+  void setEnabled(std::span<const Entity> entities, bool enabled)
+  {
+    for (Entity entity : entities)
+      setEnabled(entity, enabled);
+  }
+  bool isEnabled(Entity entity) const
+  {
+    const Record &record = recordOf(entity);
+    return record.bitmask == Bitmask{-1} ||
+           m_archetypes.at(record.bitmask)
+               .isEnabled(static_cast<size_t>(record.column));
+  }
+
   // ==================================================== //
   // remove
   // ==================================================== //
 
-  // Removal of a single entity can be O(n) in worst case (because we need to
-  // update the last element's Record). If possible, prefer to batch
+  // Removal is O(1): the hole is filled with the last row of the archetype,
+  // whose owner is known from Archetype::m_entities, so only that record is
+  // updated. The handle becomes stale, see isAlive()
   void remove(Entity entity)
   {
-    P_ASSERT(m_records.size() > static_cast<unsigned>(entity),
-             "Record couldn't find entity {}", entity);
-    // internally: update swapped entity's record, turn removed record invalid
-    Bitmask targetBitMask = m_records[static_cast<unsigned>(entity)].bitmask;
-    Column targetColumn = m_records[static_cast<unsigned>(entity)].column;
-    Archetype &archetype = m_archetypes.at(targetBitMask);
-
-    auto [lastEntityColumn, swappedEntity] = archetype.remove(targetColumn);
+    const Record &target = recordOf(entity);
+    // entities whose components were all removed have no row anymore
+    if (target.bitmask != Bitmask{-1}) {
+      m_observers.recordRemoved(entity, target.bitmask);
+      leaveArchetype(m_archetypes.at(target.bitmask), target.column);
+    }
+    for (size_t c : m_sparseInUse)
+      if (m_sparseSets[c].tryRemove(m_sparseSets[c].set.get(), entity))
+        m_observers.recordRemoved(entity, Bitmask::bit(c));
     removeEntity(entity);
-    m_records[static_cast<unsigned>(swappedEntity)] = {targetBitMask,
-                                                       targetColumn};
   }
-  template <ECSComponent... ObjectComponents>
+  // Remove k entities in O(k), no matter how many entities are alive. Rows
+  // leave their archetype together, one call per column for all of them
   void removeBatch(std::span<const Entity> entities)
   {
-    // useful
-    struct RecordHash {
-      std::size_t operator()(const Record &r) const noexcept
-      {
-        return std::hash<Bitmask>()(r.bitmask) ^
-               (std::hash<Column>()(r.column) << 1);
+    for (Entity entity : entities) {
+      const Record &target = recordOf(entity);
+      if (target.bitmask != Bitmask{-1}) {
+        m_observers.recordRemoved(entity, target.bitmask);
+        Archetype &from = m_archetypes.at(target.bitmask);
+        if (!from.hasQueuedRemovals())
+          m_batchArchetypes.push_back(&from);
+        queueLeave(from, target.column);
       }
-    };
-    struct RecordEq {
-      bool operator()(const Record &a, const Record &b) const noexcept
-      {
-        return a.bitmask == b.bitmask && a.column == b.column;
-      }
-    };
+      for (size_t c : m_sparseInUse)
+        if (m_sparseSets[c].tryRemove(m_sparseSets[c].set.get(), entity))
+          m_observers.recordRemoved(entity, Bitmask::bit(c));
+      removeEntity(entity);
+    }
+    for (Archetype *archetype : m_batchArchetypes)
+      archetype->flushRemovals();
+    m_batchArchetypes.clear();
+  }
 
-    if (entities.empty())
-      return;
+  // ==================================================== //
+  // handles
+  // ==================================================== //
 
-    std::unordered_set<Record, RecordHash, RecordEq> replacedMap;
-    replacedMap.reserve(entities.size());
-
-    // remove NOTE: for high remove batches, it may be faster to cache
-    // archetypes
-    for (auto &target : entities) {
-      Bitmask &bitmask = m_records[target].bitmask;
-      Column &column = m_records[target].column;
-      Archetype &archetype = m_archetypes.at(bitmask);
-      replacedMap.emplace(bitmask,
-                          archetype.remove<ObjectComponents...>(column));
-      bitmask = Bitmask{-1};
-      column = Column{-1};
-    }
-    // update remaining records columns
-    std::size_t updated = 0;
-    for (Record &record : m_records) {
-      // NOTE: there is a possibility that it will find the some invalid record,
-      // in this case, we need to test it to make sure that is the correct
-      // behaviour
-
-      P_ASSERT(record.bitmask != Bitmask{-1} && record.column != Column{-1},
-               "The debug begins");
-      if (auto it = replacedMap.find(record); it != replacedMap.end()) {
-        record.column = it->second;
-        if (++updated == replacedMap.size())
-          break;
-      }
-    }
+  // False once the entity was removed, even if its index was recycled since.
+  // Generations wrap after MaxEntityGeneration removals of the same index
+  bool isAlive(Entity entity) const
+  {
+    return entity.value >= 0 && entityIndex(entity) < m_records.size() &&
+           m_records[entityIndex(entity)].generation ==
+               entityGeneration(entity);
   }
 
 private:
@@ -407,6 +1380,10 @@ private:
   template <ECSComponent... Components>
   static constexpr Bitmask getMultipleBitmask()
   {
+    static_assert(!anySparse<Components...>(),
+                  "Sparse components aren't part of archetypes: they can't be "
+                  "created with the others or iterated by chunk. Use "
+                  "addComponents on their own and each() to iterate them");
     if constexpr (hasAllBitmask<Components...>()) {
       return ComponentManagerT::template multiComponentBitmask<Components...>();
     }
@@ -416,6 +1393,8 @@ private:
   }
   template <ECSComponent Component> static constexpr Bitmask getSingleBitmask()
   {
+    static_assert(!SparseComponent<Component>,
+                  "Sparse components aren't part of archetypes");
     if constexpr (hasBitmask<Component>()) {
       return ComponentManagerT::template singleComponentBitmask<Component>();
     }
@@ -432,12 +1411,571 @@ private:
     return ComponentManagerT::template isRegistered<Component>();
   }
 
+  // Sparse set related
+  template <typename... Components> static constexpr bool anySparse()
+  {
+    return (SparseComponent<Components> || ...);
+  }
+  template <typename C> using SparseSetOf = SparseSet<std::remove_const_t<C>>;
+  template <typename C> SparseSetOf<C> &sparseSet()
+  {
+    constexpr size_t c = ComponentManagerT::template componentIndex<C>();
+    SparseSlot &slot = m_sparseSets[c];
+    if (!slot.set) {
+      slot.set = ErasedSparseSet{new SparseSetOf<C>(), [](void *set) {
+                                   delete static_cast<SparseSetOf<C> *>(set);
+                                 }};
+      slot.tryRemove = [](void *set, Entity entity) {
+        return static_cast<SparseSetOf<C> *>(set)->tryRemove(entity);
+      };
+      m_sparseInUse.push_back(c);
+    }
+    return *static_cast<SparseSetOf<C> *>(slot.set.get());
+  }
+  // null while no entity ever had the component
+  template <typename C> SparseSetOf<C> *findSparseSet()
+  {
+    constexpr size_t c = ComponentManagerT::template componentIndex<C>();
+    return static_cast<SparseSetOf<C> *>(m_sparseSets[c].set.get());
+  }
+  template <typename C> const SparseSetOf<C> *findSparseSet() const
+  {
+    constexpr size_t c = ComponentManagerT::template componentIndex<C>();
+    return static_cast<const SparseSetOf<C> *>(m_sparseSets[c].set.get());
+  }
+  // the archetype bits of the dense components only
+  template <typename... Components> static constexpr Bitmask denseMask()
+  {
+    return (Bitmask{} | ... | denseBit<Components>());
+  }
+  template <typename C> static constexpr Bitmask denseBit()
+  {
+    if constexpr (SparseComponent<C>)
+      return Bitmask{};
+    else
+      return getSingleBitmask<std::remove_const_t<C>>();
+  }
+  // each() related. Dense components always count as present here, the
+  // archetype mask already checked them
+  template <typename C> bool inSparse(Entity entity) const
+  {
+    if constexpr (SparseComponent<C>) {
+      const SparseSetOf<C> *set = findSparseSet<C>();
+      return set != nullptr && set->contains(entity);
+    } else {
+      return true;
+    }
+  }
+  template <typename... Components>
+  bool inAnySparse([[maybe_unused]] Entity entity) const
+  {
+    return ((SparseComponent<Components> && inSparse<Components>(entity)) ||
+            ...);
+  }
+  // keep the entities of the smallest sparse set, missing if one is empty or
+  // was never created since then nothing can match
+  template <typename C>
+  void pickDriver(std::span<const Entity> &driver, bool &missing) const
+  {
+    if constexpr (SparseComponent<C>) {
+      const SparseSetOf<C> *set = findSparseSet<C>();
+      if (set == nullptr || set->empty())
+        missing = true;
+      else if (driver.empty() || set->size() < driver.size())
+        driver = set->entities();
+    }
+  }
+  template <typename C>
+  C &eachComponent(Entity entity, Archetype *archetype, Column column)
+  {
+    if constexpr (SparseComponent<C>) {
+      return findSparseSet<C>()->get(entity);
+    } else {
+      if constexpr (!std::is_const_v<C>)
+        archetype->template markChanged<C>(chunkOf(*archetype, column),
+                                           m_changeTick);
+      return archetype->template fetchComponent<std::remove_const_t<C>>(
+          column);
+    }
+  }
+  template <typename C> bool hasComponent(Entity entity) const
+  {
+    if constexpr (SparseComponent<C>) {
+      P_ASSERT(isAlive(entity), "Entity {} is stale or was never created",
+               entity);
+      const SparseSetOf<C> *set = findSparseSet<C>();
+      return set != nullptr && set->contains(entity);
+    } else {
+      return hasAny<C>(entity);
+    }
+  }
+
+  // Archetype related
+  static constexpr bool matchesQuery(Bitmask mask, Bitmask include,
+                                     Bitmask exclude)
+  {
+    return (mask & include) == include && (mask & exclude).none();
+  }
+  // every archetype must be created here, so the cached queries can see it
+  Archetype &getOrCreateArchetype(Bitmask bitmask)
+  {
+    auto [it, isInserted] = m_archetypes.try_emplace(bitmask);
+    if (isInserted) {
+      m_archetypeMasks.push_back(bitmask);
+      m_archetypeList.push_back(&it->second);
+      std::lock_guard lock(m_queriesMutex);
+      for (auto &[masks, archetypes] : m_queries)
+        if (matchesQuery(bitmask, masks.first, masks.second))
+          archetypes.push_back(&it->second);
+    }
+    return it->second;
+  }
+  // The scan over all archetypes happens only the first time a mask pair is
+  // queried. Const queries share the same cache, the archetypes are still
+  // owned by this registry and only handed out as const from there
+  const std::vector<Archetype *> &cachedQuery(Bitmask include,
+                                              Bitmask exclude) const
+  {
+    std::lock_guard lock(m_queriesMutex);
+    auto [it, isInserted] = m_queries.try_emplace({include, exclude});
+    if (isInserted) {
+      std::vector<Archetype *> &matches = it->second;
+      m_archetypeMasks.forEachMatch(include, exclude, [&](size_t i) {
+        matches.push_back(m_archetypeList[i]);
+      });
+    }
+    return it->second;
+  }
+
+  // Sort related
+  // Rows of one archetype in the order of compare, returns how many moved.
+  // order is only scratch, kept by the caller between archetypes
+  template <ECSComponent C, typename Compare>
+  size_t sortRows(Archetype &archetype, Compare &compare,
+                  std::vector<size_t> &order)
+  {
+    const ChunkedStorage<C> &keys =
+        std::as_const(archetype).template getComponent<C>();
+    order.resize(keys.size());
+    std::iota(order.begin(), order.end(), size_t{0});
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return compare(keys[a], keys[b]);
+    });
+    return applyOrder(archetype, order);
+  }
+  // Rows of one archetype regrouped by the values of its shared components,
+  // returns how many moved
+  size_t groupRows(Archetype &archetype, std::vector<size_t> &order)
+  {
+    if (!archetype.hasSharedColumns())
+      return 0;
+    archetype.groupSharedRows(order);
+    return applyOrder(archetype, order);
+  }
+  // Move the rows as reorderRows(order) does and update their records,
+  // returns how many moved
+  size_t applyOrder(Archetype &archetype, std::span<const size_t> order)
+  {
+    if (std::is_sorted(order.begin(), order.end()))
+      return 0;
+    archetype.reorderRows(order, m_reorderScratch);
+    size_t moved = 0;
+    for (size_t row = 0; row < order.size(); ++row)
+      if (order[row] != row) {
+        const Column column = Column{static_cast<int32_t>(row)};
+        recordOf(archetype.m_entities[row]).column = column;
+        markRowChanged(archetype, column);
+        ++moved;
+      }
+    return moved;
+  }
+
+  // Compaction related
+  // Visit the archetypes in mask order from the cursor, wrapping around once
+  // at most. sortRows(mask, archetype) returns the bytes it moved
+  template <typename SortFn>
+  CompactReport<Bitmask> compactArchetypes(const CompactOptions &options,
+                                           SortFn &&sortRows)
+  {
+    CompactReport<Bitmask> report;
+    std::vector<Archetype *> dropped;
+    auto it = m_compactCursor ? m_archetypes.upper_bound(*m_compactCursor)
+                              : m_archetypes.begin();
+    for (size_t visited = 0; visited < m_archetypes.size(); ++visited) {
+      if (options.budgetBytes != 0 &&
+          report.bytesReclaimed + report.bytesMoved >= options.budgetBytes)
+        break;
+      if (it == m_archetypes.end())
+        it = m_archetypes.begin();
+      auto &[mask, archetype] = *it;
+      report.bytesMoved += sortRows(mask, archetype);
+      CompactedArchetype<Bitmask> compacted{mask};
+      if (options.dropEmpty && archetype.m_entities.empty()) {
+        compacted.bytesReclaimed = archetype.reservedBytes();
+        compacted.dropped = true;
+        dropped.push_back(&archetype);
+      } else {
+        compacted.bytesReclaimed = archetype.shrink(options.spareChunks);
+      }
+      if (compacted.bytesReclaimed != 0 || compacted.dropped) {
+        report.bytesReclaimed += compacted.bytesReclaimed;
+        report.archetypes.push_back(compacted);
+      }
+      m_compactCursor = mask;
+      if (++it == m_archetypes.end()) {
+        report.passCompleted = true;
+        m_compactCursor.reset();
+      }
+    }
+    dropArchetypes(dropped);
+    return report;
+  }
+  // Destroy archetypes, forgetting them everywhere they were cached
+  void dropArchetypes(std::span<Archetype *const> dropped)
+  {
+    if (dropped.empty())
+      return;
+    auto isDropped = [dropped](const Archetype *archetype) {
+      return std::find(dropped.begin(), dropped.end(), archetype) !=
+             dropped.end();
+    };
+    auto toDropped = [&isDropped](const auto &edge) {
+      return isDropped(edge.second.target);
+    };
+    m_archetypeMasks.removeIf(
+        [&](size_t i) { return isDropped(m_archetypeList[i]); });
+    std::erase_if(m_archetypeList, isDropped);
+    {
+      std::lock_guard lock(m_queriesMutex);
+      for (auto &[masks, archetypes] : m_queries)
+        std::erase_if(archetypes, isDropped);
+    }
+    for (auto &[mask, archetype] : m_archetypes) {
+      std::erase_if(archetype.m_addEdges, toDropped);
+      std::erase_if(archetype.m_removeEdges, toDropped);
+    }
+    std::erase_if(m_archetypes, [&isDropped](const auto &entry) {
+      return isDropped(&entry.second);
+    });
+  }
+
+  // Snapshot related
+  // An archetype of a snapshot, pointing into its bytes
+  struct SnapshotBlock {
+    Bitmask mask;
+    size_t rows = 0;
+    size_t rowBytes = 0;
+    const std::byte *entities = nullptr;
+    std::array<const std::byte *, Archetype::NumberOfColumns> columns = {};
+  };
+  static size_t columnCount(Bitmask mask)
+  {
+    size_t count = 0;
+    for (std::uint64_t word : mask.words)
+      count += static_cast<size_t>(std::popcount(word));
+    return count;
+  }
+  // Both passes of captureSnapshot, see SnapshotWriter
+  template <ECSComponent... Components>
+  size_t writeSnapshot(SnapshotWriter &writer) const
+  {
+    static_assert(std::is_trivially_copyable_v<Record>);
+    const Bitmask saved = getMultipleBitmask<Components...>();
+    size_t archetypes = 0;
+    size_t dropped = 0;
+    for (const auto &[mask, archetype] : m_archetypes) {
+      if ((mask & ~saved).any())
+        dropped += archetype.m_entities.size();
+      else if (!archetype.m_entities.empty())
+        ++archetypes;
+    }
+
+    constexpr std::uint64_t layout =
+        ComponentManagerT::template layoutHash<Components...>();
+    writer.write(SnapshotHeader{.components = Archetype::NumberOfColumns,
+                                .layout = layout,
+                                .recordBytes = sizeof(Record),
+                                .records = m_records.size(),
+                                .freeEntities = m_availableEntities.size(),
+                                .droppedEntities = dropped,
+                                .archetypes = archetypes});
+    writer.align();
+    writer.write(m_records.data(), m_records.size() * sizeof(Record));
+    writer.align();
+    for (Entity entity : m_availableEntities)
+      writer.write(entity);
+    writer.align();
+    for (const auto &[mask, archetype] : m_archetypes)
+      if ((mask & ~saved).any())
+        writer.write(archetype.m_entities.data(),
+                     archetype.m_entities.size() * sizeof(Entity));
+    for (const auto &[mask, archetype] : m_archetypes) {
+      if ((mask & ~saved).any() || archetype.m_entities.empty())
+        continue;
+      writer.align();
+      writer.write(SnapshotArchetype<Bitmask>{
+          mask, archetype.m_entities.size(), columnCount(mask)});
+      (..., writeColumnHeader<Components>(writer, mask));
+      writer.align();
+      writer.write(archetype.m_entities.data(),
+                   archetype.m_entities.size() * sizeof(Entity));
+      (..., writeColumn<Components>(writer, mask, archetype));
+    }
+    return dropped;
+  }
+  // Point block at the next archetype of reader, checking its columns are
+  // the ones of the loaded Components
+  static bool readSnapshotBlock(
+      SnapshotReader &reader,
+      const std::array<size_t, Archetype::NumberOfColumns> &rowBytes,
+      SnapshotBlock &block)
+  {
+    reader.align();
+    SnapshotArchetype<Bitmask> archetype;
+    if (!reader.read(archetype) ||
+        archetype.columns != columnCount(archetype.mask))
+      return false;
+    block.mask = archetype.mask;
+    block.rows = archetype.rows;
+    std::vector<SnapshotColumn> columns(archetype.columns);
+    Bitmask seen{};
+    for (SnapshotColumn &column : columns) {
+      if (!reader.read(column) || column.component >= rowBytes.size() ||
+          !archetype.mask.test(column.component) ||
+          seen.test(column.component) ||
+          rowBytes[column.component] != column.rowBytes ||
+          column.rowBytes == 0)
+        return false;
+      seen |= Bitmask::bit(column.component);
+    }
+    reader.align();
+    block.entities = reader.take(block.rows, sizeof(Entity));
+    for (const SnapshotColumn &column : columns) {
+      reader.align();
+      block.columns[column.component] =
+          reader.take(block.rows, column.rowBytes);
+      block.rowBytes += column.rowBytes;
+    }
+    return !reader.failed();
+  }
+  static Entity snapshotEntity(const std::byte *entities, size_t i)
+  {
+    Entity entity;
+    std::memcpy(&entity, entities + i * sizeof(Entity), sizeof(Entity));
+    return entity;
+  }
+  // Check the entities of a snapshot agree with each other: every row of a
+  // block and its record point at each other, and every free id is owned by
+  // an empty record, once. The records of the dropped entities are cleared
+  // first, like in a loaded registry
+  static bool checkSnapshotEntities(std::vector<Record> &records,
+                                    std::span<const SnapshotBlock> blocks,
+                                    const std::byte *available,
+                                    size_t freeEntities,
+                                    const std::byte *dropped,
+                                    size_t droppedEntities)
+  {
+    auto owner = [&records](Entity entity) -> Record * {
+      if (entity.value < 0 || entityIndex(entity) >= records.size())
+        return nullptr;
+      Record &record = records[entityIndex(entity)];
+      return record.generation == entityGeneration(entity) ? &record
+                                                           : nullptr;
+    };
+    for (size_t i = 0; i < droppedEntities; ++i) {
+      Record *record = owner(snapshotEntity(dropped, i));
+      if (record == nullptr)
+        return false;
+      record->bitmask = Bitmask{-1};
+      record->column = Column{-1};
+    }
+    std::map<Bitmask, const SnapshotBlock *> blockOf;
+    for (const SnapshotBlock &block : blocks) {
+      if (!blockOf.emplace(block.mask, &block).second)
+        return false;
+      for (size_t row = 0; row < block.rows; ++row) {
+        const Record *record = owner(snapshotEntity(block.entities, row));
+        if (record == nullptr || record->bitmask != block.mask ||
+            record->column.value != static_cast<std::int32_t>(row))
+          return false;
+      }
+    }
+    // every row points at its record, so a placed record only has to point
+    // at a row holding its own index. A record without a row has no
+    // archetype either, sparse components aren't part of its mask
+    for (size_t i = 0; i < records.size(); ++i) {
+      const Record &record = records[i];
+      if (record.generation < 0 || record.generation > MaxEntityGeneration ||
+          record.column.value < -1)
+        return false;
+      if (record.column.value == -1) {
+        if (record.bitmask != Bitmask{-1})
+          return false;
+        continue;
+      }
+      const auto block = blockOf.find(record.bitmask);
+      const size_t row = static_cast<size_t>(record.column.value);
+      if (block == blockOf.end() || row >= block->second->rows ||
+          entityIndex(snapshotEntity(block->second->entities, row)) != i)
+        return false;
+    }
+    std::vector<bool> freed(records.size(), false);
+    for (size_t i = 0; i < freeEntities; ++i) {
+      const Entity entity = snapshotEntity(available, i);
+      const Record *record = owner(entity);
+      if (record == nullptr || record->column.value != -1 ||
+          record->bitmask != Bitmask{-1} || freed[entityIndex(entity)])
+        return false;
+      freed[entityIndex(entity)] = true;
+    }
+    return true;
+  }
+  template <ECSComponent C>
+  static void writeColumnHeader(SnapshotWriter &writer, Bitmask mask)
+  {
+    constexpr size_t c = ComponentManagerT::template componentIndex<C>();
+    if (mask.test(c))
+      writer.write(SnapshotColumn{c, sizeof(C)});
+  }
+  template <ECSComponent C>
+  static void writeColumn(SnapshotWriter &writer, Bitmask mask,
+                          const Archetype &archetype)
+  {
+    if (!mask.test(ComponentManagerT::template componentIndex<C>()))
+      return;
+    writer.align();
+    const ChunkedStorage<C> &column = archetype.template getComponent<C>();
+    for (size_t chunk = 0; chunk < archetype.chunkCount(); ++chunk)
+      writer.write(column.chunkData(chunk),
+                   archetype.chunkSize(chunk) * sizeof(C));
+  }
+  template <ECSComponent C>
+  static void loadColumn(Archetype &archetype, const SnapshotBlock &block)
+  {
+    constexpr size_t c = ComponentManagerT::template componentIndex<C>();
+    if (block.mask.test(c))
+      archetype.template createComponent<C>().appendBytes(block.columns[c],
+                                                          block.rows);
+  }
+
+  // Rows [begin, begin + count) of a chunk
+  template <typename... Components>
+  static ChunkView<Components...> subView(const ChunkView<Components...> &chunk,
+                                          size_t begin, size_t count)
+  {
+    return ChunkView<Components...>{
+        std::apply(
+            [begin](Components *...arrays) {
+              return std::tuple<Components *...>{(arrays + begin)...};
+            },
+            chunk.arrays),
+        chunk.entities.subspan(begin, count), count};
+  }
+
   // remove
   void removeEntity(Entity entity)
   {
-    m_records[static_cast<unsigned>(entity)].bitmask = Bitmask{-1};
-    m_records[static_cast<unsigned>(entity)].column = Column{-1};
-    m_availableEntities.push(entity);
+    Record &record = recordOf(entity);
+    record.bitmask = Bitmask{-1};
+    record.column = Column{-1};
+    record.generation = (record.generation + 1) & MaxEntityGeneration;
+    m_availableEntities.push_back(
+        makeEntity(entityIndex(entity), record.generation));
+  }
+
+  // Transition related
+  // Edge from an archetype to the one of mask target, created on first use.
+  // extraBytes is the row size of the components not in from, the only part
+  // of the new archetype row that from doesn't know
+  const typename Archetype::Edge &
+  transition(Archetype &from, Bitmask target,
+             std::map<Bitmask, typename Archetype::Edge> &edges, Bitmask delta,
+             std::size_t extraBytes)
+  {
+    auto it = edges.find(delta);
+    if (it != edges.end())
+      return it->second;
+
+    Archetype &to = getOrCreateArchetype(target);
+    std::vector<std::size_t> shared = from.sharedColumns(target);
+    to.setRowBytes(from.sharedRowBytes(shared) + extraBytes);
+    return edges.try_emplace(delta, &to, std::move(shared)).first->second;
+  }
+  // Drop the row an entity left behind, fixing the record of the entity
+  // moved into its place
+  void leaveArchetype(Archetype &from, Column column)
+  {
+    queueLeave(from, column);
+    from.flushRemovals();
+  }
+  // leaveArchetype, the columns following at from.flushRemovals()
+  void queueLeave(Archetype &from, Column column)
+  {
+    auto [lastColumn, swappedEntity] = from.queueRemove(column);
+    if (static_cast<std::size_t>(column) < from.m_entities.size()) {
+      recordOf(swappedEntity).column = column;
+      markRowChanged(from, column);
+    }
+  }
+  // Change tick related
+  static size_t chunkOf(const Archetype &archetype, Column column)
+  {
+    return static_cast<size_t>(column) / archetype.rowsPerChunk();
+  }
+  // a row that was just written or moved counts as changed in every column
+  void markRowChanged(Archetype &archetype, Column column)
+  {
+    archetype.markRowsChanged(static_cast<size_t>(column), 1, m_changeTick);
+  }
+
+  // Bulk creation related
+  template <ECSComponent... Components, typename PushFn>
+  std::vector<Entity> createBatch(size_t count, PushFn &&push)
+  {
+    return createBatch(getMultipleBitmask<Components...>(), count,
+                       std::forward<PushFn>(push));
+  }
+  template <typename PushFn>
+  std::vector<Entity> createBatch(Bitmask bitMask, size_t count, PushFn &&push)
+  {
+    Archetype &archetype = getOrCreateArchetype(bitMask);
+    std::vector<Entity> entities = allocateEntities(count);
+    const Column first = push(archetype, std::span<const Entity>(entities));
+    for (size_t i = 0; i < count; ++i)
+      updateRecord(entities[i], bitMask, static_cast<size_t>(first) + i);
+    archetype.markRowsChanged(static_cast<size_t>(first), count, m_changeTick);
+    m_observers.recordAdded(entities, bitMask);
+    return entities;
+  }
+  template <typename C> static auto moveFrom(std::span<C> column)
+  {
+    return [column](size_t i) -> C && { return std::move(column[i]); };
+  }
+  template <typename C> static auto copyFrom(std::span<C> column)
+  {
+    return [column](size_t i) -> const C & { return column[i]; };
+  }
+  template <typename C> static auto copyOf(const C &prototype)
+  {
+    return [&prototype](size_t) -> const C & { return prototype; };
+  }
+  // Same as calling createEntity count times, recycled ids first
+  std::vector<Entity> allocateEntities(size_t count)
+  {
+    std::vector<Entity> entities;
+    entities.reserve(count);
+    while (entities.size() < count && !m_availableEntities.empty()) {
+      entities.push_back(m_availableEntities.front());
+      m_availableEntities.pop_front();
+    }
+    const size_t needed = m_records.size() + (count - entities.size());
+    if (needed > m_records.capacity())
+      m_records.reserve(std::max(needed, 2 * m_records.capacity()));
+    while (entities.size() < count) {
+      entities.push_back(newEntity());
+      addRecord(Bitmask{-1}, Column{-1});
+    }
+    return entities;
   }
 
   // Record related
@@ -451,12 +1989,37 @@ private:
   }
   void updateRecord(Entity entity, Bitmask bitmask, Column column)
   {
-    m_records[static_cast<unsigned>(entity)] = {bitmask, column};
+    Record &record = recordOf(entity);
+    record.bitmask = bitmask;
+    record.column = column;
   }
   void updateRecord(Entity entity, Bitmask bitmask, size_t column)
   {
-    m_records[static_cast<unsigned>(entity)] = {
-        bitmask, Column{static_cast<int32_t>(column)}};
+    updateRecord(entity, bitmask, Column{static_cast<int32_t>(column)});
+  }
+  // Every access to a record goes through here, so stale handles are caught
+  Record &recordOf(Entity entity)
+  {
+    P_ASSERT(isAlive(entity), "Entity {} is stale or was never created",
+             entity);
+    return m_records[entityIndex(entity)];
+  }
+  const Record &recordOf(Entity entity) const
+  {
+    P_ASSERT(isAlive(entity), "Entity {} is stale or was never created",
+             entity);
+    return m_records[entityIndex(entity)];
+  }
+  // A never used index, its generation starts at 0. Checked in every build,
+  // an index past EntityIndexMask would alias the generation bits
+  Entity newEntity()
+  {
+    if (numberOfEntities >= EntityIndexMask) {
+      PLOG_E("Reached the maximum number of entities, {}",
+             EntityIndexMask + 1);
+      std::terminate();
+    }
+    return makeEntity(static_cast<size_t>(++numberOfEntities), 0);
   }
 };
 } // namespace reg
@@ -9,26 +9,274 @@
 
 #include "Core.h"
 #include "CoreFiles/LogWrapper.h"
+#include "ECS/Registry/Bitmask.h"
+#include "ECS/Registry/ChunkedStorage.h"
 #include "ECS/Registry/Entity.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
 #include <exception>
-#include <typeindex>
+#include <map>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace reg
 {
 
+// A component opts into sharing by declaring
+//   static constexpr bool shared = true;
+// along with operator==. Its value is meant to be the same for many entities,
+// like the texture or the layer they are drawn with. Rows still hold a copy
+// each, but queries that ask for it split their chunk views wherever the
+// value changes, so one view sees a single value, and compact() regroups the
+// rows of equal values so those views stay long. A view handed out as mutable
+// must keep its rows equal, e.g. by writing the same value to all of them
+template <typename T>
+concept SharedComponent =
+    ECSComponent<T> && std::equality_comparable<std::remove_cvref_t<T>> &&
+    requires { requires std::remove_cvref_t<T>::shared; };
+
+// A component holding state only valid for the entity it belongs to, like an
+// index into a system, declares
+//   void resetForPrefab();
+// which sets that state back to its default. It is called on every copy made
+// into a prefab, so instances never inherit it from the entity the prefab was
+// made from
+template <typename T>
+concept PrefabResettable =
+    ECSComponent<T> && requires(T &t) { t.resetForPrefab(); };
+
+// Copy construct value into the raw memory at to, as the default of a prefab
+template <typename C> void copyIntoPrefab(void *to, const C &value)
+{
+  C *copy = std::construct_at(static_cast<C *>(to), value);
+  if constexpr (PrefabResettable<C>)
+    copy->resetForPrefab();
+}
+
 // ---------------------------------------------------- //
 // Container definition
 // ---------------------------------------------------- //
-class Archetype
+template <CompileTimeBitMaskType ComponentManagerT> class Archetype
 {
 public:
+  using Bitmask = typename ComponentManagerT::Bitmask;
   using Deleter = void (*)(void *);
-  using ErasedVector = std::unique_ptr<void, Deleter>;
-  std::vector<std::function<Column(Column)>> m_removers;
+  using ErasedColumn = std::unique_ptr<void, Deleter>;
+  template <typename C> using Storage = ChunkedStorage<C>;
+  static constexpr std::size_t NumberOfColumns =
+      ComponentManagerT::getNumberOfRegisteredComponents();
   std::vector<reg::Entity> m_entities;
 
+  // Type erased operations on a column, one static instance per component
+  // type, so an archetype only stores a pointer per column. Used wherever
+  // only the column index is known: removals and moves between archetypes
+  struct ColumnOps {
+    std::size_t rowBytes;
+    void *(*create)(std::size_t rowsPerChunk);
+    Deleter destroy;
+    // fill the hole at each row with the last row, one row after the other.
+    // Each row is its position once the previous ones are removed
+    void (*swapRemoveRows)(void *column, std::span<const std::size_t> rows);
+    // move the rows of from to the end of to, in the order given
+    void (*moveRows)(void *from, std::span<const std::size_t> rows, void *to);
+    // rearrange the rows so the i-th one is the old row order[i]. scratch is
+    // raw memory for as many rows as order, aligned for them
+    void (*reorder)(void *column, std::span<const std::size_t> order,
+                    void *scratch);
+    // free the unused blocks past spareChunks, returns the bytes freed
+    std::size_t (*shrink)(void *column, std::size_t spareChunks);
+    // bytes of the blocks allocated
+    std::size_t (*reservedBytes)(const void *column);
+
+    // Single values outside of a column, used by prefabs. The copies are
+    // null for components that can't be copied, and reset the state of
+    // PrefabResettable ones
+    std::size_t alignment;
+    bool triviallyCopyable;
+    // C::layoutId, empty when it declares none and can't be saved
+    std::string_view layoutId;
+    // copy construct the value at from into the raw memory at to
+    void (*copyValue)(const void *from, void *to);
+    void (*destroyValue)(void *value);
+    // copy construct row of column into the raw memory at to
+    void (*copyRow)(const void *column, std::size_t row, void *to);
+    // append count copies of value at the end of column
+    void (*appendCopies)(void *column, const void *value, std::size_t count);
+    // copy assign value to row of column
+    void (*assignRow)(void *column, std::size_t row, const void *value);
+
+    // rows a and b of column hold equal values, null unless C is shared
+    bool (*sameRows)(const void *column, std::size_t a, std::size_t b);
+  };
+  // Copies of ColumnOps, null when C can't be copied
+  template <typename C>
+  static constexpr decltype(ColumnOps::copyValue) copyValueOf()
+  {
+    if constexpr (std::is_copy_constructible_v<C>)
+      return [](const void *from, void *to) {
+        copyIntoPrefab(to, *static_cast<const C *>(from));
+      };
+    else
+      return nullptr;
+  }
+  template <typename C>
+  static constexpr decltype(ColumnOps::copyRow) copyRowOf()
+  {
+    if constexpr (std::is_copy_constructible_v<C>)
+      return [](const void *column, std::size_t row, void *to) {
+        copyIntoPrefab(to, (*static_cast<const Storage<C> *>(column))[row]);
+      };
+    else
+      return nullptr;
+  }
+  template <typename C>
+  static constexpr decltype(ColumnOps::appendCopies) appendCopiesOf()
+  {
+    if constexpr (std::is_copy_constructible_v<C>)
+      return [](void *column, const void *value, std::size_t count) {
+        const C &prototype = *static_cast<const C *>(value);
+        static_cast<Storage<C> *>(column)->append(
+            count,
+            [&prototype](std::size_t) -> const C & { return prototype; });
+      };
+    else
+      return nullptr;
+  }
+
+  template <typename C>
+  static constexpr decltype(ColumnOps::assignRow) assignRowOf()
+  {
+    if constexpr (std::is_copy_assignable_v<C>)
+      return [](void *column, std::size_t row, const void *value) {
+        (*static_cast<Storage<C> *>(column))[row] =
+            *static_cast<const C *>(value);
+      };
+    else
+      return nullptr;
+  }
+  template <typename C>
+  static constexpr decltype(ColumnOps::sameRows) sameRowsOf()
+  {
+    if constexpr (SharedComponent<C>)
+      return [](const void *column, std::size_t a, std::size_t b) {
+        const Storage<C> &storage = *static_cast<const Storage<C> *>(column);
+        return storage[a] == storage[b];
+      };
+    else
+      return nullptr;
+  }
+
+  template <typename C> static constexpr ColumnOps columnOpsOf = {
+      sizeof(C),
+      [](std::size_t rowsPerChunk) -> void * {
+        return new Storage<C>(rowsPerChunk);
+      },
+      [](void *column) { delete static_cast<Storage<C> *>(column); },
+      [](void *column, std::span<const std::size_t> rows) {
+        Storage<C> &storage = *static_cast<Storage<C> *>(column);
+        for (std::size_t row : rows)
+          storage.swapRemove(row);
+      },
+      [](void *from, std::span<const std::size_t> rows, void *to) {
+        Storage<C> &source = *static_cast<Storage<C> *>(from);
+        Storage<C> &target = *static_cast<Storage<C> *>(to);
+        target.reserve(target.size() + rows.size());
+        for (std::size_t row : rows)
+          target.emplace_back(std::move(source[row]));
+      },
+      [](void *column, std::span<const std::size_t> order, void *scratch) {
+        Storage<C> &storage = *static_cast<Storage<C> *>(column);
+        C *rows = static_cast<C *>(scratch);
+        for (std::size_t i = 0; i < order.size(); ++i)
+          std::construct_at(rows + i, std::move(storage[order[i]]));
+        for (std::size_t i = 0; i < order.size(); ++i) {
+          storage[i] = std::move(rows[i]);
+          std::destroy_at(rows + i);
+        }
+      },
+      [](void *column, std::size_t spareChunks) {
+        return static_cast<Storage<C> *>(column)->shrink(spareChunks);
+      },
+      [](const void *column) {
+        const Storage<C> &storage = *static_cast<const Storage<C> *>(column);
+        return storage.allocatedChunks() * storage.rowsPerChunk() * sizeof(C);
+      },
+      alignof(C),
+      std::is_trivially_copyable_v<C>,
+      layoutIdOf<C>(),
+      copyValueOf<C>(),
+      [](void *value) { std::destroy_at(static_cast<C *>(value)); },
+      copyRowOf<C>(),
+      appendCopiesOf<C>(),
+      assignRowOf<C>(),
+      sameRowsOf<C>()};
+
+  // Cached transition to the archetype that has (or lacks) a set of
+  // components, along with the columns that both archetypes share
+  struct Edge {
+    Archetype *target;
+    std::vector<std::size_t> sharedColumns;
+  };
+  // keyed by the mask of the components added or removed
+  std::map<Bitmask, Edge> m_addEdges;
+  std::map<Bitmask, Edge> m_removeEdges;
+  // entities of a batch the registry is gathering, kept so batches don't
+  // allocate
+  std::vector<reg::Entity> m_batchEntities;
+
 private:
-  std::map<std::type_index, ErasedVector> m_componentMap;
+  // One slot per registered component, indexed by its compile time position.
+  // Slots of components that aren't part of this archetype stay empty
+  std::array<ErasedColumn, NumberOfColumns> m_columns =
+      emptyColumns(std::make_index_sequence<NumberOfColumns>{});
+  // Shared by every column. Zero until the first column is created
+  std::size_t m_rowsPerChunk = 0;
+  std::array<const ColumnOps *, NumberOfColumns> m_ops = {};
+  // Indices of the columns that exist, in creation order
+  std::vector<std::size_t> m_columnList;
+  // the ones of shared components
+  std::vector<std::size_t> m_sharedColumnList;
+
+  template <std::size_t... I>
+  static std::array<ErasedColumn, NumberOfColumns>
+  emptyColumns(std::index_sequence<I...>)
+  {
+    return {((void)I, ErasedColumn{nullptr, nullptr})...};
+  }
+  // The chunk layout is decided by the size of a whole row, before the first
+  // column is created. Every path creating columns knows it: the pushes get
+  // all the components of the archetype, the others call setRowBytes() first
+  void setChunkLayout(std::size_t rowBytes)
+  {
+    if (m_rowsPerChunk == 0)
+      m_rowsPerChunk = rowsPerChunkFor(rowBytes + sizeof(reg::Entity));
+  }
+  // Column c, created from its type erased operations if it doesn't exist
+  void *erasedColumn(std::size_t c, const ColumnOps &ops)
+  {
+    if (!m_columns[c]) {
+      P_ASSERT(m_rowsPerChunk != 0, "Chunk layout must be set first");
+      m_columns[c] = ErasedColumn{ops.create(m_rowsPerChunk), ops.destroy};
+      m_ops[c] = &ops;
+      m_columnList.push_back(c);
+      if (ops.sameRows != nullptr)
+        m_sharedColumnList.push_back(c);
+    }
+    return m_columns[c].get();
+  }
+  template <typename C> static constexpr std::size_t columnIndex()
+  {
+    return ComponentManagerT::template componentIndex<C>();
+  }
 
 public:
   // ---------------------------------------------------- //
@@ -36,31 +284,21 @@ public:
   // ---------------------------------------------------- //
 
   // either finds or create a new component
-  template <typename C> std::vector<C> &createComponent()
+  template <typename C> Storage<C> &createComponent()
   {
-    auto it = m_componentMap.find(std::type_index(typeid(C)));
-    if (it != m_componentMap.end()) {
-      return *static_cast<std::vector<C> *>(it->second.get());
+    ErasedColumn &slot = m_columns[columnIndex<C>()];
+    if (slot) {
+      return *static_cast<Storage<C> *>(slot.get());
     } else {
+      erasedColumn(columnIndex<C>(), columnOpsOf<C>);
+      PLOG_T("New component bitmask added {}", typeid(C).name());
 
-      auto deleter = [](void *vector) {
-        delete static_cast<std::vector<C> *>(vector);
-      };
-      m_removers.push_back([this](reg::Column column) {
-        return removeFromComponent<C>(column);
-      });
-      auto [newIt, isInserted] =
-          m_componentMap.emplace(std::type_index(typeid(C)),
-                                 ErasedVector{new std::vector<C>(), deleter});
-      P_ASSERT(isInserted, "Could not create new component vector");
-      PLOG_I("New component bitmask added {}", typeid(C).name());
-
-      // store the deleter to use inside the destructor
-      return *static_cast<std::vector<C> *>(newIt->second.get());
+      return *static_cast<Storage<C> *>(slot.get());
     }
   }
   template <typename... Components> Column pushComponents(Components &&...comps)
   {
+    setChunkLayout((std::size_t{0} + ... + sizeof(std::decay_t<Components>)));
     Column column = Column{-1};
     (...,
      (column = pushComponent<Components>(std::forward<Components>(
@@ -70,6 +308,7 @@ public:
   template <typename... Components>
   Column pushComponents(reg::Entity entity, Components &&...comps)
   {
+    setChunkLayout((std::size_t{0} + ... + sizeof(std::decay_t<Components>)));
     Column column = Column{-1};
     (...,
      (column = pushComponent<Components>(std::forward<Components>(
@@ -78,54 +317,289 @@ public:
     return column;
   }
 
+  // Append one row per entity. Each column is filled on its own, values(i)
+  // gives the component of the i-th entity, one function per component
+  template <typename... Components, typename... ValueFns>
+  Column pushColumns(std::span<const reg::Entity> entities,
+                     ValueFns &&...values)
+  {
+    static_assert(sizeof...(Components) == sizeof...(ValueFns));
+    setChunkLayout((std::size_t{0} + ... + sizeof(Components)));
+    const Column first = Column{static_cast<int>(m_entities.size())};
+    (..., createComponent<Components>().append(
+              entities.size(), std::forward<ValueFns>(values)));
+    m_entities.insert(m_entities.end(), entities.begin(), entities.end());
+    return first;
+  }
+  // Append one row per entity, row(i) returns a tuple holding the components
+  // of the i-th entity, in the order of Components. Every column is reserved
+  // once up front
+  template <typename... Components, typename RowFn>
+  Column pushRows(std::span<const reg::Entity> entities, RowFn &&row)
+  {
+    setChunkLayout((std::size_t{0} + ... + sizeof(Components)));
+    const Column first = Column{static_cast<int>(m_entities.size())};
+    std::tuple<Storage<Components> &...> columns{
+        createComponent<Components>()...};
+    std::apply(
+        [&entities](Storage<Components> &...column) {
+          (..., column.reserve(column.size() + entities.size()));
+        },
+        columns);
+    for (std::size_t i = 0; i < entities.size(); ++i)
+      emplaceRow(columns, row(i), std::index_sequence_for<Components...>{});
+    m_entities.insert(m_entities.end(), entities.begin(), entities.end());
+    return first;
+  }
+
+  // Append count copies of value to column c, e.g. a field of a prefab. The
+  // entities of the new rows are appended by the caller
+  void appendCopies(std::size_t c, const ColumnOps &ops, const void *value,
+                    std::size_t count)
+  {
+    P_ASSERT(ops.appendCopies != nullptr, "Component {} can't be copied", c);
+    ops.appendCopies(erasedColumn(c, ops), value, count);
+  }
+
+  // Overwrite row of column c with a copy of value
+  void assignRow(std::size_t c, std::size_t row, const void *value)
+  {
+    P_ASSERT(m_ops[c]->assignRow != nullptr, "Component {} can't be copied",
+             c);
+    m_ops[c]->assignRow(m_columns[c].get(), row, value);
+  }
+
   // directly add the component to the archetype, should be used N time per
   // entity, with N being the entity's number of components
   template <typename C, typename... Args> Column pushComponent(Args &&...args)
   {
-    std::vector<C> &componentArray = createComponent<C>();
+    Storage<C> &componentArray = createComponent<C>();
     Column index = Column(static_cast<int>(componentArray.size()));
     componentArray.emplace_back(std::forward<Args>(args)...);
     return index;
   }
 
+  template <typename Columns, typename Row, std::size_t... I>
+  static void emplaceRow(Columns &columns, Row &&values,
+                         std::index_sequence<I...>)
+  {
+    (..., std::get<I>(columns).emplace_back(
+              std::get<I>(std::forward<Row>(values))));
+  }
+
   // ---------------------------------------------------- //
-  // remove
+  // transition
   // ---------------------------------------------------- //
 
-  std::pair<Column, Entity> remove(Column column)
+  // Columns of this archetype that also belong to the archetype of mask
+  std::vector<std::size_t> sharedColumns(Bitmask mask) const
   {
-    Column lastColumn = Column{-1};
-    Entity swappedEntity = m_entities[m_entities.size() - 1];
+    std::vector<std::size_t> shared;
+    for (std::size_t c : m_columnList)
+      if (mask.test(c))
+        shared.push_back(c);
+    return shared;
+  }
+  // Total size of a row of the archetype of mask, when known
+  std::size_t sharedRowBytes(std::span<const std::size_t> columns) const
+  {
+    std::size_t bytes = 0;
+    for (std::size_t c : columns)
+      bytes += m_ops[c]->rowBytes;
+    return bytes;
+  }
 
-    for (std::function<Column(Column)> &remover : m_removers) {
-      lastColumn = remover(column);
+  // Copy a row into to, column by column along a precomputed edge, and append
+  // the entity. Columns that only to has must be pushed by the caller. The
+  // row itself is left here, remove it afterwards
+  Column moveRowTo(Archetype &to, Column row, const Edge &edge)
+  {
+    const std::size_t moved = static_cast<std::size_t>(row);
+    return moveRowsTo(to, std::span<const std::size_t>(&moved, 1), edge);
+  }
+  // moveRowTo for many rows, one call per shared column rather than per row.
+  // Returns the column of the first row in to, the others follow it
+  Column moveRowsTo(Archetype &to, std::span<const std::size_t> rows,
+                    const Edge &edge)
+  {
+    const Column first = Column{static_cast<int>(to.m_entities.size())};
+    for (std::size_t c : edge.sharedColumns)
+      m_ops[c]->moveRows(m_columns[c].get(), rows,
+                         to.erasedColumn(c, *m_ops[c]));
+    for (std::size_t row : rows) {
+      to.m_entities.push_back(m_entities[row]);
+      if (!isEnabled(row))
+        to.setEnabled(to.m_entities.size() - 1, false);
     }
-    std::iter_swap(m_entities.begin() + column, m_entities.end() - 1);
-    m_entities.pop_back();
-    return std::make_pair(lastColumn, swappedEntity);
+    return first;
   }
 
-  template <typename... Components>
+  // Set the chunk layout of a new archetype from the size of its rows, the
+  // first call wins. Used by transitions, loads and one component pushes
+  void setRowBytes(std::size_t rowBytes) { setChunkLayout(rowBytes); }
+
+  // ---------------------------------------------------- //
+  // sort
+  // ---------------------------------------------------- //
+
+  // Rearrange every column and the entities so the i-th row is the old row
+  // order[i]. order must be a permutation of all the rows. Each column is
+  // gathered in scratch and moved back, scratch is kept by the caller so
+  // reordering many archetypes only grows it to the largest column
+  void reorderRows(std::span<const std::size_t> order,
+                   std::vector<std::byte> &scratch)
+  {
+    P_ASSERT(order.size() == m_entities.size(),
+             "reorderRows expects one index per row");
+    for (std::size_t c : m_columnList)
+      m_ops[c]->reorder(m_columns[c].get(), order,
+                        scratchRows(scratch, m_ops[c]->rowBytes,
+                                    m_ops[c]->alignment, order.size()));
+    reg::Entity *entities = static_cast<reg::Entity *>(scratchRows(
+        scratch, sizeof(reg::Entity), alignof(reg::Entity), order.size()));
+    for (std::size_t row = 0; row < order.size(); ++row)
+      entities[row] = m_entities[order[row]];
+    std::copy(entities, entities + order.size(), m_entities.begin());
+    if (m_disabledCount != 0) {
+      std::vector<std::uint64_t> disabled((order.size() + 63) / 64, 0);
+      for (std::size_t row = 0; row < order.size(); ++row)
+        if (!isEnabled(order[row]))
+          disabled[row / 64] |= std::uint64_t{1} << (row % 64);
+      m_disabled = std::move(disabled);
+    }
+  }
+
+  // Room for rows of rowBytes in scratch, aligned to alignment
+  static void *scratchRows(std::vector<std::byte> &scratch,
+                           std::size_t rowBytes, std::size_t alignment,
+                           std::size_t rows)
+  {
+    std::size_t space = rowBytes * rows + alignment;
+    if (scratch.size() < space)
+      scratch.resize(space);
+    void *data = scratch.data();
+    return std::align(alignment, rowBytes * rows, data, space);
+  }
+
+  // ---------------------------------------------------- //
+  // shared components
+  // ---------------------------------------------------- //
+
+  bool hasSharedColumns() const { return !m_sharedColumnList.empty(); }
+  // every shared component holds the same value in rows a and b
+  bool sameSharedValues(std::size_t a, std::size_t b) const
+  {
+    for (std::size_t c : m_sharedColumnList)
+      if (!m_ops[c]->sameRows(m_columns[c].get(), a, b))
+        return false;
+    return true;
+  }
+  // Fill order with the rows regrouped by shared values, for reorderRows():
+  // groups come in the order they first appear and keep the order of their
+  // rows. Values are only compared for equality, so this is linear in the
+  // number of distinct values per row
+  void groupSharedRows(std::vector<std::size_t> &order) const
+  {
+    const std::size_t rows = m_entities.size();
+    // first row and number of rows of each group
+    std::vector<std::pair<std::size_t, std::size_t>> groups;
+    std::vector<std::size_t> groupOf(rows);
+    for (std::size_t row = 0; row < rows; ++row) {
+      std::size_t g = row == 0 ? 0 : groupOf[row - 1];
+      if (row == 0 || !sameSharedValues(groups[g].first, row)) {
+        g = 0;
+        while (g < groups.size() && !sameSharedValues(groups[g].first, row))
+          ++g;
+        if (g == groups.size())
+          groups.emplace_back(row, 0);
+      }
+      groupOf[row] = g;
+      ++groups[g].second;
+    }
+    std::size_t next = 0;
+    for (auto &[first, count] : groups)
+      next += std::exchange(count, next);
+    order.resize(rows);
+    for (std::size_t row = 0; row < rows; ++row)
+      order[groups[groupOf[row]].second++] = row;
+  }
+
+  // ---------------------------------------------------- //
+  // memory
+  // ---------------------------------------------------- //
+
+  // Bytes of one row over every column
+  std::size_t rowBytes() const { return sharedRowBytes(m_columnList); }
+  // Bytes held by the columns, the entities, the change ticks and the
+  // disabled bits
+  std::size_t reservedBytes() const
+  {
+    std::size_t bytes = m_entities.capacity() * sizeof(reg::Entity) +
+                        m_disabled.capacity() * sizeof(std::uint64_t);
+    for (std::size_t c : m_columnList)
+      bytes += m_ops[c]->reservedBytes(m_columns[c].get()) +
+               m_changeTicks[c].capacity() * sizeof(ChangeTick);
+    return bytes;
+  }
+  // Give back what the rows don't use anymore, keeping spareChunks empty
+  // blocks per column for the rows to come. Returns the bytes freed
+  std::size_t shrink(std::size_t spareChunks)
+  {
+    const std::size_t before = reservedBytes();
+    for (std::size_t c : m_columnList) {
+      m_ops[c]->shrink(m_columns[c].get(), spareChunks);
+      std::vector<ChangeTick> &ticks = m_changeTicks[c];
+      if (ticks.size() > chunkCount()) {
+        ticks.resize(chunkCount());
+        ticks.shrink_to_fit();
+      }
+    }
+    const std::size_t spareRows = spareChunks * m_rowsPerChunk;
+    if (m_entities.capacity() > m_entities.size() + spareRows) {
+      std::vector<reg::Entity> entities;
+      entities.reserve(m_entities.size() + spareRows);
+      entities.assign(m_entities.begin(), m_entities.end());
+      m_entities = std::move(entities);
+    }
+    if (m_disabledCount == 0)
+      m_disabled = {};
+    return before - reservedBytes();
+  }
+
+  // ---------------------------------------------------- //
+  // remove
+  // ---------------------------------------------------- //
+
   std::pair<Column, Entity> remove(Column column)
   {
-    static_assert(sizeof...(Components) != 0,
-                  "Not allowed to remove from empty archetypes");
-    Column lastColumn = Column{-1};
-    Entity swappedEntity = m_entities[m_entities.size() - 1];
-    (..., (lastColumn = removeFromComponent<Components>(column)));
-    std::iter_swap(m_entities.begin() + column, m_entities.end() - 1);
+    const std::pair<Column, Entity> removed = queueRemove(column);
+    flushRemovals();
+    return removed;
+  }
+  // remove() for rows leaving together: the entity moves now, the columns
+  // all at once in flushRemovals(), one call per column rather than per row.
+  // column is the position of the row once the queued ones are removed.
+  // Flush before anything reads the components again
+  std::pair<Column, Entity> queueRemove(Column column)
+  {
+    const std::size_t row = static_cast<std::size_t>(column);
+    const std::size_t last = m_entities.size() - 1;
+    const Entity swappedEntity = m_entities[last];
+    m_entities[row] = swappedEntity;
     m_entities.pop_back();
-    return std::make_pair(lastColumn, swappedEntity);
+    if (m_disabledCount != 0) {
+      setEnabled(row, isEnabled(last));
+      setEnabled(last, true);
+    }
+    m_queuedRemovals.push_back(row);
+    return std::make_pair(Column{static_cast<int>(last)}, swappedEntity);
   }
-
-  // This is returning the swapped element's column. You need to use it to
-  // update its entity record later
-  template <typename C> Column removeFromComponent(Column index)
+  bool hasQueuedRemovals() const { return !m_queuedRemovals.empty(); }
+  void flushRemovals()
   {
-    std::vector<C> &v = getComponent<C>();
-    std::iter_swap(v.begin() + index, v.end() - 1);
-    v.pop_back();
-    return Column{static_cast<int>(v.size())};
+    for (std::size_t c : m_columnList)
+      m_ops[c]->swapRemoveRows(m_columns[c].get(), m_queuedRemovals);
+    m_queuedRemovals.clear();
   }
 
   // ---------------------------------------------------- //
@@ -146,7 +620,7 @@ public:
 
   template <typename T> const T &fetchComponent(Column entityIndex) const
   {
-    const std::vector<T> &componentArray = getComponent<T>();
+    const Storage<T> &componentArray = getComponent<T>();
     P_ASSERT((unsigned)entityIndex <= componentArray.size(),
              "Entity index {} out of range on array of size {}",
              entityIndex.value, componentArray.size());
@@ -155,38 +629,41 @@ public:
 
   template <typename T> T &fetchComponent(Column entityIndex)
   {
-    std::vector<T> &componentArray = getComponent<T>();
+    Storage<T> &componentArray = getComponent<T>();
     P_ASSERT((unsigned)entityIndex <= componentArray.size(),
              "Entity index {} out of range on array of size {}",
              entityIndex.value, componentArray.size());
     return componentArray[static_cast<unsigned>(entityIndex)];
   }
 
-  template <typename C> const std::vector<C> &getComponent() const
+  template <typename C> const Storage<C> &getComponent() const
   {
-    auto it = m_componentMap.find(std::type_index(typeid(C)));
-    if (it == m_componentMap.end()) {
+    const ErasedColumn &slot = m_columns[columnIndex<C>()];
+    if (!slot) {
       PLOG_E("Cannot find component vector inside Archetype");
       PLOG_E("You are probably trying to call getComponent but the component "
              "you want doesn't exist in the object.");
       PLOG_E("Missing component type: {}", typeid(C).name());
       std::terminate();
     }
-    return *static_cast<const std::vector<C> *>(it->second.get());
+    return *static_cast<const Storage<C> *>(slot.get());
   }
 
-  template <typename C> std::vector<C> &getComponent()
+  template <typename C> Storage<C> &getComponent()
   {
-    auto it = m_componentMap.find(std::type_index(typeid(C)));
-    if (it == m_componentMap.end()) {
+    ErasedColumn &slot = m_columns[columnIndex<C>()];
+    if (!slot) {
       PLOG_E("Cannot find component vector inside Archetype");
       PLOG_E("You are probably trying to call getComponent but the component "
              "you want doesn't exist in the object.");
       PLOG_E("Missing component type: {}", typeid(C).name());
       std::terminate();
     }
-    return *static_cast<std::vector<C> *>(it->second.get());
+    return *static_cast<Storage<C> *>(slot.get());
   }
+  // Type erased column c with its operations, null if it doesn't exist
+  const void *columnData(std::size_t c) const { return m_columns[c].get(); }
+  const ColumnOps *columnOps(std::size_t c) const { return m_ops[c]; }
   Column lastColumn() const
   {
     return Column{static_cast<int>(m_entities.size())};
@@ -195,6 +672,122 @@ public:
   {
     return m_entities[static_cast<unsigned>(column)];
   }
+
+  // ---------------------------------------------------- //
+  // chunks
+  // ---------------------------------------------------- //
+  std::size_t rowsPerChunk() const { return m_rowsPerChunk; }
+  std::size_t chunkCount() const
+  {
+    return m_rowsPerChunk == 0
+               ? 0
+               : (m_entities.size() + m_rowsPerChunk - 1) / m_rowsPerChunk;
+  }
+  // number of rows in use inside a chunk, only the last one can be partial
+  std::size_t chunkSize(std::size_t chunk) const
+  {
+    return std::min(m_rowsPerChunk,
+                    m_entities.size() - chunk * m_rowsPerChunk);
+  }
+  std::span<reg::Entity> chunkEntities(std::size_t chunk)
+  {
+    return {m_entities.data() + chunk * m_rowsPerChunk, chunkSize(chunk)};
+  }
+  std::span<const reg::Entity> chunkEntities(std::size_t chunk) const
+  {
+    return {m_entities.data() + chunk * m_rowsPerChunk, chunkSize(chunk)};
+  }
+
+  // ---------------------------------------------------- //
+  // enabled rows
+  // ---------------------------------------------------- //
+
+  // Rows are enabled unless their bit is set. Disabling keeps the row where
+  // it is, queries skip it. Rows past the last one always have their bit clear
+  bool isEnabled(std::size_t row) const
+  {
+    const std::size_t word = row / 64;
+    return word >= m_disabled.size() ||
+           (m_disabled[word] >> (row % 64) & 1) == 0;
+  }
+  void setEnabled(std::size_t row, bool enabled)
+  {
+    if (isEnabled(row) == enabled)
+      return;
+    const std::size_t word = row / 64;
+    if (word >= m_disabled.size())
+      m_disabled.resize(word + 1, 0);
+    m_disabled[word] ^= std::uint64_t{1} << (row % 64);
+    if (enabled)
+      --m_disabledCount;
+    else
+      ++m_disabledCount;
+  }
+  std::size_t disabledCount() const { return m_disabledCount; }
+  // First row in [row, end) that is enabled, or disabled when disabled is
+  // set, end if there is none. Skips 64 rows per word
+  std::size_t findRow(std::size_t row, std::size_t end, bool disabled) const
+  {
+    while (row < end) {
+      const std::size_t word = row / 64;
+      if (word >= m_disabled.size())
+        return disabled ? end : row;
+      std::uint64_t bits = disabled ? m_disabled[word] : ~m_disabled[word];
+      bits &= ~std::uint64_t{0} << (row % 64);
+      if (bits != 0)
+        return std::min(end, word * 64 + std::countr_zero(bits));
+      row = (word + 1) * 64;
+    }
+    return end;
+  }
+
+  // ---------------------------------------------------- //
+  // change detection
+  // ---------------------------------------------------- //
+
+  // Stamp a chunk of column c with the tick of a write. Chunks never stamped
+  // read as tick 0, i.e. older than any query
+  void markChanged(std::size_t c, std::size_t chunk, ChangeTick tick)
+  {
+    std::vector<ChangeTick> &ticks = m_changeTicks[c];
+    if (ticks.size() <= chunk)
+      ticks.resize(chunk + 1, 0);
+    ticks[chunk] = tick;
+  }
+  template <typename C> void markChanged(std::size_t chunk, ChangeTick tick)
+  {
+    markChanged(columnIndex<C>(), chunk, tick);
+  }
+  // Stamp every column over the chunks holding rows [first, first + count)
+  void markRowsChanged(std::size_t first, std::size_t count, ChangeTick tick)
+  {
+    if (count == 0)
+      return;
+    const std::size_t last = (first + count - 1) / m_rowsPerChunk;
+    for (std::size_t c : m_columnList)
+      for (std::size_t chunk = first / m_rowsPerChunk; chunk <= last; ++chunk)
+        markChanged(c, chunk, tick);
+  }
+  ChangeTick changeTick(std::size_t c, std::size_t chunk) const
+  {
+    const std::vector<ChangeTick> &ticks = m_changeTicks[c];
+    return chunk < ticks.size() ? ticks[chunk] : 0;
+  }
+  template <typename C>
+  bool changedSince(std::size_t chunk, ChangeTick since) const
+  {
+    return changeTick(columnIndex<C>(), chunk) > since;
+  }
+
+private:
+  // per column, the tick of the last write to each of its chunks
+  std::array<std::vector<ChangeTick>, NumberOfColumns> m_changeTicks = {};
+  // one bit per row, set when the row is disabled. Only grows up to the last
+  // disabled row
+  std::vector<std::uint64_t> m_disabled;
+  std::size_t m_disabledCount = 0;
+  // rows removed from the entities but not yet from the columns, in order
+  std::vector<std::size_t> m_queuedRemovals;
 };
 
 } // namespace reg
@@ -7,14 +7,192 @@
 
 #pragma once
 #include "ECS/Registry/Entity.h"
+#include <array>
+#include <concepts>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <ostream>
+#include <string_view>
 #include <type_traits>
 namespace reg
 {
 
+// ---------------------------------------------------- //
+// Wide bitmask
+// ---------------------------------------------------- //
+
+// One bit per registered component, as many 64 bit words as needed. The width
+// is picked by CompileTimeBitMask, so registering more components never
+// overflows the mask
+template <std::size_t Bits> struct BasicBitmask {
+  static_assert(Bits % 64 == 0, "Bitmasks are made of whole 64 bit words");
+  static constexpr std::size_t NumberOfWords = Bits / 64;
+  std::array<std::uint64_t, NumberOfWords> words = {};
+
+  constexpr BasicBitmask() = default;
+  // Sign extended, so Bitmask{-1} has every bit set and still means "no
+  // archetype" like it did with 32 bit masks
+  constexpr explicit BasicBitmask(std::int64_t v)
+  {
+    words[0] = static_cast<std::uint64_t>(v);
+    for (std::size_t w = 1; w < NumberOfWords; ++w)
+      words[w] = v < 0 ? ~std::uint64_t{0} : 0;
+  }
+
+  static constexpr BasicBitmask bit(std::size_t n)
+  {
+    BasicBitmask mask;
+    mask.words[n / 64] = std::uint64_t{1} << (n % 64);
+    return mask;
+  }
+  constexpr bool test(std::size_t n) const
+  {
+    return (words[n / 64] >> (n % 64)) & 1;
+  }
+  constexpr bool none() const
+  {
+    for (std::uint64_t word : words)
+      if (word != 0)
+        return false;
+    return true;
+  }
+  constexpr bool any() const { return !none(); }
+  // 32 bit slice w, the lane width used when matching many masks at once
+  constexpr std::uint32_t lane(std::size_t w) const
+  {
+    return static_cast<std::uint32_t>(words[w / 2] >> (32 * (w % 2)));
+  }
+
+  constexpr bool operator==(const BasicBitmask &) const = default;
+  constexpr auto operator<=>(const BasicBitmask &) const = default;
+
+  friend constexpr BasicBitmask &operator|=(BasicBitmask &lhs,
+                                            const BasicBitmask &rhs) noexcept
+  {
+    for (std::size_t w = 0; w < NumberOfWords; ++w)
+      lhs.words[w] |= rhs.words[w];
+    return lhs;
+  }
+  friend constexpr BasicBitmask &operator&=(BasicBitmask &lhs,
+                                            const BasicBitmask &rhs) noexcept
+  {
+    for (std::size_t w = 0; w < NumberOfWords; ++w)
+      lhs.words[w] &= rhs.words[w];
+    return lhs;
+  }
+  friend constexpr BasicBitmask &operator^=(BasicBitmask &lhs,
+                                            const BasicBitmask &rhs) noexcept
+  {
+    for (std::size_t w = 0; w < NumberOfWords; ++w)
+      lhs.words[w] ^= rhs.words[w];
+    return lhs;
+  }
+  friend constexpr BasicBitmask operator|(BasicBitmask lhs,
+                                          const BasicBitmask &rhs) noexcept
+  {
+    return lhs |= rhs;
+  }
+  friend constexpr BasicBitmask operator&(BasicBitmask lhs,
+                                          const BasicBitmask &rhs) noexcept
+  {
+    return lhs &= rhs;
+  }
+  friend constexpr BasicBitmask operator^(BasicBitmask lhs,
+                                          const BasicBitmask &rhs) noexcept
+  {
+    return lhs ^= rhs;
+  }
+  friend constexpr BasicBitmask operator~(BasicBitmask v) noexcept
+  {
+    for (std::uint64_t &w : v.words)
+      w = ~w;
+    return v;
+  }
+
+  // most significant word first, as a single hexadecimal number
+  friend std::ostream &operator<<(std::ostream &os, const BasicBitmask &v)
+  {
+    std::size_t top = NumberOfWords - 1;
+    while (top > 0 && v.words[top] == 0)
+      --top;
+    const std::ios_base::fmtflags flags = os.flags();
+    const char fill = os.fill('0');
+    os << std::hex << v.words[top];
+    for (std::size_t w = top; w-- > 0;)
+      os << std::setw(16) << v.words[w];
+    os.fill(fill);
+    os.flags(flags);
+    return os;
+  }
+};
+
+// 128 bits for up to 128 components, then whole 256 bit blocks
+template <std::size_t NumberOfComponents>
+using BitmaskFor =
+    BasicBitmask<(NumberOfComponents <= 128
+                      ? 128
+                      : (NumberOfComponents + 255) / 256 * 256)>;
+
 template <typename T>
 concept ECSComponent = requires { typename T::tag; };
 
+// ---------------------------------------------------- //
+// Layout hash
+// ---------------------------------------------------- //
+
+// A component saved by bit position, in snapshots and prefab files, declares
+//   static constexpr std::string_view layoutId = "Transform2d/1";
+// next to its tag: a name that doesn't depend on the compiler, and a revision
+// bumped whenever its fields change, even when its size doesn't. Files are
+// only read back by builds agreeing on the id of every component they hold
+template <typename T>
+concept HasLayoutId = ECSComponent<T> && requires {
+  {
+    std::remove_cvref_t<T>::layoutId
+  } -> std::convertible_to<std::string_view>;
+};
+template <typename T> constexpr std::string_view layoutIdOf()
+{
+  if constexpr (HasLayoutId<T>)
+    return std::remove_cvref_t<T>::layoutId;
+  else
+    return {};
+}
+
+// Id, size and alignment of a stored component, empty for the ones not stored
+struct ComponentLayout {
+  std::string_view id = {};
+  std::size_t size = 0;
+  std::size_t alignment = 0;
+};
+
+// FNV-1a over the layout of every registered component, in bit order. Only
+// declared ids and numbers go in, never names spelled by the compiler, so
+// every build storing the components the same way agrees on the hash
+template <std::size_t N>
+constexpr std::uint64_t
+hashLayouts(const std::array<ComponentLayout, N> &layouts)
+{
+  std::uint64_t hash = 14695981039346656037ull;
+  auto mix = [&hash](std::uint64_t value) {
+    for (int byte = 0; byte < 8; ++byte) {
+      hash ^= (value >> (8 * byte)) & 0xff;
+      hash *= 1099511628211ull;
+    }
+  };
+  mix(N);
+  for (const ComponentLayout &layout : layouts) {
+    mix(layout.id.size());
+    for (char c : layout.id)
+      mix(static_cast<unsigned char>(c));
+    mix(layout.size);
+    mix(layout.alignment);
+  }
+  return hash;
+}
+
 template <typename... Components> struct CompileTimeBitMask {
 private:
   template <typename T>
@@ -26,6 +204,8 @@ private:
 
   // ------------------------------------------------------------------
 public:
+  using Bitmask = BitmaskFor<sizeof...(Components)>;
+
   // Get the index of a component type (compile-time)
   template <ECSComponent Target>
   static constexpr Bitmask singleComponentBitmask()
@@ -37,6 +217,17 @@ public:
     return exp(getComponentIndex<typename CleanTarget::tag, Components...>());
   }
 
+  // Get the dense position of a component inside the registered list
+  // (compile-time). Archetypes use it to index their column array
+  template <ECSComponent Target> static constexpr std::size_t componentIndex()
+  {
+    using CleanTarget = identity_t<Target>;
+    static_assert(isRegistered<Target>(),
+                  "You are asking for a component but haven't registered it "
+                  "yet inside the register");
+    return getComponentIndex<typename CleanTarget::tag, Components...>();
+  }
+
   // Get combined bit mask for multiple components
   template <ECSComponent... Targets>
   static constexpr Bitmask multiComponentBitmask()
@@ -70,6 +261,19 @@ public:
     return (isRegistered<Ts>() && ...);
   }
 
+  // Fingerprint of how Targets are stored: the bit, layout id, size and
+  // alignment of each one. Data saved by bit position, like snapshots, checks
+  // it on load. The order of Targets doesn't matter
+  template <ECSComponent... Targets> static constexpr std::uint64_t layoutHash()
+  {
+    static_assert((HasLayoutId<Targets> && ...),
+                  "Components saved to a file must declare a layoutId");
+    std::array<ComponentLayout, m_comp_num> layouts = {};
+    (..., (layouts[componentIndex<Targets>()] = {
+               layoutIdOf<Targets>(), sizeof(Targets), alignof(Targets)}));
+    return hashLayouts(layouts);
+  }
+
 private:
   static constexpr std::size_t m_comp_num = sizeof...(Components);
   // Recursive helper to check if a type exists in the parameter pack
@@ -111,7 +315,7 @@ private:
     }
   }
 
-  static constexpr Bitmask exp(std::size_t n) { return Bitmask{1 << n}; }
+  static constexpr Bitmask exp(std::size_t n) { return Bitmask::bit(n); }
 };
 
 // ---------------------------------------------------- //
@@ -133,3 +337,17 @@ template <typename T>
 concept CompileTimeBitMaskType = is_compile_time_bitmask_v<T>;
 
 } // namespace reg
+
+namespace std
+{
+template <std::size_t Bits> struct hash<reg::BasicBitmask<Bits>> {
+  size_t operator()(const reg::BasicBitmask<Bits> &b) const noexcept
+  {
+    size_t seed = 0;
+    for (std::uint64_t word : b.words)
+      seed ^= std::hash<std::uint64_t>()(word) + 0x9e3779b9 + (seed << 6) +
+              (seed >> 2);
+    return seed;
+  }
+};
+} // namespace std
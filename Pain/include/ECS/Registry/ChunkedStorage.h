@@ -0,0 +1,212 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+
+#pragma once
+
+#include "Core.h"
+#include "CoreFiles/LogWrapper.h"
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Memory budget of one archetype chunk, i.e. the sum of all its columns. Can
+// be overwritten at compile time
+#ifndef PAIN_ECS_CHUNK_BYTES
+#define PAIN_ECS_CHUNK_BYTES (16 * 1024)
+#endif
+
+namespace reg
+{
+inline constexpr std::size_t ChunkBytes = PAIN_ECS_CHUNK_BYTES;
+// Every block of a column starts on a cache line, so chunk arrays can be read
+// with aligned vector loads and two columns never share a line
+inline constexpr std::size_t ChunkAlignment = 64;
+
+// Number of rows that fit inside a chunk, rounded down to a power of two so
+// rows can be located with a shift and a mask
+constexpr std::size_t rowsPerChunkFor(std::size_t rowBytes)
+{
+  const std::size_t rows = rowBytes == 0 ? ChunkBytes : ChunkBytes / rowBytes;
+  return std::bit_floor(rows == 0 ? std::size_t{1} : rows);
+}
+
+// ---------------------------------------------------- //
+// Chunked column
+// ---------------------------------------------------- //
+
+// Storage of a single component type inside an archetype. Rows live in fixed
+// capacity blocks, growing the column only allocates a new block, so existing
+// rows are never copied by a push. Removals fill the hole with the last row,
+// so addresses stay valid only until the next removal. Every column of an
+// archetype uses the same rows per chunk, so the block k of each column holds
+// the same entities.
+template <typename C> class ChunkedStorage
+{
+public:
+  explicit ChunkedStorage(std::size_t rowsPerChunk)
+      : m_shift(static_cast<unsigned>(std::countr_zero(rowsPerChunk))),
+        m_mask(rowsPerChunk - 1)
+  {
+    P_ASSERT(std::has_single_bit(rowsPerChunk),
+             "Rows per chunk must be a power of two, got {}", rowsPerChunk);
+  }
+  ~ChunkedStorage()
+  {
+    clear();
+    for (C *chunk : m_chunks)
+      deallocateBlock(chunk);
+  }
+  NONCOPYABLE(ChunkedStorage);
+  NONMOVABLE(ChunkedStorage);
+
+  // ---------------------------------------------------- //
+  // size
+  // ---------------------------------------------------- //
+  std::size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+  std::size_t rowsPerChunk() const { return m_mask + 1; }
+  std::size_t chunkCount() const { return (m_size + m_mask) >> m_shift; }
+  // allocated blocks, can be bigger than chunkCount() after removals
+  std::size_t allocatedChunks() const { return m_chunks.size(); }
+
+  // ---------------------------------------------------- //
+  // access
+  // ---------------------------------------------------- //
+  C &operator[](std::size_t row)
+  {
+    return m_chunks[row >> m_shift][row & m_mask];
+  }
+  const C &operator[](std::size_t row) const
+  {
+    return m_chunks[row >> m_shift][row & m_mask];
+  }
+  C &back() { return (*this)[m_size - 1]; }
+  C *chunkData(std::size_t chunk) { return m_chunks[chunk]; }
+  const C *chunkData(std::size_t chunk) const { return m_chunks[chunk]; }
+
+  // ---------------------------------------------------- //
+  // modify
+  // ---------------------------------------------------- //
+  template <typename... Args> C &emplace_back(Args &&...args)
+  {
+    if ((m_size >> m_shift) == m_chunks.size())
+      m_chunks.push_back(allocateBlock());
+    C *slot = &(*this)[m_size];
+    std::construct_at(slot, std::forward<Args>(args)...);
+    ++m_size;
+    return *slot;
+  }
+
+  // Allocate the blocks needed to hold rows elements without constructing any
+  void reserve(std::size_t rows)
+  {
+    const std::size_t chunks = (rows + m_mask) >> m_shift;
+    m_chunks.reserve(chunks);
+    while (m_chunks.size() < chunks)
+      m_chunks.push_back(allocateBlock());
+  }
+
+  // Append n elements, the i-th one constructed from value(i). Rows are
+  // written block by block, so each block is filled with a plain loop
+  template <typename ValueFn> void append(std::size_t n, ValueFn &&value)
+  {
+    reserve(m_size + n);
+    std::size_t i = 0;
+    while (i < n) {
+      C *block = m_chunks[m_size >> m_shift];
+      const std::size_t offset = m_size & m_mask;
+      const std::size_t rows = std::min(n - i, rowsPerChunk() - offset);
+      for (std::size_t k = 0; k < rows; ++k)
+        std::construct_at(block + offset + k, value(i + k));
+      m_size += rows;
+      i += rows;
+    }
+  }
+
+  // Append n rows copied byte for byte from data, one memcpy per block. data
+  // needs no alignment, e.g. rows of a mapped snapshot file
+  void appendBytes(const std::byte *data, std::size_t n)
+  {
+    static_assert(std::is_trivially_copyable_v<C>,
+                  "Only trivially copyable components can be copied as bytes");
+    reserve(m_size + n);
+    while (n > 0) {
+      C *block = m_chunks[m_size >> m_shift];
+      const std::size_t offset = m_size & m_mask;
+      const std::size_t rows = std::min(n, rowsPerChunk() - offset);
+      std::memcpy(static_cast<void *>(block + offset), data, rows * sizeof(C));
+      data += rows * sizeof(C);
+      m_size += rows;
+      n -= rows;
+    }
+  }
+
+  void pop_back()
+  {
+    P_ASSERT(m_size > 0, "pop_back called on an empty column");
+    std::destroy_at(&back());
+    --m_size;
+  }
+
+  // Fill the hole at row with the last element, keeping the column dense
+  void swapRemove(std::size_t row)
+  {
+    const std::size_t last = m_size - 1;
+    if (row != last)
+      (*this)[row] = std::move((*this)[last]);
+    pop_back();
+  }
+
+  void clear()
+  {
+    while (m_size > 0)
+      pop_back();
+  }
+
+  // Free the blocks past the rows in use, keeping spareChunks of them for the
+  // rows to come. Returns the bytes freed
+  std::size_t shrink(std::size_t spareChunks)
+  {
+    const std::size_t keep = chunkCount() + spareChunks;
+    if (m_chunks.size() <= keep)
+      return 0;
+    const std::size_t freed = m_chunks.size() - keep;
+    for (std::size_t chunk = keep; chunk < m_chunks.size(); ++chunk)
+      deallocateBlock(m_chunks[chunk]);
+    m_chunks.resize(keep);
+    m_chunks.shrink_to_fit();
+    return freed * rowsPerChunk() * sizeof(C);
+  }
+
+private:
+  static constexpr std::align_val_t BlockAlignment{
+      std::max(ChunkAlignment, alignof(C))};
+
+  std::vector<C *> m_chunks = {};
+  std::size_t m_size = 0;
+  unsigned m_shift;
+  std::size_t m_mask;
+
+  // uninitialized room for a block of rows
+  C *allocateBlock() const
+  {
+    return static_cast<C *>(
+        ::operator new(rowsPerChunk() * sizeof(C), BlockAlignment));
+  }
+  static void deallocateBlock(C *block)
+  {
+    ::operator delete(block, BlockAlignment);
+  }
+};
+
+} // namespace reg
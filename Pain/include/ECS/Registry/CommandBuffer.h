@@ -0,0 +1,206 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+
+#pragma once
+
+#include "ECS/Registry/ArcheRegistry.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <tuple>
+#include <typeindex>
+#include <vector>
+
+namespace reg
+{
+
+template <CompileTimeBitMaskType ComponentManagerT> class CommandQueue;
+
+// ---------------------------------------------------- //
+// Deferred structural changes
+// ---------------------------------------------------- //
+
+// Records structural changes while chunks are being iterated, to apply them
+// later with playback(). Recording never touches the registry, so ChunkViews
+// stay valid. A buffer must only be used by one thread at a time, see
+// CommandQueue for one buffer per thread.
+//
+// Playback order: add/removeComponents in recording order, then removals, then
+// spawns. Spawns of the same component list are appended as one batch
+template <CompileTimeBitMaskType ComponentManagerT> class CommandBuffer
+{
+  using Registry = ArcheRegistry<ComponentManagerT>;
+  friend class CommandQueue<ComponentManagerT>;
+
+public:
+  CommandBuffer() = default;
+  NONCOPYABLE(CommandBuffer);
+
+  // Create an entity with these components during playback
+  template <ECSComponent... Components> void spawn(Components &&...comps)
+  {
+    SpawnBatch<std::decay_t<Components>...> &batch =
+        spawnBatch<std::decay_t<Components>...>();
+    (..., std::get<std::vector<std::decay_t<Components>>>(batch.columns)
+              .emplace_back(std::forward<Components>(comps)));
+  }
+
+  // Remove an entity during playback. Entities that are already gone by then
+  // are skipped, so removing one twice is fine
+  void remove(Entity entity) { m_removals.push_back(entity); }
+
+  // Add components to an existing entity during playback
+  template <ECSComponent... Components>
+  void addComponents(Entity entity, Components &&...comps)
+  {
+    auto fn = [entity, ... comps = std::forward<Components>(comps)](
+                  Registry &registry) mutable {
+      registry.template addComponents<Components...>(entity,
+                                                     std::move(comps)...);
+    };
+    m_deferred.push_back(
+        std::make_unique<Deferred<decltype(fn)>>(std::move(fn)));
+  }
+
+  // Remove components from an existing entity during playback
+  template <ECSComponent... Components> void removeComponents(Entity entity)
+  {
+    auto fn = [entity](Registry &registry) {
+      registry.template removeComponents<Components...>(entity);
+    };
+    m_deferred.push_back(
+        std::make_unique<Deferred<decltype(fn)>>(std::move(fn)));
+  }
+
+  bool empty() const
+  {
+    return m_deferred.empty() && m_removals.empty() &&
+           std::all_of(m_spawns.begin(), m_spawns.end(),
+                       [](const auto &it) { return it.second->empty(); });
+  }
+
+  // Apply every recorded command. Must run on the thread owning the registry
+  // while no chunk is being iterated
+  void playback(Registry &registry)
+  {
+    playbackDeferred(registry);
+    playbackRemovals(registry);
+    playbackSpawns(registry);
+  }
+
+private:
+  struct Command {
+    virtual ~Command() = default;
+    virtual void apply(Registry &registry) = 0;
+  };
+  template <typename Fn> struct Deferred : Command {
+    explicit Deferred(Fn &&f) : fn(std::move(f)) {}
+    Fn fn;
+    void apply(Registry &registry) override { fn(registry); }
+  };
+
+  struct SpawnBatchBase {
+    virtual ~SpawnBatchBase() = default;
+    virtual bool empty() const = 0;
+    virtual void apply(Registry &registry) = 0;
+  };
+  // Columns are cleared, not freed, so their capacity is reused next frame
+  template <typename... Components> struct SpawnBatch : SpawnBatchBase {
+    std::tuple<std::vector<Components>...> columns;
+    bool empty() const override { return std::get<0>(columns).empty(); }
+    void apply(Registry &registry) override
+    {
+      std::apply(
+          [&registry](std::vector<Components> &...column) {
+            registry.template createEntities<Components...>(
+                std::span<Components>(column)...);
+            (..., column.clear());
+          },
+          columns);
+    }
+  };
+
+  // keyed by component list, components are only appended to the batch
+  // holding the same list in the same order
+  std::map<std::type_index, std::unique_ptr<SpawnBatchBase>> m_spawns;
+  std::vector<Entity> m_removals;
+  std::vector<std::unique_ptr<Command>> m_deferred;
+
+  template <typename... Components>
+  SpawnBatch<Components...> &spawnBatch()
+  {
+    std::unique_ptr<SpawnBatchBase> &batch =
+        m_spawns[std::type_index(typeid(SpawnBatch<Components...>))];
+    if (!batch)
+      batch = std::make_unique<SpawnBatch<Components...>>();
+    return static_cast<SpawnBatch<Components...> &>(*batch);
+  }
+
+  void playbackDeferred(Registry &registry)
+  {
+    for (std::unique_ptr<Command> &command : m_deferred)
+      command->apply(registry);
+    m_deferred.clear();
+  }
+  void playbackRemovals(Registry &registry)
+  {
+    for (Entity entity : m_removals)
+      if (registry.isAlive(entity))
+        registry.remove(entity);
+    m_removals.clear();
+  }
+  void playbackSpawns(Registry &registry)
+  {
+    for (auto &[type, batch] : m_spawns)
+      if (!batch->empty())
+        batch->apply(registry);
+  }
+};
+
+// One CommandBuffer per recording thread, so threads never share a buffer.
+// local() takes a lock, fetch the buffer once per job rather than once per
+// entity
+template <CompileTimeBitMaskType ComponentManagerT> class CommandQueue
+{
+  using Registry = ArcheRegistry<ComponentManagerT>;
+
+public:
+  CommandBuffer<ComponentManagerT> &local()
+  {
+    std::lock_guard lock(m_mutex);
+    std::unique_ptr<CommandBuffer<ComponentManagerT>> &buffer =
+        m_buffers[std::this_thread::get_id()];
+    if (!buffer)
+      buffer = std::make_unique<CommandBuffer<ComponentManagerT>>();
+    return *buffer;
+  }
+
+  // Apply the buffers of every thread, one kind of command at a time so the
+  // order of CommandBuffer::playback holds across threads
+  void playback(Registry &registry)
+  {
+    std::lock_guard lock(m_mutex);
+    for (auto &[thread, buffer] : m_buffers)
+      buffer->playbackDeferred(registry);
+    for (auto &[thread, buffer] : m_buffers)
+      buffer->playbackRemovals(registry);
+    for (auto &[thread, buffer] : m_buffers)
+      buffer->playbackSpawns(registry);
+  }
+
+private:
+  std::mutex m_mutex;
+  std::map<std::thread::id,
+           std::unique_ptr<CommandBuffer<ComponentManagerT>>>
+      m_buffers;
+};
+
+} // namespace reg
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "spdlog/fmt/bundled/base.h"
+#include <cstddef>
 #include <cstdint>
 #include <ostream>
 
@@ -29,37 +30,55 @@ template <typename T, typename Tag> struct StrongType {
 };
 namespace reg
 {
-struct BitmaskTag {
-};
 struct EntityTag {
 };
 struct ColumnTag {
 };
 
-using Bitmask = StrongType<std::int32_t, BitmaskTag>;
 using Entity = StrongType<std::int32_t, EntityTag>;
 using Column = StrongType<std::int32_t, ColumnTag>;
-struct Record {
-  Bitmask bitmask;
+// Monotonic counter of the registry, stamped on chunks when they are written
+using ChangeTick = std::uint64_t;
+// Where the components of an entity live. BitmaskT is the mask type of the
+// registry, see CompileTimeBitMask::Bitmask
+template <typename BitmaskT> struct Record {
+  BitmaskT bitmask;
   Column column;
+  // generation of the entity currently owning this record
+  std::int32_t generation = 0;
 };
+
 // ---------------------------------------------------- //
-// Bitmask operations on "Bitmask"
-// clang-format off
+// Generational entity handles
 // ---------------------------------------------------- //
 
-constexpr Bitmask operator|(Bitmask lhs, Bitmask rhs) noexcept { return Bitmask(lhs.value | rhs.value); }
-constexpr Bitmask operator&(Bitmask lhs, Bitmask rhs) noexcept { return Bitmask(lhs.value & rhs.value); }
-constexpr Bitmask operator^(Bitmask lhs, Bitmask rhs) noexcept { return Bitmask(lhs.value ^ rhs.value); }
-constexpr Bitmask operator~(Bitmask v) noexcept { return Bitmask(~v.value); }
-constexpr Bitmask &operator|=(Bitmask &lhs, Bitmask rhs) noexcept { lhs.value |= rhs.value; return lhs; }
-constexpr Bitmask &operator&=(Bitmask &lhs, Bitmask rhs) noexcept { lhs.value &= rhs.value; return lhs; }
-constexpr Bitmask &operator^=(Bitmask &lhs, Bitmask rhs) noexcept { lhs.value ^= rhs.value; return lhs; }
-
+// An Entity packs the index of its record with a generation, bumped every
+// time the index is recycled. Handles kept after a removal then no longer
+// match their record, instead of silently aliasing the new owner. Both parts
+// fit in the positive range, so Entity{-1} is still the null entity. A
+// registry holds at most 2^22 (about 4.19M) entities at once, creating more
+// terminates
+inline constexpr int EntityIndexBits = 22;
+inline constexpr std::int32_t EntityIndexMask = (1 << EntityIndexBits) - 1;
+// generations wrap around after this value
+inline constexpr std::int32_t MaxEntityGeneration =
+    (1 << (31 - EntityIndexBits)) - 1;
+
+constexpr std::size_t entityIndex(Entity entity)
+{
+  return static_cast<std::size_t>(entity.value & EntityIndexMask);
+}
+constexpr std::int32_t entityGeneration(Entity entity)
+{
+  return (entity.value >> EntityIndexBits) & MaxEntityGeneration;
+}
+constexpr Entity makeEntity(std::size_t index, std::int32_t generation)
+{
+  return Entity{(generation << EntityIndexBits) |
+                static_cast<std::int32_t>(index)};
+}
 } // namespace reg
 
-// clang-format on
-
 // For spdlog
 template <> struct fmt::formatter<reg::Entity> : fmt::formatter<int32_t> {
   auto format(const reg::Entity &e, fmt::format_context &ctx) const
@@ -71,13 +90,6 @@ template <> struct fmt::formatter<reg::Entity> : fmt::formatter<int32_t> {
 // For remove batch function
 namespace std
 {
-template <> struct hash<reg::Bitmask> {
-  size_t operator()(const reg::Bitmask &b) const noexcept
-  {
-    return std::hash<std::int32_t>()(b.value);
-  }
-};
-
 template <> struct hash<reg::Column> {
   size_t operator()(const reg::Column &c) const noexcept
   {
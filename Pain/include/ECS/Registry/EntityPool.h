@@ -0,0 +1,119 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+
+#pragma once
+
+#include "CoreFiles/LogWrapper.h"
+#include "ECS/Registry/ArcheRegistry.h"
+#include "ECS/Registry/Bitmask.h"
+#include "ECS/Registry/Entity.h"
+#include "ECS/Registry/Prefab.h"
+
+#include <algorithm>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace reg
+{
+
+// ---------------------------------------------------- //
+// Entity pool
+// ---------------------------------------------------- //
+
+// Recycles the entities of a prefab, for things spawned and despawned many
+// times per second like projectiles. Releasing an entity only disables its
+// row, acquiring one resets that row to the prefab values and enables it
+// again, so neither moves a row nor touches the free list of the registry.
+// A released handle stays alive while it is parked: whoever kept it sees the
+// next instance. Entities that left the prefab archetype in the meantime are
+// removed on release instead of parked. Sparse components aren't reset
+template <CompileTimeBitMaskType ComponentManagerT> class EntityPool
+{
+public:
+  using Registry = ArcheRegistry<ComponentManagerT>;
+
+  explicit EntityPool(Prefab<ComponentManagerT> prefab)
+      : m_prefab(std::move(prefab))
+  {
+    P_ASSERT(!m_prefab.empty(), "Pools need a prefab with components");
+  }
+
+  const Prefab<ComponentManagerT> &prefab() const { return m_prefab; }
+  // entities waiting in the registry to be acquired again
+  std::size_t parked() const { return m_parked.size(); }
+
+  // An entity of the prefab, the last parked one if there is any
+  Entity acquire(Registry &registry)
+  {
+    if (m_parked.empty())
+      return registry.instantiate(m_prefab, 1).front();
+    const Entity entity = m_parked.back();
+    m_parked.pop_back();
+    registry.respawn(std::span<const Entity>(&entity, 1), m_prefab);
+    return entity;
+  }
+  // count entities of the prefab, parked ones first and the rest
+  // instantiated in one batch
+  std::vector<Entity> acquire(Registry &registry, std::size_t count)
+  {
+    const std::size_t reused = std::min(count, m_parked.size());
+    std::vector<Entity> entities(m_parked.end() - reused, m_parked.end());
+    m_parked.resize(m_parked.size() - reused);
+    registry.respawn(entities, m_prefab);
+    if (reused < count) {
+      std::vector<Entity> created =
+          registry.instantiate(m_prefab, count - reused);
+      entities.insert(entities.end(), created.begin(), created.end());
+    }
+    return entities;
+  }
+
+  // Park entities acquired from this pool until they are acquired again
+  void release(Registry &registry, std::span<const Entity> entities)
+  {
+    for (Entity entity : entities) {
+      P_ASSERT(registry.isEnabled(entity), "Entity {} was released twice",
+               entity);
+      if (registry.isInstanceOf(entity, m_prefab)) {
+        registry.setEnabled(entity, false);
+        m_parked.push_back(entity);
+      } else {
+        registry.remove(entity);
+      }
+    }
+  }
+  void release(Registry &registry, Entity entity)
+  {
+    release(registry, std::span<const Entity>(&entity, 1));
+  }
+
+  // Instantiate count parked entities ahead of time, e.g. while loading, so
+  // the first spawns don't create any row
+  void reserve(Registry &registry, std::size_t count)
+  {
+    if (count <= m_parked.size())
+      return;
+    std::vector<Entity> created =
+        registry.instantiate(m_prefab, count - m_parked.size());
+    registry.setEnabled(created, false);
+    m_parked.insert(m_parked.end(), created.begin(), created.end());
+  }
+  // Remove the parked entities from the registry
+  void clear(Registry &registry)
+  {
+    registry.removeBatch(m_parked);
+    m_parked.clear();
+  }
+
+private:
+  Prefab<ComponentManagerT> m_prefab;
+  // the most recently released is acquired first, its row is still warm
+  std::vector<Entity> m_parked = {};
+};
+
+} // namespace reg
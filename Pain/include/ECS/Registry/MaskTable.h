@@ -0,0 +1,133 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PAIN_MASK_TABLE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace reg
+{
+
+// ---------------------------------------------------- //
+// Archetype masks, laid out for matching
+// ---------------------------------------------------- //
+
+// The masks of every archetype, stored lane by lane (32 bits of every mask,
+// then the next 32 bits...) instead of mask by mask. A query then tests 4
+// archetypes per SSE2 instruction, and only over the lanes its own masks use,
+// so the cost doesn't grow with the width of the bitmask
+template <typename BitmaskT> class MaskTable
+{
+  static constexpr std::size_t NumberOfLanes = BitmaskT::NumberOfWords * 2;
+  static constexpr std::size_t Block = 4;
+
+public:
+  // Masks are only appended, their index is their insertion order
+  void push_back(const BitmaskT &mask)
+  {
+    if (m_size % Block == 0)
+      for (std::vector<std::uint32_t> &lane : m_lanes)
+        lane.resize(m_size + Block, 0);
+    for (std::size_t l = 0; l < NumberOfLanes; ++l)
+      m_lanes[l][m_size] = mask.lane(l);
+    ++m_size;
+  }
+  std::size_t size() const { return m_size; }
+  // Drop the masks whose index makes drop(index) true, the others keep their
+  // order and are renumbered from 0
+  template <typename Pred> void removeIf(Pred &&drop)
+  {
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < m_size; ++i) {
+      if (drop(i))
+        continue;
+      for (std::vector<std::uint32_t> &lane : m_lanes)
+        lane[kept] = lane[i];
+      ++kept;
+    }
+    m_size = kept;
+    const std::size_t padded = (m_size + Block - 1) / Block * Block;
+    for (std::vector<std::uint32_t> &lane : m_lanes) {
+      lane.resize(padded);
+      std::fill(lane.begin() + static_cast<std::ptrdiff_t>(m_size), lane.end(),
+                0);
+      lane.shrink_to_fit();
+    }
+  }
+
+  // Call fn(index) for every mask that has all the bits of include and none
+  // of exclude, in insertion order
+  template <typename Fn>
+  void forEachMatch(const BitmaskT &include, const BitmaskT &exclude,
+                    Fn &&fn) const
+  {
+    // lanes where both masks are empty match everything, skip them
+    std::array<std::size_t, NumberOfLanes> used;
+    std::size_t usedCount = 0;
+    for (std::size_t l = 0; l < NumberOfLanes; ++l)
+      if ((include.lane(l) | exclude.lane(l)) != 0)
+        used[usedCount++] = l;
+
+    for (std::size_t base = 0; base < m_size; base += Block) {
+      unsigned matches = matchBlock(base, include, exclude, used, usedCount);
+      for (std::size_t i = 0; matches != 0; ++i, matches >>= 1)
+        if ((matches & 1) && base + i < m_size)
+          fn(base + i);
+    }
+  }
+
+private:
+  std::array<std::vector<std::uint32_t>, NumberOfLanes> m_lanes = {};
+  std::size_t m_size = 0;
+
+  // One bit per mask of the block starting at base
+  unsigned matchBlock(std::size_t base, const BitmaskT &include,
+                      const BitmaskT &exclude,
+                      const std::array<std::size_t, NumberOfLanes> &used,
+                      std::size_t usedCount) const
+  {
+#ifdef PAIN_MASK_TABLE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    __m128i ok = _mm_set1_epi32(-1);
+    for (std::size_t u = 0; u < usedCount; ++u) {
+      const std::size_t l = used[u];
+      const __m128i masks = _mm_loadu_si128(
+          reinterpret_cast<const __m128i *>(m_lanes[l].data() + base));
+      const __m128i in = _mm_set1_epi32(static_cast<int>(include.lane(l)));
+      const __m128i ex = _mm_set1_epi32(static_cast<int>(exclude.lane(l)));
+      ok = _mm_and_si128(ok, _mm_cmpeq_epi32(_mm_and_si128(masks, in), in));
+      ok = _mm_and_si128(ok, _mm_cmpeq_epi32(_mm_and_si128(masks, ex), zero));
+    }
+    return static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(ok)));
+#else
+    unsigned matches = 0;
+    for (std::size_t i = 0; i < Block; ++i) {
+      bool ok = true;
+      for (std::size_t u = 0; u < usedCount && ok; ++u) {
+        const std::size_t l = used[u];
+        const std::uint32_t mask = m_lanes[l][base + i];
+        ok = (mask & include.lane(l)) == include.lane(l) &&
+             (mask & exclude.lane(l)) == 0;
+      }
+      matches |= static_cast<unsigned>(ok) << i;
+    }
+    return matches;
+#endif
+  }
+};
+
+} // namespace reg
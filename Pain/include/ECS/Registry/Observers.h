@@ -0,0 +1,212 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+
+#pragma once
+
+#include "CoreFiles/LogWrapper.h"
+#include "ECS/Registry/Entity.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace reg
+{
+
+// ---------------------------------------------------- //
+// Component events
+// ---------------------------------------------------- //
+
+using ObserverId = std::size_t;
+
+// What happened to the component of the entities handed to an observer
+enum class ComponentEvent : std::uint8_t { Added, Removed, Changed };
+
+// Called once per delivery with every entity the event happened to since the
+// previous one
+using ObserverFn = std::function<void(std::span<const Entity>)>;
+
+// ---------------------------------------------------- //
+// Observer table
+// ---------------------------------------------------- //
+
+// Subscriptions to the events of each component, along with the entities
+// waiting to be handed to them. The registry only records an entity for the
+// components someone observes, so structural changes cost a mask test while
+// nobody does. deliver() hands out removals first, then additions, then
+// changes: an entity that gained and lost a component since the previous
+// delivery is in both lists, handlers check its current state
+template <typename BitmaskT, std::size_t NumberOfComponents>
+class ObserverTable
+{
+public:
+  // Fill entities with the ones whose component was written after since.
+  // Type erased like the sparse sets, the table doesn't know the registry
+  using CollectChangedFn = void (*)(const void *registry, ChangeTick since,
+                                    std::vector<Entity> &entities);
+
+  bool empty() const { return m_observers.empty(); }
+
+  // collect and since are only used by Changed observers
+  ObserverId add(std::size_t component, ComponentEvent event, ObserverFn fn,
+                 CollectChangedFn collect = nullptr, ChangeTick since = 0)
+  {
+    P_ASSERT(!m_delivering, "Observers can't subscribe during a delivery");
+    const ObserverId id = m_nextId++;
+    m_observers.push_back(
+        {id, component, event, std::move(fn), collect, since});
+    if (event == ComponentEvent::Added)
+      m_watchAdded |= BitmaskT::bit(component);
+    else if (event == ComponentEvent::Removed)
+      m_watchRemoved |= BitmaskT::bit(component);
+    return id;
+  }
+  void erase(ObserverId id)
+  {
+    P_ASSERT(!m_delivering, "Observers can't unsubscribe during a delivery");
+    std::erase_if(m_observers, [id](const Observer &observer) {
+      return observer.id == id;
+    });
+    m_watchAdded = {};
+    m_watchRemoved = {};
+    for (const Observer &observer : m_observers)
+      if (observer.event == ComponentEvent::Added)
+        m_watchAdded |= BitmaskT::bit(observer.component);
+      else if (observer.event == ComponentEvent::Removed)
+        m_watchRemoved |= BitmaskT::bit(observer.component);
+    // events nobody observes anymore are dropped
+    dropUnwatched(m_added, m_pendingAdded, m_watchAdded);
+    dropUnwatched(m_removed, m_pendingRemoved, m_watchRemoved);
+  }
+
+  // ---------------------------------------------------- //
+  // record, called by the registry
+  // ---------------------------------------------------- //
+
+  // entities gained the components of mask
+  void recordAdded(std::span<const Entity> entities, BitmaskT mask)
+  {
+    record(m_added, m_pendingAdded, mask & m_watchAdded, entities);
+  }
+  void recordAdded(Entity entity, BitmaskT mask)
+  {
+    recordAdded(std::span<const Entity>(&entity, 1), mask);
+  }
+  // entity lost the components of mask
+  void recordRemoved(Entity entity, BitmaskT mask)
+  {
+    record(m_removed, m_pendingRemoved, mask & m_watchRemoved,
+           std::span<const Entity>(&entity, 1));
+  }
+
+  // ---------------------------------------------------- //
+  // deliver
+  // ---------------------------------------------------- //
+
+  // Hand every pending event to its observers. Changed observers are told
+  // about the writes stamped after their previous delivery, up to tick
+  // included. Structural changes made by the handlers are kept for the next
+  // delivery, they can't subscribe or unsubscribe though
+  void deliver(const void *registry, ChangeTick tick)
+  {
+    P_ASSERT(!m_delivering, "Observers were delivered from a handler");
+    m_delivering = true;
+    takePending(m_removed, m_pendingRemoved, m_removedBatch);
+    takePending(m_added, m_pendingAdded, m_addedBatch);
+    for (Observer &observer : m_observers)
+      if (observer.event == ComponentEvent::Removed)
+        notify(observer, m_removedBatch[observer.component]);
+    for (Observer &observer : m_observers)
+      if (observer.event == ComponentEvent::Added)
+        notify(observer, m_addedBatch[observer.component]);
+    for (Observer &observer : m_observers) {
+      if (observer.event != ComponentEvent::Changed)
+        continue;
+      m_changed.clear();
+      observer.collectChanged(registry, observer.since, m_changed);
+      observer.since = tick;
+      notify(observer, m_changed);
+    }
+    for (std::vector<Entity> &batch : m_removedBatch)
+      batch.clear();
+    for (std::vector<Entity> &batch : m_addedBatch)
+      batch.clear();
+    m_delivering = false;
+  }
+
+private:
+  using EntityLists = std::array<std::vector<Entity>, NumberOfComponents>;
+  struct Observer {
+    ObserverId id = 0;
+    std::size_t component = 0;
+    ComponentEvent event = ComponentEvent::Added;
+    ObserverFn fn = {};
+    CollectChangedFn collectChanged = nullptr;
+    // last tick delivered to a Changed observer
+    ChangeTick since = 0;
+  };
+
+  std::vector<Observer> m_observers = {};
+  ObserverId m_nextId = 0;
+  // components with at least one observer of the event
+  BitmaskT m_watchAdded = {};
+  BitmaskT m_watchRemoved = {};
+  // recorded since the last delivery, per component. The masks tell which
+  // lists aren't empty, so a delivery only visits those
+  EntityLists m_added = {};
+  EntityLists m_removed = {};
+  BitmaskT m_pendingAdded = {};
+  BitmaskT m_pendingRemoved = {};
+  // lists being delivered, swapped with the pending ones so both keep their
+  // capacity from one delivery to the next
+  EntityLists m_addedBatch = {};
+  EntityLists m_removedBatch = {};
+  std::vector<Entity> m_changed = {};
+  bool m_delivering = false;
+
+  template <typename Fn> static void forEachBit(BitmaskT mask, Fn &&fn)
+  {
+    for (std::size_t w = 0; w < mask.words.size(); ++w)
+      for (std::uint64_t word = mask.words[w]; word != 0; word &= word - 1)
+        fn(w * 64 + static_cast<std::size_t>(std::countr_zero(word)));
+  }
+  static void record(EntityLists &lists, BitmaskT &pending, BitmaskT watched,
+                     std::span<const Entity> entities)
+  {
+    if (watched.none())
+      return;
+    pending |= watched;
+    forEachBit(watched, [&](std::size_t c) {
+      lists[c].insert(lists[c].end(), entities.begin(), entities.end());
+    });
+  }
+  static void takePending(EntityLists &lists, BitmaskT &pending,
+                          EntityLists &batch)
+  {
+    forEachBit(pending, [&](std::size_t c) { std::swap(lists[c], batch[c]); });
+    pending = {};
+  }
+  static void dropUnwatched(EntityLists &lists, BitmaskT &pending,
+                            BitmaskT watched)
+  {
+    forEachBit(pending & ~watched, [&](std::size_t c) { lists[c].clear(); });
+    pending &= watched;
+  }
+  static void notify(Observer &observer, const std::vector<Entity> &entities)
+  {
+    if (!entities.empty())
+      observer.fn(entities);
+  }
+};
+
+} // namespace reg
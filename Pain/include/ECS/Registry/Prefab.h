@@ -0,0 +1,333 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+
+#pragma once
+
+#include "Core.h"
+#include "CoreFiles/LogWrapper.h"
+#include "ECS/Registry/Archetype.h"
+#include "ECS/Registry/Bitmask.h"
+#include "ECS/Registry/Snapshot.h"
+#include "ECS/Registry/SparseSet.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <optional>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+namespace reg
+{
+
+// ---------------------------------------------------- //
+// Binary layout
+// ---------------------------------------------------- //
+
+// A prefab file is its header, then for each field a SnapshotColumn followed
+// by the bytes of its value, every block aligned like in a snapshot. Like
+// snapshots, a prefab is read back by builds with the same component layout
+inline constexpr std::array<char, 8> PrefabMagic = {'P', 'A', 'I', 'N',
+                                                    'P', 'F', 'B', '\0'};
+inline constexpr std::uint32_t PrefabVersion = 1;
+
+struct PrefabHeader {
+  std::array<char, 8> magic = PrefabMagic;
+  std::uint32_t version = PrefabVersion;
+  // number of registered components and CompileTimeBitMask::layoutHash() of
+  // the fields
+  std::uint32_t components = 0;
+  std::uint64_t layout = 0;
+  std::uint64_t fields = 0;
+};
+
+// ---------------------------------------------------- //
+// Prefab
+// ---------------------------------------------------- //
+
+// Template of an entity: the archetype it lands in and one packed row holding
+// the default value of each of its components. ArcheRegistry::instantiate
+// copies that row into the columns of the archetype a column at a time, so
+// building N entities costs one archetype lookup and no per component
+// dispatch. Only archetype components are part of a prefab, not sparse ones
+template <CompileTimeBitMaskType ComponentManagerT> class Prefab
+{
+public:
+  using Bitmask = typename ComponentManagerT::Bitmask;
+  using ColumnOps = typename Archetype<ComponentManagerT>::ColumnOps;
+  static constexpr std::size_t NumberOfColumns =
+      Archetype<ComponentManagerT>::NumberOfColumns;
+  // A component of the row, offset bytes from its start
+  struct Field {
+    std::size_t component = 0;
+    std::size_t offset = 0;
+    const ColumnOps *ops = nullptr;
+  };
+
+  Prefab() = default;
+  ~Prefab() { reset(); }
+  Prefab(const Prefab &other)
+      : Prefab(assemble(other.m_fields,
+                        [&other](const Field &field, void *slot) {
+                          field.ops->copyValue(other.value(field), slot);
+                        }))
+  {
+  }
+  Prefab &operator=(const Prefab &other)
+  {
+    Prefab copy(other);
+    swap(copy);
+    return *this;
+  }
+  Prefab(Prefab &&other) noexcept { swap(other); }
+  Prefab &operator=(Prefab &&other) noexcept
+  {
+    swap(other);
+    return *this;
+  }
+
+  // A prefab of the given default values
+  template <ECSComponent... Components>
+  static Prefab of(const Components &...defaults)
+  {
+    static_assert(!(SparseComponent<Components> || ...),
+                  "Sparse components can't be part of a prefab");
+    static_assert((std::is_copy_constructible_v<Components> && ...),
+                  "Prefab components must be copyable");
+    return assemble(
+        {Field{ComponentManagerT::template componentIndex<Components>(), 0,
+               &Archetype<ComponentManagerT>::template columnOpsOf<
+                   Components>}...},
+        [&defaults...](const Field &field, void *slot) {
+          (..., constructField(field, slot, defaults));
+        });
+  }
+  // Lay the fields out in one row, in the given order, then copy construct
+  // each value with construct(field, slot). Their offsets are set here
+  template <typename ConstructFn>
+  static Prefab assemble(std::vector<Field> fields, ConstructFn &&construct)
+  {
+    Prefab prefab;
+    std::size_t bytes = 0;
+    for (Field &field : fields) {
+      P_ASSERT(!prefab.m_mask.test(field.component),
+               "Component {} appears twice in the prefab", field.component);
+      P_ASSERT(field.ops->copyValue != nullptr,
+               "Component {} can't be copied into a prefab", field.component);
+      prefab.m_mask |= Bitmask::bit(field.component);
+      prefab.m_alignment = std::max(prefab.m_alignment, field.ops->alignment);
+      bytes = (bytes + field.ops->alignment - 1) / field.ops->alignment *
+              field.ops->alignment;
+      field.offset = bytes;
+      bytes += field.ops->rowBytes;
+    }
+    prefab.m_row = static_cast<std::byte *>(::operator new(
+        std::max(bytes, std::size_t{1}), std::align_val_t{prefab.m_alignment}));
+    prefab.m_fields.reserve(fields.size());
+    // a field is only destroyed once it was constructed
+    for (const Field &field : fields) {
+      construct(field, static_cast<void *>(prefab.m_row + field.offset));
+      prefab.m_fields.push_back(field);
+    }
+    return prefab;
+  }
+
+  // ---------------------------------------------------- //
+  // access
+  // ---------------------------------------------------- //
+
+  bool empty() const { return m_fields.empty(); }
+  Bitmask mask() const { return m_mask; }
+  std::span<const Field> fields() const { return m_fields; }
+  const void *value(const Field &field) const { return m_row + field.offset; }
+  // Bytes of a row of the archetype, without padding between the fields
+  std::size_t rowBytes() const
+  {
+    std::size_t bytes = 0;
+    for (const Field &field : m_fields)
+      bytes += field.ops->rowBytes;
+    return bytes;
+  }
+
+  // The default value of C, which the prefab must hold. Changing it only
+  // affects the entities instantiated afterwards
+  template <ECSComponent C> C &get()
+  {
+    return *static_cast<C *>(const_cast<void *>(findValue<C>()));
+  }
+  template <ECSComponent C> const C &get() const
+  {
+    return *static_cast<const C *>(findValue<C>());
+  }
+  template <ECSComponent C> bool has() const
+  {
+    return m_mask.test(ComponentManagerT::template componentIndex<C>());
+  }
+
+  // ---------------------------------------------------- //
+  // file
+  // ---------------------------------------------------- //
+
+  // Copy the prefab into bytes, in the layout above. Fails if a component
+  // isn't trivially copyable or declares no layoutId
+  bool capture(std::vector<std::byte> &bytes) const
+  {
+    for (const Field &field : m_fields)
+      if (!field.ops->triviallyCopyable || field.ops->layoutId.empty()) {
+        PLOG_E("Prefab component {} isn't trivially copyable or has no "
+               "layoutId, it can't be saved",
+               field.component);
+        return false;
+      }
+    SnapshotWriter measure;
+    write(measure);
+    bytes.resize(measure.size());
+    SnapshotWriter writer(bytes, false);
+    write(writer);
+    return true;
+  }
+  bool save(const std::string &path) const
+  {
+    std::vector<std::byte> bytes;
+    return capture(bytes) && writeSnapshotFile(path, bytes);
+  }
+
+  // Operations of the listed components, indexed like archetype columns, the
+  // others are null. Tells load() which components a file may hold
+  template <ECSComponent... Components>
+  static std::array<const ColumnOps *, NumberOfColumns> columnOpsTable()
+  {
+    static_assert((std::is_trivially_copyable_v<Components> && ...),
+                  "Only trivially copyable components can be loaded");
+    static_assert((HasLayoutId<Components> && ...),
+                  "Components saved to a file must declare a layoutId");
+    std::array<const ColumnOps *, NumberOfColumns> table = {};
+    (..., (table[ComponentManagerT::template componentIndex<Components>()] =
+               &Archetype<ComponentManagerT>::template columnOpsOf<
+                   Components>));
+    return table;
+  }
+  // Read a prefab written by capture(). nullopt when bytes isn't a prefab of
+  // this layout or holds a component missing from components
+  static std::optional<Prefab>
+  load(std::span<const std::byte> bytes,
+       const std::array<const ColumnOps *, NumberOfColumns> &components)
+  {
+    SnapshotReader reader(bytes);
+    PrefabHeader header;
+    if (!reader.read(header) || header.magic != PrefabMagic ||
+        header.version != PrefabVersion ||
+        header.components != NumberOfColumns ||
+        header.fields > NumberOfColumns) {
+      PLOG_E("Prefab wasn't saved with this registry layout");
+      return std::nullopt;
+    }
+    std::vector<Field> fields;
+    std::array<const std::byte *, NumberOfColumns> values = {};
+    for (std::size_t i = 0; i < header.fields; ++i) {
+      reader.align();
+      SnapshotColumn column;
+      if (!reader.read(column) || column.component >= NumberOfColumns ||
+          components[column.component] == nullptr ||
+          components[column.component]->rowBytes != column.rowBytes ||
+          values[column.component] != nullptr)
+        break;
+      reader.align();
+      values[column.component] = reader.take(column.rowBytes);
+      fields.push_back({column.component, 0, components[column.component]});
+    }
+    if (fields.size() != header.fields || reader.failed()) {
+      PLOG_E("Prefab is truncated or holds components that can't be loaded");
+      return std::nullopt;
+    }
+    if (header.layout != layoutHash(fields)) {
+      PLOG_E("Prefab wasn't saved with this registry layout");
+      return std::nullopt;
+    }
+    return assemble(std::move(fields),
+                    [&values](const Field &field, void *slot) {
+                      std::memcpy(slot, values[field.component],
+                                  field.ops->rowBytes);
+                    });
+  }
+  template <ECSComponent... Components>
+  static std::optional<Prefab> load(std::span<const std::byte> bytes)
+  {
+    return load(bytes, columnOpsTable<Components...>());
+  }
+
+private:
+  Bitmask m_mask = {};
+  std::vector<Field> m_fields = {};
+  std::byte *m_row = nullptr;
+  std::size_t m_alignment = 1;
+
+  template <typename C>
+  static void constructField(const Field &field, void *slot, const C &value)
+  {
+    if (field.component == ComponentManagerT::template componentIndex<C>())
+      copyIntoPrefab(slot, value);
+  }
+  template <typename C> const void *findValue() const
+  {
+    constexpr std::size_t c = ComponentManagerT::template componentIndex<C>();
+    for (const Field &field : m_fields)
+      if (field.component == c)
+        return value(field);
+    P_ASSERT(false, "Prefab has no component {}", typeid(C).name());
+    return nullptr;
+  }
+  // CompileTimeBitMask::layoutHash() of the components of fields
+  static std::uint64_t layoutHash(std::span<const Field> fields)
+  {
+    std::array<ComponentLayout, NumberOfColumns> layouts = {};
+    for (const Field &field : fields)
+      layouts[field.component] = {field.ops->layoutId, field.ops->rowBytes,
+                                  field.ops->alignment};
+    return hashLayouts(layouts);
+  }
+  void write(SnapshotWriter &writer) const
+  {
+    writer.write(PrefabHeader{.components = NumberOfColumns,
+                              .layout = layoutHash(m_fields),
+                              .fields = m_fields.size()});
+    for (const Field &field : m_fields) {
+      writer.align();
+      writer.write(SnapshotColumn{field.component, field.ops->rowBytes});
+      writer.align();
+      writer.write(value(field), field.ops->rowBytes);
+    }
+  }
+  void swap(Prefab &other) noexcept
+  {
+    std::swap(m_mask, other.m_mask);
+    std::swap(m_fields, other.m_fields);
+    std::swap(m_row, other.m_row);
+    std::swap(m_alignment, other.m_alignment);
+  }
+  void reset()
+  {
+    for (const Field &field : m_fields)
+      field.ops->destroyValue(m_row + field.offset);
+    m_fields.clear();
+    if (m_row != nullptr)
+      ::operator delete(m_row, std::align_val_t{m_alignment});
+    m_row = nullptr;
+    m_mask = {};
+    m_alignment = 1;
+  }
+};
+
+} // namespace reg
@@ -0,0 +1,159 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+
+#pragma once
+
+#include "Core.h"
+#include "CoreFiles/LogWrapper.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+namespace reg
+{
+
+// ---------------------------------------------------- //
+// Resource ids
+// ---------------------------------------------------- //
+
+using ResourceId = size_t;
+
+// next id handed out by resourceId(), shared by every scene
+inline std::atomic<ResourceId> g_nextResourceId = 0;
+
+// Dense id of a resource type, given the first time the type is asked for.
+// const T and T share the same id
+template <typename T> ResourceId resourceId()
+{
+  if constexpr (std::is_const_v<T>) {
+    return resourceId<std::remove_const_t<T>>();
+  } else {
+    static const ResourceId id =
+        g_nextResourceId.fetch_add(1, std::memory_order_relaxed);
+    return id;
+  }
+}
+
+// ---------------------------------------------------- //
+// Access declared by systems
+// ---------------------------------------------------- //
+
+// Resources a system reads or writes, built from its ResourceTags where a
+// const type is only read. Two systems without conflict may run at once
+struct ResourceAccess {
+  std::vector<ResourceId> reads = {};
+  std::vector<ResourceId> writes = {};
+
+  template <typename... Ts> static ResourceAccess of()
+  {
+    ResourceAccess access;
+    (..., (std::is_const_v<Ts> ? access.reads : access.writes)
+              .push_back(resourceId<Ts>()));
+    return access;
+  }
+
+  bool canWrite(ResourceId id) const
+  {
+    return std::find(writes.begin(), writes.end(), id) != writes.end();
+  }
+  bool canRead(ResourceId id) const
+  {
+    return canWrite(id) ||
+           std::find(reads.begin(), reads.end(), id) != reads.end();
+  }
+  // one of them writes a resource the other uses
+  bool conflictsWith(const ResourceAccess &other) const
+  {
+    auto readBy = [](const ResourceAccess &access) {
+      return [&access](ResourceId id) { return access.canRead(id); };
+    };
+    return std::ranges::any_of(writes, readBy(other)) ||
+           std::ranges::any_of(other.writes, readBy(*this));
+  }
+};
+
+// ---------------------------------------------------- //
+// Storage
+// ---------------------------------------------------- //
+
+// Scene-wide singletons, at most one object per type: the active camera, the
+// map, tuning tables... They live outside the archetypes, so reaching one is
+// an index into a vector instead of a query or a map lookup. Objects keep
+// their address until they are replaced or erased
+class Resources
+{
+public:
+  Resources() = default;
+  Resources(Resources &&other) = default;
+  Resources &operator=(Resources &&other) = default;
+  NONCOPYABLE(Resources);
+
+  // Create the resource T, replacing the previous one
+  template <typename T, typename... Args> T &emplace(Args &&...args)
+  {
+    static_assert(!std::is_const_v<T> && !std::is_reference_v<T>,
+                  "Resources are stored by value");
+    const ResourceId id = resourceId<T>();
+    if (id >= m_objects.size())
+      m_objects.resize(id + 1);
+    std::shared_ptr<T> object =
+        std::make_shared<T>(std::forward<Args>(args)...);
+    T &resource = *object;
+    m_objects[id] = std::move(object);
+    return resource;
+  }
+
+  // The resource T, which must exist
+  template <typename T> T &get()
+  {
+    T *resource = find<T>();
+    P_ASSERT(resource != nullptr, "Resource {} was never emplaced",
+             typeid(T).name());
+    return *resource;
+  }
+  template <typename T> const T &get() const
+  {
+    const T *resource = find<T>();
+    P_ASSERT(resource != nullptr, "Resource {} was never emplaced",
+             typeid(T).name());
+    return *resource;
+  }
+  // The resource T, or nullptr
+  template <typename T> T *find()
+  {
+    const ResourceId id = resourceId<T>();
+    return id < m_objects.size() ? static_cast<T *>(m_objects[id].get())
+                                 : nullptr;
+  }
+  template <typename T> const T *find() const
+  {
+    const ResourceId id = resourceId<T>();
+    return id < m_objects.size()
+               ? static_cast<const T *>(m_objects[id].get())
+               : nullptr;
+  }
+  template <typename T> bool contains() const { return find<T>() != nullptr; }
+
+  template <typename T> void erase()
+  {
+    const ResourceId id = resourceId<T>();
+    if (id < m_objects.size())
+      m_objects[id].reset();
+  }
+
+private:
+  // indexed by resourceId(), empty for types this scene doesn't hold. The
+  // shared_ptr keeps the deleter of each type
+  std::vector<std::shared_ptr<void>> m_objects;
+};
+
+} // namespace reg
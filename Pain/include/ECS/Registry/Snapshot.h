@@ -0,0 +1,294 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+
+#pragma once
+
+#include "Core.h"
+#include "CoreFiles/LogWrapper.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#ifdef PLATFORM_IS_LINUX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace reg
+{
+
+// ---------------------------------------------------- //
+// Binary layout
+// ---------------------------------------------------- //
+
+// A snapshot is the memory of a registry written as is: the records, the
+// recycled ids, the entities saved without their components, then for each
+// archetype its entities followed by one contiguous array per column. Every
+// block is a plain copy, the records of the entities saved without components
+// are fixed when loading. Numbers and components are stored in their native
+// layout, so a snapshot is read back by the build that wrote it, the header
+// checks the component layout and the record size. Every block starts at a
+// multiple of SnapshotAlignment from the start of the file
+inline constexpr std::array<char, 8> SnapshotMagic = {'P', 'A', 'I', 'N',
+                                                      'E', 'C', 'S', '\0'};
+inline constexpr std::uint32_t SnapshotVersion = 2;
+inline constexpr std::size_t SnapshotAlignment = 16;
+
+struct SnapshotHeader {
+  std::array<char, 8> magic = SnapshotMagic;
+  std::uint32_t version = SnapshotVersion;
+  // number of registered components and CompileTimeBitMask::layoutHash() of
+  // the saved components
+  std::uint32_t components = 0;
+  std::uint64_t layout = 0;
+  std::uint64_t recordBytes = 0;
+  std::uint64_t records = 0;
+  std::uint64_t freeEntities = 0;
+  std::uint64_t droppedEntities = 0;
+  std::uint64_t archetypes = 0;
+};
+// followed by columns SnapshotColumn, then the entities and the columns data
+template <typename BitmaskT> struct SnapshotArchetype {
+  BitmaskT mask;
+  std::uint64_t rows = 0;
+  std::uint64_t columns = 0;
+};
+struct SnapshotColumn {
+  std::uint64_t component = 0;
+  std::uint64_t rowBytes = 0;
+};
+
+// ---------------------------------------------------- //
+// Writer
+// ---------------------------------------------------- //
+
+// A block left for later by SnapshotWriter, offset is where it goes
+struct SnapshotCopy {
+  std::size_t offset = 0;
+  const std::byte *source = nullptr;
+  std::size_t bytes = 0;
+};
+// blocks are deferred in pieces of this size, to balance the threads copying
+inline constexpr std::size_t SnapshotCopyGrain = 256 * 1024;
+
+// Lays a snapshot out in a byte buffer. The same writes are done twice: the
+// first pass only measures the snapshot, the second one copies it into a
+// buffer of that size. Blocks written by pointer can be deferred instead of
+// copied, to spread the copies over threads afterwards
+class SnapshotWriter
+{
+public:
+  // measuring pass, see size()
+  SnapshotWriter() = default;
+  // copying pass, bytes must be size() long
+  SnapshotWriter(std::span<std::byte> bytes, bool deferBlocks)
+      : m_bytes(bytes), m_copying(true), m_defer(deferBlocks)
+  {
+  }
+
+  // data must stay valid until the deferred copies are done
+  void write(const void *data, std::size_t bytes)
+  {
+    const std::byte *source = static_cast<const std::byte *>(data);
+    if (m_copying && !m_defer)
+      std::memcpy(m_bytes.data() + m_offset, source, bytes);
+    else if (m_copying)
+      for (std::size_t done = 0; done < bytes; done += SnapshotCopyGrain)
+        m_deferred.push_back({m_offset + done, source + done,
+                              std::min(SnapshotCopyGrain, bytes - done)});
+    m_offset += bytes;
+  }
+  template <typename T> void write(const T &value)
+  {
+    static_assert(std::is_trivially_copyable_v<T>);
+    if (std::byte *data = claim(sizeof(T)))
+      std::memcpy(data, &value, sizeof(T));
+  }
+  // Room for bytes the caller fills itself, null while measuring
+  std::byte *claim(std::size_t bytes)
+  {
+    std::byte *data = m_copying ? m_bytes.data() + m_offset : nullptr;
+    m_offset += bytes;
+    return data;
+  }
+  // start the next block on an aligned offset
+  void align()
+  {
+    const std::size_t padding =
+        (SnapshotAlignment - m_offset % SnapshotAlignment) % SnapshotAlignment;
+    if (std::byte *data = claim(padding))
+      std::memset(data, 0, padding);
+  }
+  std::size_t size() const { return m_offset; }
+
+  // the copies left by write(), independent from each other
+  std::span<const SnapshotCopy> deferred() const { return m_deferred; }
+  void copyDeferred(std::size_t index) const
+  {
+    const SnapshotCopy &copy = m_deferred[index];
+    std::memcpy(m_bytes.data() + copy.offset, copy.source, copy.bytes);
+  }
+
+private:
+  std::span<std::byte> m_bytes = {};
+  bool m_copying = false;
+  bool m_defer = false;
+  std::size_t m_offset = 0;
+  std::vector<SnapshotCopy> m_deferred = {};
+};
+
+// Write a snapshot next to path then rename it, so a crash while writing
+// never leaves a truncated file where the previous snapshot was
+inline bool writeSnapshotFile(const std::string &path,
+                              std::span<const std::byte> bytes)
+{
+  const std::string temporary = path + ".tmp";
+  {
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(bytes.data()),
+               static_cast<std::streamsize>(bytes.size()));
+    if (!file) {
+      PLOG_E("Couldn't write snapshot {}", temporary);
+      return false;
+    }
+  }
+  std::error_code error;
+  std::filesystem::rename(temporary, path, error);
+  if (error)
+    PLOG_E("Couldn't move snapshot to {}: {}", path, error.message());
+  return !error;
+}
+
+// Copy of a registry waiting to be written by a worker thread, see
+// AbstractScene::autosave. bytes belongs to the worker while writing is set
+struct SnapshotStaging {
+  std::vector<std::byte> bytes = {};
+  std::atomic<bool> writing{false};
+};
+
+// ---------------------------------------------------- //
+// Reader
+// ---------------------------------------------------- //
+
+// Walks the blocks of a snapshot in memory. Reading past the end fails the
+// reader instead of the program, a truncated file is only a failed load
+class SnapshotReader
+{
+public:
+  explicit SnapshotReader(std::span<const std::byte> bytes) : m_bytes(bytes)
+  {
+  }
+
+  // The next count elements of elementBytes each, or null when there aren't
+  // enough bytes left
+  const std::byte *take(std::size_t count, std::size_t elementBytes = 1)
+  {
+    const std::size_t left = m_bytes.size() - m_offset;
+    if (m_failed || (elementBytes != 0 && count > left / elementBytes)) {
+      m_failed = true;
+      return nullptr;
+    }
+    const std::byte *data = m_bytes.data() + m_offset;
+    m_offset += count * elementBytes;
+    return data;
+  }
+  // Copied out, blocks of a mapped file have no alignment guarantee in memory
+  template <typename T> bool read(T &value)
+  {
+    static_assert(std::is_trivially_copyable_v<T>);
+    const std::byte *data = take(sizeof(T));
+    if (data != nullptr)
+      std::memcpy(&value, data, sizeof(T));
+    return data != nullptr;
+  }
+  void align()
+  {
+    take((SnapshotAlignment - m_offset % SnapshotAlignment) %
+         SnapshotAlignment);
+  }
+  bool failed() const { return m_failed; }
+
+private:
+  std::span<const std::byte> m_bytes;
+  std::size_t m_offset = 0;
+  bool m_failed = false;
+};
+
+// ---------------------------------------------------- //
+// File
+// ---------------------------------------------------- //
+
+// Read only view of a whole file. Mapped on Linux, so the pages are only read
+// from disk when the load copies them into the chunks. Elsewhere the file is
+// read into memory
+class SnapshotFile
+{
+public:
+  explicit SnapshotFile(const char *path)
+  {
+#ifdef PLATFORM_IS_LINUX
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+      PLOG_E("Couldn't open snapshot {}", path);
+      return;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+      void *data = ::mmap(nullptr, static_cast<std::size_t>(info.st_size),
+                          PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED)
+        m_bytes = {static_cast<const std::byte *>(data),
+                   static_cast<std::size_t>(info.st_size)};
+      else
+        PLOG_E("Couldn't map snapshot {}", path);
+    }
+    ::close(fd);
+#else
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+      PLOG_E("Couldn't open snapshot {}", path);
+      return;
+    }
+    m_buffer.resize(static_cast<std::size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char *>(m_buffer.data()),
+              static_cast<std::streamsize>(m_buffer.size()));
+    m_bytes = m_buffer;
+#endif
+  }
+  ~SnapshotFile()
+  {
+#ifdef PLATFORM_IS_LINUX
+    if (!m_bytes.empty())
+      ::munmap(const_cast<std::byte *>(m_bytes.data()), m_bytes.size());
+#endif
+  }
+  NONCOPYABLE(SnapshotFile);
+  NONMOVABLE(SnapshotFile);
+
+  // empty if the file couldn't be read
+  std::span<const std::byte> bytes() const { return m_bytes; }
+
+private:
+  std::span<const std::byte> m_bytes = {};
+#ifndef PLATFORM_IS_LINUX
+  std::vector<std::byte> m_buffer = {};
+#endif
+};
+
+} // namespace reg
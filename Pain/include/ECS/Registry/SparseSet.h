@@ -0,0 +1,114 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+
+#pragma once
+
+#include "Core.h"
+#include "CoreFiles/LogWrapper.h"
+#include "ECS/Registry/Bitmask.h"
+#include "ECS/Registry/ChunkedStorage.h"
+#include "ECS/Registry/Entity.h"
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace reg
+{
+
+// A component opts into sparse storage by declaring
+//   static constexpr bool sparse = true;
+// It then lives in a SparseSet instead of the archetype tables, so adding or
+// removing it never moves the rest of the entity. Meant for short lived
+// markers (selected, hit flash, dirty) toggled far more often than iterated
+template <typename T>
+concept SparseComponent =
+    ECSComponent<T> && requires { requires std::remove_cvref_t<T>::sparse; };
+
+// ---------------------------------------------------- //
+// Sparse set
+// ---------------------------------------------------- //
+
+// Components of a single type keyed by entity. sparse maps an entity index to
+// its slot in the dense arrays, which stay packed by filling holes with the
+// last slot. Insertion, removal and lookup are O(1). Dense rows are chunked,
+// so insertions never move them, but a removal moves the last component into
+// the hole: references are valid only until the next removal from the set
+template <typename C> class SparseSet
+{
+public:
+  SparseSet() : m_dense(rowsPerChunkFor(sizeof(C) + sizeof(Entity))) {}
+  NONCOPYABLE(SparseSet);
+  NONMOVABLE(SparseSet);
+
+  std::size_t size() const { return m_entities.size(); }
+  bool empty() const { return m_entities.empty(); }
+  // owners of the dense slots, in slot order
+  std::span<const Entity> entities() const { return m_entities; }
+
+  bool contains(Entity entity) const
+  {
+    const std::size_t index = entityIndex(entity);
+    return index < m_sparse.size() && m_sparse[index] != Npos &&
+           m_entities[m_sparse[index]] == entity;
+  }
+
+  template <typename... Args> C &emplace(Entity entity, Args &&...args)
+  {
+    P_ASSERT(!contains(entity), "Entity {} already has this sparse component",
+             entity);
+    const std::size_t index = entityIndex(entity);
+    if (index >= m_sparse.size())
+      m_sparse.resize(index + 1, Npos);
+    m_sparse[index] = static_cast<std::uint32_t>(m_entities.size());
+    m_entities.push_back(entity);
+    return m_dense.emplace_back(std::forward<Args>(args)...);
+  }
+
+  void remove(Entity entity)
+  {
+    P_ASSERT(contains(entity), "Entity {} doesn't have this sparse component",
+             entity);
+    const std::uint32_t slot = m_sparse[entityIndex(entity)];
+    const Entity last = m_entities.back();
+    m_dense.swapRemove(slot);
+    m_entities[slot] = last;
+    m_entities.pop_back();
+    m_sparse[entityIndex(last)] = slot;
+    m_sparse[entityIndex(entity)] = Npos;
+  }
+  // remove only if present, returns whether it was
+  bool tryRemove(Entity entity)
+  {
+    if (!contains(entity))
+      return false;
+    remove(entity);
+    return true;
+  }
+
+  C &get(Entity entity)
+  {
+    P_ASSERT(contains(entity), "Entity {} doesn't have this sparse component",
+             entity);
+    return m_dense[m_sparse[entityIndex(entity)]];
+  }
+  const C &get(Entity entity) const
+  {
+    P_ASSERT(contains(entity), "Entity {} doesn't have this sparse component",
+             entity);
+    return m_dense[m_sparse[entityIndex(entity)]];
+  }
+
+private:
+  static constexpr std::uint32_t Npos = ~std::uint32_t{0};
+  std::vector<std::uint32_t> m_sparse = {};
+  ChunkedStorage<C> m_dense;
+  std::vector<Entity> m_entities = {};
+};
+
+} // namespace reg
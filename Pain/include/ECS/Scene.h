@@ -9,14 +9,23 @@
 
 #include "Assets/DeltaTime.h"
 #include "Core.h"
+#include "CoreFiles/FrameArena.h"
 #include "CoreFiles/ThreadPool.h"
 #include "ECS/EventDispatcher.h"
 #include "ECS/Registry/ArcheRegistry.h"
 #include "ECS/Registry/Bitmask.h"
+#include "ECS/Registry/CommandBuffer.h"
 #include "ECS/Registry/Entity.h"
+#include "ECS/Registry/EntityPool.h"
+#include "ECS/Registry/Prefab.h"
+#include "ECS/Registry/Resources.h"
 #include "ECS/Systems.h"
 
+#include <fstream>
+#include <memory>
+#include <optional>
 #include <sol/sol.hpp>
+#include <string>
 #include <utility>
 
 namespace pain
@@ -41,10 +50,12 @@ struct CameraSys;
  * AbstractScene represents a high-level execution context of the engine.
  * It owns:
  *  - An archetype registry for entity/component storage.
+ *  - Resources, scene-wide singletons stored outside of the archetypes.
  *  - A set of systems responsible for update, rendering and event processing.
  *  It references from the application:
  *  - A shared Lua state for gameplay and tooling scripting.
  *  - A thread pool with a main-thread job queue.
+ *  - A frame arena for allocations that only live during one frame.
  *  - An event dispatcher for engine events.
  *
  * The scene is parameterized by a compile-time component manager, allowing
@@ -93,6 +104,117 @@ public:
         entity, std::forward<Components>(components)...);
   }
 
+  /**
+   * @brief Creates many entities sharing the same component types at once.
+   *
+   * Entity ids are allocated in bulk and the rows are appended to a single
+   * archetype, reserving each column once. Accepts the same arguments as
+   * reg::ArcheRegistry::createEntities:
+   *  - one span per component, moved from,
+   *  - a count followed by components copied into every entity,
+   *  - a count followed by a generator returning a tuple per entity.
+   *
+   * @code
+   * scene.createEntities(1000, Transform2dComponent{}, SpriteComponent{});
+   * @endcode
+   *
+   * @return Identifiers of the created entities, in row order.
+   */
+  template <reg::ECSComponent... Components, typename... Args>
+  std::vector<reg::Entity> createEntities(Args &&...args)
+  {
+    return m_registry.template createEntities<Components...>(
+        std::forward<Args>(args)...);
+  }
+
+  /**
+   * @brief Copies the components of an entity into a prefab.
+   *
+   * The prefab holds the archetype of the entity and a packed copy of its
+   * row. Components that can't be copied and sparse ones are left out.
+   *
+   * @param entity Entity used as a template, left untouched.
+   * @return Prefab to pass to instantiate().
+   */
+  reg::Prefab<Manager> makePrefab(reg::Entity entity) const
+  {
+    return m_registry.makePrefab(entity);
+  }
+
+  /**
+   * @brief Creates many entities from a prefab.
+   *
+   * Every entity starts as a copy of the prefab row, copied column by column
+   * into a single archetype. Overrides give per entity values for some of
+   * the prefab components, one span of @p count values per component:
+   *
+   * @code
+   * scene.instantiate(asteroid, transforms.size(), std::span(transforms));
+   * @endcode
+   *
+   * @return Identifiers of the created entities, in row order.
+   */
+  template <reg::ECSComponent... Overrides>
+  std::vector<reg::Entity> instantiate(const reg::Prefab<Manager> &prefab,
+                                       size_t count,
+                                       std::span<Overrides>... overrides)
+  {
+    return m_registry.instantiate(prefab, count, overrides...);
+  }
+
+  /**
+   * @brief Loads a prefab file written by reg::Prefab::save.
+   *
+   * @tparam Components Components the file may hold, trivially copyable.
+   * @param path Prefab file.
+   * @return The prefab, or nothing if the file is missing or doesn't match
+   *         this scene.
+   */
+  template <reg::ECSComponent... Components>
+  std::optional<reg::Prefab<Manager>> loadPrefab(const char *path) const
+  {
+    reg::SnapshotFile file(path);
+    if (file.bytes().empty())
+      return std::nullopt;
+    return reg::Prefab<Manager>::template load<Components...>(file.bytes());
+  }
+
+  /**
+   * @brief Spawns an entity from a pool, reusing a released one if any.
+   *
+   * A reused entity keeps its handle and its row, its components are reset
+   * to the prefab of the pool. See reg::EntityPool.
+   *
+   * @return The spawned entity.
+   */
+  reg::Entity acquire(reg::EntityPool<Manager> &pool)
+  {
+    return pool.acquire(m_registry);
+  }
+  /** @brief Spawns @p count entities from a pool, see acquire(). */
+  std::vector<reg::Entity> acquire(reg::EntityPool<Manager> &pool,
+                                   size_t count)
+  {
+    return pool.acquire(m_registry, count);
+  }
+
+  /**
+   * @brief Despawns entities acquired from a pool.
+   *
+   * They are disabled instead of removed, queries skip them until they are
+   * acquired again.
+   */
+  void release(reg::EntityPool<Manager> &pool,
+               std::span<const reg::Entity> entities)
+  {
+    pool.release(m_registry, entities);
+  }
+  /** @brief Despawns a single entity acquired from a pool. */
+  void release(reg::EntityPool<Manager> &pool, reg::Entity entity)
+  {
+    pool.release(m_registry, entity);
+  }
+
   /**
    * @brief Creates a single component on an entity.
    *
@@ -124,12 +246,27 @@ public:
         entity, std::forward<Components>(components)...);
   }
 
+  /**
+   * @brief Removes components from an existing entity.
+   *
+   * The entity stays alive, even when it is left without components.
+   *
+   * @tparam Components ECS component types, all owned by the entity.
+   * @param entity Target entity.
+   */
+  template <reg::ECSComponent... Components>
+  void removeComponents(reg::Entity entity)
+  {
+    m_registry.template removeComponents<Components...>(entity);
+  }
+
   /**
    * @brief Returns the bitmask corresponding to a single component type.
    *
    * @tparam Component Component type.
    */
-  template <reg::ECSComponent Component> reg::Bitmask getSingleBitmask()
+  template <reg::ECSComponent Component>
+  typename Manager::Bitmask getSingleBitmask()
   {
     return Manager::template singleComponentBitmask<Component>();
   }
@@ -140,10 +277,11 @@ public:
    * @tparam Components Required component types.
    * @tparam ExcludeComponents Component types to exclude.
    * @param Exclude Optional exclusion mask.
-   * @return Vector of chunk views matching the query.
+   * @return Cached range of chunk views matching the query. Iterating it
+   *         does not allocate.
    */
   template <reg::ECSComponent... Components, typename... ExcludeComponents>
-  inline std::vector<reg::ChunkView<Components...>>
+  inline reg::QueryView<reg::Archetype<Manager>, Components...>
   query(exclude_t<ExcludeComponents...> = {})
   {
     return m_registry.template query<Components...>(
@@ -152,13 +290,43 @@ public:
 
   /// @brief Const version of query().
   template <reg::ECSComponent... Components, typename... ExcludeComponents>
-  inline std::vector<reg::ChunkView<const Components...>>
+  inline reg::QueryView<const reg::Archetype<Manager>, const Components...>
   queryConst(exclude_t<ExcludeComponents...> = {}) const
   {
     return m_registry.template queryConst<Components...>(
         exclude<ExcludeComponents...>);
   }
 
+  /**
+   * @brief Queries only the chunks written after a change tick.
+   *
+   * @param since Tick returned by getChangeTick() when the caller last read.
+   * @return Range over the chunks where any of Components changed.
+   */
+  template <reg::ECSComponent... Components, typename... ExcludeComponents>
+  inline reg::QueryView<reg::Archetype<Manager>, Components...>
+  queryChanged(reg::ChangeTick since, exclude_t<ExcludeComponents...> = {})
+  {
+    return m_registry.template queryChanged<Components...>(
+        since, exclude<ExcludeComponents...>);
+  }
+
+  /// @brief Current change tick, stamped on every chunk written from now on.
+  reg::ChangeTick getChangeTick() const { return m_registry.changeTick(); }
+
+  /**
+   * @brief Calls fn(entity, components &...) for every matching entity.
+   *
+   * Works with sparse components too, which query can't iterate.
+   */
+  template <reg::ECSComponent... Components, typename... ExcludeComponents,
+            typename Fn>
+  inline void each(Fn &&fn, exclude_t<ExcludeComponents...> = {})
+  {
+    m_registry.template each<Components...>(std::forward<Fn>(fn),
+                                            exclude<ExcludeComponents...>);
+  }
+
   /**
    * @brief Retrieves multiple components from an entity.
    *
@@ -211,6 +379,220 @@ public:
   /** @brief Removes an entity and all of its components from the registry. */
   void removeEntity(reg::Entity entity) { m_registry.remove(entity); }
 
+  /**
+   * @brief Checks whether a handle still refers to a living entity.
+   *
+   * Handles become stale once their entity is removed, even when the id is
+   * later recycled for a new entity.
+   */
+  bool isAlive(reg::Entity entity) const { return m_registry.isAlive(entity); }
+
+  /**
+   * @brief Pauses or resumes an entity without moving it.
+   *
+   * A disabled entity keeps its components and its handle, but queries and
+   * systems skip it. Toggling only flips a bit, so thousands of entities can
+   * be paused per frame, e.g. off-screen map chunks. The entity must own at
+   * least one component that isn't sparse.
+   *
+   * @param entity Target entity.
+   * @param enabled False to pause the entity.
+   */
+  void setEnabled(reg::Entity entity, bool enabled)
+  {
+    m_registry.setEnabled(entity, enabled);
+  }
+
+  /** @brief Whether an entity is visited by queries, see setEnabled(). */
+  bool isEnabled(reg::Entity entity) const
+  {
+    return m_registry.isEnabled(entity);
+  }
+
+  /**
+   * @brief Saves every entity of the scene to a binary snapshot file.
+   *
+   * Only the listed components are saved, they must be trivially copyable and
+   * hold no pointers. Entities owning other components are saved without
+   * any, see reg::ArcheRegistry::saveSnapshot.
+   *
+   * @tparam Components Components written to the snapshot.
+   * @param path Destination file, overwritten.
+   * @return False if the file couldn't be written.
+   */
+  template <reg::ECSComponent... Components>
+  bool saveSnapshot(const char *path) const
+  {
+    std::ofstream file(path, std::ios::binary);
+    return file && m_registry.template saveSnapshot<Components...>(file);
+  }
+
+  /**
+   * @brief Loads a snapshot saved with the same components into this scene.
+   *
+   * The file is mapped and each column is copied at once, instead of creating
+   * the entities one by one from scripts. Must be called before the scene
+   * creates any entity.
+   *
+   * @tparam Components Components the snapshot was saved with.
+   * @param path Snapshot file.
+   * @return False if the file is missing or doesn't match this scene.
+   */
+  template <reg::ECSComponent... Components>
+  bool loadSnapshot(const char *path)
+  {
+    reg::SnapshotFile file(path);
+    return !file.bytes().empty() &&
+           m_registry.template loadSnapshot<Components...>(file.bytes());
+  }
+
+  /**
+   * @brief Saves the scene without blocking the frame, e.g. for autosaves.
+   *
+   * Only the copy of the registry into a staging buffer stalls the frame, and
+   * it is spread over the thread pool. The file is then written by the
+   * thread pool while the scene keeps running. The buffer is reused by the
+   * next autosave, which is skipped if the previous file is still being
+   * written.
+   *
+   * @tparam Components Components written, as for saveSnapshot().
+   * @param path Destination file, replaced once fully written.
+   * @return False if the autosave was skipped.
+   */
+  template <reg::ECSComponent... Components> bool autosave(std::string path)
+  {
+    if (m_autosave->writing.load(std::memory_order_acquire)) {
+      PLOG_W("Autosave to {} skipped, the previous one is still being written",
+             path);
+      return false;
+    }
+    m_registry.template captureSnapshot<Components...>(m_autosave->bytes,
+                                                       &m_threadPool);
+    m_autosave->writing.store(true, std::memory_order_relaxed);
+    m_threadPool.enqueue([staging = m_autosave, path = std::move(path)] {
+      reg::writeSnapshotFile(path, staging->bytes);
+      staging->writing.store(false, std::memory_order_release);
+    });
+    return true;
+  }
+
+  /** @brief Whether the file of the last autosave is still being written. */
+  bool isAutosaving() const
+  {
+    return m_autosave->writing.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief Gives back the memory of despawned entities, a bit every call.
+   *
+   * Shrinks the columns of the archetypes, drops the empty ones and regroups
+   * the rows of equal shared components, see reg::SharedComponent. With a
+   * budget, call it once per frame, outside of any system iterating the
+   * registry, until the report says the pass is completed. Component
+   * references and views taken before are invalidated.
+   *
+   * @param options Budget of the call and what to keep.
+   * @return Bytes reclaimed per archetype visited by this call.
+   */
+  reg::CompactReport<typename Manager::Bitmask>
+  compact(reg::CompactOptions options = {})
+  {
+    return m_registry.compact(options);
+  }
+
+  /**
+   * @brief Same as compact(), also sorting rows by a component for locality.
+   *
+   * @tparam C Key component, archetypes without it are only shrunk.
+   * @param compare Strict weak ordering of two C, as for std::sort.
+   * @param options Budget of the call, the moved rows count towards it.
+   */
+  template <reg::ECSComponent C, typename Compare>
+  reg::CompactReport<typename Manager::Bitmask>
+  compact(Compare &&compare, reg::CompactOptions options = {})
+  {
+    return m_registry.template compact<C>(std::forward<Compare>(compare),
+                                          options);
+  }
+
+  // =============================================================== //
+  // RESOURCES RELATED
+  // =============================================================== //
+
+  /**
+   * @brief Creates a scene-wide singleton, e.g. the map or tuning tables.
+   *
+   * Resources live outside of the archetypes: reaching one costs an index
+   * into a vector instead of a query. Systems reach them with
+   * System::resource() once listed in their ResourceTags.
+   *
+   * @tparam T Resource type, replaced if the scene already holds one.
+   * @param args Constructor arguments for the resource.
+   * @return Reference to the resource, stable until it is replaced or removed.
+   */
+  template <typename T, typename... Args> T &emplaceResource(Args &&...args)
+  {
+    return m_resources.template emplace<T>(std::forward<Args>(args)...);
+  }
+
+  /** @brief Returns a resource, which must have been emplaced. */
+  template <typename T> T &resource() { return m_resources.template get<T>(); }
+
+  /** @brief Const version of resource(). */
+  template <typename T> const T &resource() const
+  {
+    return m_resources.template get<T>();
+  }
+
+  /** @brief Checks whether the scene holds a resource of type T. */
+  template <typename T> bool hasResource() const
+  {
+    return m_resources.template contains<T>();
+  }
+
+  /** @brief Destroys the resource of type T, if any. */
+  template <typename T> void removeResource()
+  {
+    m_resources.template erase<T>();
+  }
+
+  // =============================================================== //
+  // COMPONENT EVENTS RELATED
+  // =============================================================== //
+
+  /**
+   * @brief Subscribes fn to the entities that gained the component C.
+   *
+   * Events are delivered in batches at the sync points of the scene: before
+   * every update system and after playbackCommands(). Systems should prefer
+   * System::onAdded(), which unsubscribes with them.
+   *
+   * @return Id to pass to unobserve().
+   */
+  template <reg::ECSComponent C> reg::ObserverId onAdded(reg::ObserverFn fn)
+  {
+    return m_registry.template onAdded<C>(std::move(fn));
+  }
+
+  /** @brief Subscribes fn to the entities that lost the component C. */
+  template <reg::ECSComponent C> reg::ObserverId onRemoved(reg::ObserverFn fn)
+  {
+    return m_registry.template onRemoved<C>(std::move(fn));
+  }
+
+  /**
+   * @brief Subscribes fn to the entities whose component C was written.
+   *
+   * Found per chunk from the change ticks, see queryChanged().
+   */
+  template <reg::ECSComponent C> reg::ObserverId onChanged(reg::ObserverFn fn)
+  {
+    return m_registry.template onChanged<C>(std::move(fn));
+  }
+
+  /** @brief Ends a subscription made with onAdded, onRemoved or onChanged. */
+  void unobserve(reg::ObserverId id) { m_registry.unobserve(id); }
+
   // =============================================================== //
   // LUA SCRIPTING RELATED
   // =============================================================== //
@@ -278,6 +660,9 @@ public:
   /** @brief Const access to the thread pool. */
   const ThreadPool &getThreadPool() const { return m_threadPool; }
 
+  /** @brief Returns the per-frame allocator shared with the application. */
+  FrameArena &getFrameArena() { return m_frameArena; }
+
   using MainThreadJob = std::function<void()>;
 
   /**
@@ -294,6 +679,25 @@ public:
    */
   void flushMainThreadJobs();
 
+  /**
+   * @brief Returns the command buffer of the calling thread.
+   *
+   * Structural changes recorded into it are deferred until
+   * playbackCommands(). Each thread gets its own buffer, so worker jobs can
+   * record without synchronizing with each other.
+   */
+  reg::CommandBuffer<Manager> &getCommandBuffer() { return m_commands.local(); }
+
+  /**
+   * @brief Applies the structural changes recorded by every thread.
+   *
+   * Spawns sharing the same component list are appended to their archetype
+   * as a single batch. Called by the application once per frame, after
+   * updates and events, and must not overlap with any chunk iteration. The
+   * component events of the frame are then delivered to their observers.
+   */
+  void playbackCommands();
+
   // =============================================================== //
   // ENGINE EVENTS RELATED
   // =============================================================== //
@@ -313,10 +717,10 @@ public:
 
   /**
    * @brief Constructs a scene bound to an event dispatcher, Lua state,
-   *        and thread pool.
+   *        thread pool and frame arena.
    */
   AbstractScene(reg::EventDispatcher &ed, sol::state &solState,
-                ThreadPool &threadPool);
+                ThreadPool &threadPool, FrameArena &frameArena);
 
   AbstractScene() = delete;
 
@@ -327,6 +731,9 @@ protected:
   /// Root entity for the scene.
   reg::Entity m_entity;
 
+  /// Scene-wide singletons, shared with the systems.
+  reg::Resources m_resources;
+
   /// Allows derived scenes to extend the Lua environment.
   sol::state &enchanceLuaState(sol::state &state);
 
@@ -344,12 +751,22 @@ protected:
   /// Thread pool used by the scene.
   ThreadPool &m_threadPool;
 
+  /// Per-frame allocator, reset by the application at every iteration.
+  FrameArena &m_frameArena;
+
   /// Synchronization for main-thread job queue.
   std::mutex m_mainThreadMutex;
 
   /// Pending jobs executed on the main thread.
   std::queue<MainThreadJob> m_mainThreadJobs;
 
+  /// Deferred structural changes, one buffer per recording thread.
+  reg::CommandQueue<Manager> m_commands;
+
+  /// Copy of the registry written by the last autosave, shared with its job.
+  std::shared_ptr<reg::SnapshotStaging> m_autosave =
+      std::make_shared<reg::SnapshotStaging>();
+
   /// Event dispatcher used by the scene.
   reg::EventDispatcher &m_eventDispatcher;
 };
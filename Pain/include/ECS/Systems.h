@@ -17,9 +17,13 @@
 #pragma once
 
 #include "Core.h"
+#include "CoreFiles/FrameArena.h"
+#include "CoreFiles/ThreadPool.h"
 #include "ECS/Components/ComponentManager.h"
 #include "ECS/EventDispatcher.h"
 #include "ECS/Registry/ArcheRegistry.h"
+#include "ECS/Registry/CommandBuffer.h"
+#include "ECS/Registry/Resources.h"
 #include <iostream>
 
 namespace pain
@@ -86,6 +90,9 @@ struct IOnRender {
  * A System provides access to:
  *  - The archetype registry.
  *  - The event dispatcher.
+ *  - The scene thread pool, frame arena and command buffers, once the system
+ *    is added to a scene.
+ *  - The scene resources listed in its ResourceTags, see resource().
  *
  * It exposes helper utilities for querying archetypes, accessing components,
  * and managing entities.
@@ -114,7 +121,12 @@ public:
   System &operator=(System &&other) = delete;
   NONCOPYABLE(System);
   System() = delete;
-  virtual ~System() = default;
+  /** @brief Unsubscribes the observers of the system, see onAdded(). */
+  virtual ~System()
+  {
+    for (reg::ObserverId id : m_observerIds)
+      m_registry.unobserve(id);
+  }
 
   /** @brief Reference to the ECS archetype registry. */
   reg::ArcheRegistry<CM> &m_registry;
@@ -122,6 +134,91 @@ public:
   /** @brief Reference to the event dispatcher. */
   reg::EventDispatcher &m_eventDispatcher;
 
+  /** @brief Thread pool of the owning scene, set when the system is added. */
+  ThreadPool *m_threadPool = nullptr;
+
+  /** @brief Frame arena of the owning scene, set when the system is added. */
+  FrameArena *m_frameArena = nullptr;
+
+  /** @brief Tick of the run that last called queryChanged. */
+  reg::ChangeTick m_lastRunTick = 0;
+
+  /** @brief Changes stamped after this tick are reported by queryChanged. */
+  reg::ChangeTick m_changedSince = 0;
+
+  /** @brief Command buffers of the owning scene, set when added. */
+  reg::CommandQueue<CM> *m_commands = nullptr;
+
+  /** @brief Resources of the owning scene, set when the system is added. */
+  reg::Resources *m_resources = nullptr;
+
+  /**
+   * @brief Resources listed in the ResourceTags of the system, set when added.
+   *
+   * Lets a scheduler tell which systems may run at the same time, see
+   * reg::ResourceAccess::conflictsWith.
+   */
+  reg::ResourceAccess m_resourceAccess;
+
+  /** @brief Observers subscribed by the system, removed with it. */
+  std::vector<reg::ObserverId> m_observerIds = {};
+
+  /**
+   * @brief Returns the command buffer of the calling thread.
+   *
+   * Structural changes recorded here (spawn, remove, add/removeComponents) are
+   * applied by the scene at the end of the frame, so they are safe to record
+   * while iterating chunks, including inside forEachParallel. Fetch it once
+   * per job, the lookup takes a lock.
+   */
+  reg::CommandBuffer<CM> &getCommandBuffer()
+  {
+    P_ASSERT(m_commands != nullptr,
+             "getCommandBuffer called on a system that isn't in a scene");
+    return m_commands->local();
+  }
+
+  /**
+   * @brief Returns the frame arena of the calling thread.
+   *
+   * Use it for containers that only live during one update, they are freed
+   * all at once when the frame ends:
+   * @code
+   * std::pmr::vector<reg::Entity> hits(frameResource());
+   * @endcode
+   * Falls back to the default resource for systems outside of a scene.
+   */
+  std::pmr::memory_resource *frameResource()
+  {
+    return m_frameArena != nullptr ? m_frameArena->resource()
+                                   : std::pmr::get_default_resource();
+  }
+
+  /**
+   * @brief Returns a resource of the owning scene.
+   *
+   * The resource must be listed in the ResourceTags of the system, const when
+   * it is only read:
+   * @code
+   * using ResourceTags = TypeList<const TileMap, Tuning>;
+   * const TileMap &map = resource<const TileMap>();
+   * @endcode
+   * Costs an index into a vector, no need to keep the reference around.
+   *
+   * @tparam T Resource type, const for a read-only access.
+   */
+  template <typename T> T &resource()
+  {
+    P_ASSERT(m_resources != nullptr,
+             "resource called on a system that isn't in a scene");
+    P_ASSERT(std::is_const_v<T>
+                 ? m_resourceAccess.canRead(reg::resourceId<T>())
+                 : m_resourceAccess.canWrite(reg::resourceId<T>()),
+             "Resource {} is missing from the ResourceTags of {}",
+             typeid(T).name(), typeid(*this).name());
+    return m_resources->template get<std::remove_const_t<T>>();
+  }
+
   // ---------------------------------------------------- //
   // Iterate archetypes
   // ---------------------------------------------------- //
@@ -139,7 +236,7 @@ public:
   [[deprecated("Bitmask cannot be deduced for one the components in this "
                "function. This is fine to call, but you won't be able to add "
                "this system to any scene")]]
-  inline std::vector<reg::ChunkView<Components...>>
+  inline reg::QueryView<reg::Archetype<CM>, Components...>
   query(exclude_t<ExcludeComponents...> = {})
   {
     return m_registry.template query<Components...>(
@@ -152,11 +249,12 @@ public:
    * Only enabled when all requested component types are registered in the
    * component manager.
    *
-   * @return A list of chunk views matching the query.
+   * @return A cached, non-allocating range of chunk views matching the
+   * query.
    */
   template <typename... Components, typename... ExcludeComponents>
     requires(CM::template allRegistered<Components...>())
-  inline std::vector<reg::ChunkView<Components...>>
+  inline reg::QueryView<reg::Archetype<CM>, Components...>
   query(exclude_t<ExcludeComponents...> = {})
   {
     return m_registry.template query<Components...>(
@@ -166,13 +264,203 @@ public:
   /** @brief Const version of query(). */
   template <typename... Components, typename... ExcludeComponents>
     requires(CM::template allRegistered<Components...>())
-  inline std::vector<reg::ChunkViewConst<const Components...>>
+  inline reg::QueryView<const reg::Archetype<CM>, const Components...>
   queryConst(exclude_t<ExcludeComponents...> = {})
   {
     return m_registry.template queryConst<Components...>(
         exclude<ExcludeComponents...>);
   }
 
+  /**
+   * @brief Queries only the chunks changed since the previous run of this
+   * system.
+   *
+   * A chunk is yielded when any of the listed components was handed out as
+   * mutable, or its rows were created or moved, after this system last
+   * called queryChanged in a previous update. Mark components that are only
+   * read as const, e.g. queryChanged<const Transform2dComponent>(), otherwise
+   * iterating them counts as a write for every other reader.
+   *
+   * Change detection is per chunk: an unchanged entity sharing a chunk with
+   * a changed one is yielded too.
+   */
+  template <typename... Components, typename... ExcludeComponents>
+    requires(CM::template allRegistered<Components...>())
+  inline reg::QueryView<reg::Archetype<CM>, Components...>
+  queryChanged(exclude_t<ExcludeComponents...> = {})
+  {
+    return m_registry.template queryChanged<Components...>(
+        changedSince(), exclude<ExcludeComponents...>);
+  }
+
+  /**
+   * @brief Resolves a query once, to be kept by the system.
+   *
+   * Build it in the constructor and pass it to query(), queryConst() or
+   * queryChanged() every update: those skip the lookup of the matching
+   * archetypes, and the const views can be made from worker threads. The
+   * handle stays valid as long as the registry and sees archetypes created
+   * after it.
+   */
+  template <typename... Components, typename... ExcludeComponents>
+    requires(CM::template allRegistered<Components...>())
+  inline reg::CachedQuery<reg::Archetype<CM>, Components...>
+  makeQuery(exclude_t<ExcludeComponents...> = {})
+  {
+    return m_registry.template makeQuery<Components...>(
+        exclude<ExcludeComponents...>);
+  }
+
+  /** @brief query() over a handle built by makeQuery(). */
+  template <typename... Components>
+  inline reg::QueryView<reg::Archetype<CM>, Components...>
+  query(reg::CachedQuery<reg::Archetype<CM>, Components...> cached)
+  {
+    return m_registry.query(cached);
+  }
+
+  /** @brief queryConst() over a handle built by makeQuery(). */
+  template <typename... Components>
+  inline reg::QueryView<const reg::Archetype<CM>, const Components...>
+  queryConst(reg::CachedQuery<reg::Archetype<CM>, Components...> cached) const
+  {
+    return m_registry.queryConst(cached);
+  }
+
+  /** @brief queryChanged() over a handle built by makeQuery(). */
+  template <typename... Components>
+  inline reg::QueryView<reg::Archetype<CM>, Components...>
+  queryChanged(reg::CachedQuery<reg::Archetype<CM>, Components...> cached)
+  {
+    return m_registry.queryChanged(cached, changedSince());
+  }
+
+  /**
+   * @brief Tick after which changes are reported to this run of the system.
+   *
+   * The scene advances the tick before every update, so a new tick means
+   * this is the first changed query of a new run.
+   */
+  reg::ChangeTick changedSince()
+  {
+    const reg::ChangeTick tick = m_registry.changeTick();
+    if (tick != m_lastRunTick) {
+      m_changedSince = m_lastRunTick;
+      m_lastRunTick = tick;
+    }
+    return m_changedSince;
+  }
+
+  /**
+   * @brief Calls fn(entity, components &...) for every matching entity.
+   *
+   * Unlike query, Components and ExcludeComponents may be sparse components
+   * (see reg::SparseComponent), which never appear in chunks. When one of
+   * Components is sparse the smallest sparse set drives the iteration.
+   */
+  template <typename... Components, typename... ExcludeComponents,
+            typename Fn>
+    requires(CM::template allRegistered<Components...>())
+  inline void each(Fn &&fn, exclude_t<ExcludeComponents...> = {})
+  {
+    m_registry.template each<Components...>(std::forward<Fn>(fn),
+                                            exclude<ExcludeComponents...>);
+  }
+
+  /**
+   * @brief Runs a function over every matching chunk on the thread pool.
+   *
+   * Chunks are split into ranges of at most options.grainSize rows and
+   * spread over the scene thread pool and the calling thread. Returns once
+   * every range was processed.
+   *
+   * Example:
+   * @code
+   * forEachParallel<Transform2dComponent, Movement2dComponent>(
+   *     [dt](auto chunk) {
+   *       auto [t, m] = chunk.arrays;
+   *       for (size_t i = 0; i < chunk.count; ++i)
+   *         t[i].m_position += m[i].m_velocity * dt;
+   *     });
+   * @endcode
+   *
+   * @param fn Called as fn(chunk) or fn(chunk, rangeIndex). It runs
+   * concurrently and must only write to the rows of the chunk it receives.
+   * @param options Grain size and deterministic partitioning, see
+   * reg::ParallelOptions. The ranges are allocated from the frame arena
+   * unless options.scratch is set.
+   */
+  template <typename... Components, typename... ExcludeComponents,
+            typename Fn>
+    requires(CM::template allRegistered<Components...>())
+  void forEachParallel(Fn &&fn, exclude_t<ExcludeComponents...> = {},
+                       reg::ParallelOptions options = {})
+  {
+    P_ASSERT(m_threadPool != nullptr,
+             "forEachParallel called on a system that isn't in a scene");
+    if (options.scratch == nullptr)
+      options.scratch = frameResource();
+    m_registry.template forEachParallel<Components...>(
+        *m_threadPool, std::forward<Fn>(fn), exclude<ExcludeComponents...>,
+        options);
+  }
+
+  // ---------------------------------------------------- //
+  // Observe components
+  // ---------------------------------------------------- //
+
+  /**
+   * @brief Calls fn with the entities that gained the component C.
+   *
+   * Events are batched: fn runs at the sync points of the scene, between
+   * two systems and after the command buffers are played back, once with
+   * every entity that gained C since the previous sync point. Entities may
+   * have lost C or been removed since, check before using them. The
+   * subscription ends with the system, subscribe from its constructor:
+   * @code
+   * onAdded<SAPCollider>([this](std::span<const reg::Entity> entities) {
+   *   onCollidersAdded(entities);
+   * });
+   * @endcode
+   */
+  template <typename C>
+    requires(CM::template isRegistered<C>())
+  reg::ObserverId onAdded(reg::ObserverFn fn)
+  {
+    return m_observerIds.emplace_back(
+        m_registry.template onAdded<C>(std::move(fn)));
+  }
+
+  /**
+   * @brief Calls fn with the entities that lost the component C.
+   *
+   * Batched like onAdded(). The components are gone by the time fn runs and
+   * entities removed from the registry are stale, so keep whatever is needed
+   * to clean up, e.g. an index, keyed by entity.
+   */
+  template <typename C>
+    requires(CM::template isRegistered<C>())
+  reg::ObserverId onRemoved(reg::ObserverFn fn)
+  {
+    return m_observerIds.emplace_back(
+        m_registry.template onRemoved<C>(std::move(fn)));
+  }
+
+  /**
+   * @brief Calls fn with the entities whose component C was written.
+   *
+   * Batched like onAdded() and read from the change ticks, per chunk like
+   * queryChanged(): every entity of a chunk where C was handed out as
+   * mutable is reported, along with new or moved rows.
+   */
+  template <typename C>
+    requires(CM::template isRegistered<C>())
+  reg::ObserverId onChanged(reg::ObserverFn fn)
+  {
+    return m_observerIds.emplace_back(
+        m_registry.template onChanged<C>(std::move(fn)));
+  }
+
   // ---------------------------------------------------- //
   // Sizes
   // ---------------------------------------------------- //
@@ -237,14 +525,32 @@ public:
     return m_registry.template containsAll<TargetComponents...>(entity);
   }
 
+  /** @brief Checks whether a handle still refers to a living entity. */
+  bool isAlive(reg::Entity entity) const { return m_registry.isAlive(entity); }
+
+  /**
+   * @brief Pauses or resumes an entity, queries skip disabled ones.
+   *
+   * Only flips a bit of its archetype, rows don't move, so it can be called
+   * while iterating chunks. Not from forEachParallel jobs though, rows of
+   * different ranges share the same words of bits.
+   */
+  void setEnabled(reg::Entity entity, bool enabled)
+  {
+    m_registry.setEnabled(entity, enabled);
+  }
+
   /**
    * @brief Removes an entity and its components from the registry.
    *
-   * @note The caller must specify the exact component set of the entity.
+   * @return False if the entity was already removed.
    */
   template <typename... Components> bool removeEntity(reg::Entity entity)
   {
-    return m_registry.template remove<Components...>(entity);
+    if (!m_registry.isAlive(entity))
+      return false;
+    m_registry.remove(entity);
+    return true;
   }
 };
 
@@ -266,6 +572,29 @@ concept HasAnySystemInterface =
 template <typename T>
 concept HasTags = requires { typename T::Tags; };
 
+/** @brief Checks whether a system defines a ResourceTags type. */
+template <typename T>
+concept HasResourceTags = requires { typename T::ResourceTags; };
+
+/** @brief Builds the resource access of a ResourceTags typelist. */
+template <typename TL> struct ResourceAccessOf;
+template <typename... Ts> struct ResourceAccessOf<TypeList<Ts...>> {
+  static reg::ResourceAccess get() { return reg::ResourceAccess::of<Ts...>(); }
+};
+
+/**
+ * @brief Resources a system declared, none when it has no ResourceTags.
+ *
+ * @tparam Sys System type.
+ */
+template <typename Sys> reg::ResourceAccess resourceAccessOf()
+{
+  if constexpr (HasResourceTags<Sys>)
+    return ResourceAccessOf<typename Sys::ResourceTags>::get();
+  else
+    return {};
+}
+
 /** @brief Checks whether all system tags are registered components.*/
 template <typename T>
 concept TagsAreRegistered =
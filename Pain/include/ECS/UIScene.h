@@ -41,10 +41,12 @@ public:
    * @param eventDispatcher Shared engine event dispatcher.
    * @param solState Shared Lua state.
    * @param threadPool Shared thread pool.
+   * @param frameArena Shared per-frame allocator.
    * @return Newly constructed UIScene.
    */
   static UIScene create(reg::EventDispatcher &eventDispatcher,
-                        sol::state &solState, ThreadPool &threadPool);
+                        sol::state &solState, ThreadPool &threadPool,
+                        FrameArena &frameArena);
 
   // =============================================================== //
   // IMGUI NATIVE SCRIPTING RELATED
@@ -144,6 +146,11 @@ public:
       return;
     }
     Sys *s = static_cast<Sys *>(itSystem->second.get());
+    s->m_threadPool = &m_threadPool;
+    s->m_frameArena = &m_frameArena;
+    s->m_commands = &m_commands;
+    s->m_resources = &m_resources;
+    s->m_resourceAccess = resourceAccessOf<Sys>();
     if constexpr (std::derived_from<Sys, IOnEvent>)
       m_eventSystems.emplace_back(s);
     if constexpr (std::derived_from<Sys, IOnRender>)
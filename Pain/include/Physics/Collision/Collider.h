@@ -104,6 +104,7 @@ struct ColliderComponent {
  */
 struct SAPCollider {
   using tag = tag::SAPCollider;
+  static constexpr std::string_view layoutId = "SAPCollider/1";
 
   glm::vec2 m_offset{0.0f,
                      0.0f}; /**< Local offset from the entity transform. */
@@ -113,6 +114,14 @@ struct SAPCollider {
                               resolve physics. */
   int m_index{-1}; /**< Internal index used by the Sweep-And-Prune system. */
 
+  /**
+   * @brief Forgets the Sweep-And-Prune index on copies made into a prefab.
+   *
+   * The index belongs to the entity the prefab was made from, instances are
+   * given their own when the system inserts them.
+   */
+  void resetForPrefab() { m_index = -1; }
+
   // ------------------------------------------------------------
   // Deferred creation (not inserted into Sweep-And-Prune)
   // ------------------------------------------------------------
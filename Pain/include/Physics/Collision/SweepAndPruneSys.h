@@ -87,8 +87,14 @@ struct EndPointKey {
  * @see IOnUpdate
  */
 struct SweepAndPruneSys : public System<WorldComponents>, IOnUpdate {
-  /** @brief Inherit base System constructors. */
-  using System<WorldComponents>::System;
+  /**
+   * @brief Constructs the system and observes SAPCollider.
+   *
+   * Colliders added to or removed from the registry are inserted or erased at
+   * the next sync point of the scene, see System::onAdded().
+   */
+  SweepAndPruneSys(reg::ArcheRegistry<WorldComponents> &registry,
+                   reg::EventDispatcher &eventDispatcher);
   /**
    * @brief Component tags required by this system.
    *
@@ -116,9 +122,6 @@ struct SweepAndPruneSys : public System<WorldComponents>, IOnUpdate {
    * IOnUpdate.
    */
   void onUpdate(DeltaTime deltaTime) override;
-  // void deleteStaticEntities(std::span<reg::Entity> entities);
-  // void deleteStaticEntity(reg::Entity entitiy);
-  // void deleteEntity(reg::Entity entitiy);
 
   /**
    * @brief Inserts one or more colliders into the sweep structure.
@@ -178,8 +181,22 @@ struct SweepAndPruneSys : public System<WorldComponents>, IOnUpdate {
    */
   void insertColliderSpan(const std::vector<reg::Entity> &entities);
 
+  /**
+   * @brief Erases the endpoints of colliders from the sweep structure.
+   *
+   * Works from the entity handles alone, so it can run once their collider
+   * or the entities themselves are gone. The remaining endpoints stay sorted
+   * and the keys of the colliders after them are renumbered.
+   *
+   * @param entities Entities whose colliders are erased, unknown ones are
+   * ignored.
+   */
+  void removeColliders(std::span<const reg::Entity> entities);
+
 private:
   void sortAfterInsertion();
+  void onCollidersAdded(std::span<const reg::Entity> entities);
+  bool hasEndPoints(reg::Entity entity) const;
   std::vector<EndPoint> m_endPointsX = {};
   std::vector<EndPoint> m_endPointsY = {};
 
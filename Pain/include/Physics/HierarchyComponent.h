@@ -0,0 +1,79 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * @file HierarchyComponent.h
+ * @brief Parent/child relationship and 2D transforms relative to a parent.
+ *
+ * An entity attached to another one carries a ParentComponent and a
+ * LocalTransform2dComponent. Every node of a hierarchy, roots included, also
+ * carries a WorldTransform2dComponent, computed by the TransformHierarchy
+ * system.
+ */
+
+#pragma once
+
+#include "CoreFiles/LogWrapper.h"
+#include "ECS/Components/ComponentManager.h"
+#include "ECS/Registry/Entity.h"
+#include "pch.h"
+
+namespace pain
+{
+
+/**
+ * @brief Attaches an entity to a parent entity.
+ *
+ * The world transform of the entity follows the one of its parent. Setting
+ * m_parent through a mutable access is enough to re-parent an entity.
+ */
+struct ParentComponent {
+  using tag = tag::Parent;
+  static constexpr std::string_view layoutId = "Parent/1";
+
+  reg::Entity m_parent{-1}; /**< Entity this one is attached to. */
+  /** @brief Distance to the root, maintained by TransformHierarchy. */
+  std::uint32_t m_depth{1};
+};
+
+/**
+ * @brief 2D transform relative to the parent, or to the world for roots.
+ */
+struct LocalTransform2dComponent {
+  using tag = tag::LocalTransform2d;
+  static constexpr std::string_view layoutId = "LocalTransform2d/1";
+
+  glm::vec2 m_position{0.0f, 0.0f}; /**< Offset from the parent origin. */
+  float m_rotation{0.0f};           /**< Rotation in radians. */
+  glm::vec2 m_scale{1.0f, 1.0f};    /**< Scale along the local axes. */
+
+  /** @brief Returns translation * rotation * scale as a 2D affine matrix. */
+  glm::mat3 matrix() const
+  {
+    const float c = std::cos(m_rotation);
+    const float s = std::sin(m_rotation);
+    return glm::mat3{c * m_scale.x,  s * m_scale.x,  0.0f,
+                     -s * m_scale.y, c * m_scale.y,  0.0f,
+                     m_position.x,   m_position.y,   1.0f};
+  }
+};
+
+/**
+ * @brief World space transform of a hierarchy node.
+ *
+ * Written by TransformHierarchy, read it as const everywhere else.
+ */
+struct WorldTransform2dComponent {
+  using tag = tag::WorldTransform2d;
+  static constexpr std::string_view layoutId = "WorldTransform2d/1";
+
+  glm::mat3 m_matrix{1.0f}; /**< Local to world affine matrix. */
+
+  /** @brief Returns the world position of the node origin. */
+  glm::vec2 position() const { return glm::vec2(m_matrix[2]); }
+};
+
+} // namespace pain
@@ -30,6 +30,7 @@ namespace pain
  */
 struct Transform3dComponent {
   using tag = tag::Transform3d;
+  static constexpr std::string_view layoutId = "Transform3d/1";
 
   glm::vec3 m_position{0.f, 0.f, 0.f}; /**< Position in 3D space. */
 
@@ -55,6 +56,7 @@ struct Transform3dComponent {
  */
 struct Movement3dComponent {
   using tag = tag::Movement3d;
+  static constexpr std::string_view layoutId = "Movement3d/1";
 
   glm::vec3 m_velocity{0.f, 0.f, 0.f}; /**< Linear velocity in 3D space. */
   float m_rotationSpeed{0.0f};         /**< Angular rotation speed. */
@@ -17,6 +17,8 @@
 #include "CoreFiles/LogWrapper.h"
 #include "ECS/Components/ComponentManager.h"
 #include "pch.h"
+#include <span>
+#include <type_traits>
 
 namespace pain
 {
@@ -30,6 +32,7 @@ namespace pain
  */
 struct Transform2dComponent {
   using tag = tag::Transform2d;
+  static constexpr std::string_view layoutId = "Transform2d/1";
 
   glm::vec2 m_position{0.0f, 0.0f}; /**< Position in 2D space. */
 
@@ -48,19 +51,46 @@ struct Transform2dComponent {
 };
 
 /**
- * @brief 2D movement component storing velocity and rotation speed.
+ * @brief 2D movement component storing velocity.
  *
- * Represents linear velocity and angular speed applied to an entity
- * during movement or physics updates.
+ * Represents the linear velocity applied to an entity during movement or
+ * physics updates. The angular speed lives in RotationComponent, so this
+ * component only holds the fields read by the integration every frame.
  */
 struct Movement2dComponent {
   using tag = tag::Movement2d;
+  static constexpr std::string_view layoutId = "Movement2d/2";
 
   glm::vec2 m_velocity{0.0f, 0.0f}; /**< Linear velocity in 2D space. */
-  float m_rotationSpeed{0.0f};      /**< Angular rotation speed. */
 
   /** @brief Creates a copy of this transform component. */
   Movement2dComponent clone() const { return *this; }
 };
 
+/**
+ * @brief Views consecutive 2D components as one flat array of floats.
+ *
+ * Transform2dComponent and Movement2dComponent are a single glm::vec2, so a
+ * chunk of either is laid out x0, y0, x1, y1... with the same interleaving.
+ * Kernels applying the same operation to every coordinate, like the velocity
+ * integration, can run over 2 * count floats and be vectorized.
+ *
+ * @param components First component of the run, e.g. a chunk array.
+ * @param count Number of components in the run.
+ */
+template <typename Vec2Component>
+  requires(std::is_same_v<std::remove_const_t<Vec2Component>,
+                          Transform2dComponent> ||
+           std::is_same_v<std::remove_const_t<Vec2Component>,
+                          Movement2dComponent>)
+auto floatsOf(Vec2Component *components, size_t count)
+{
+  static_assert(sizeof(Vec2Component) == 2 * sizeof(float) &&
+                    std::is_standard_layout_v<Vec2Component>,
+                "floatsOf expects components made of a single glm::vec2");
+  using Float =
+      std::conditional_t<std::is_const_v<Vec2Component>, const float, float>;
+  return std::span<Float>(reinterpret_cast<Float *>(components), 2 * count);
+}
+
 } // namespace pain
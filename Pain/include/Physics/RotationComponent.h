@@ -22,13 +22,16 @@ namespace pain
  * @brief Stores rotation parameters for an entity.
  *
  * Defines the rotation angle and axis used by rendering or transformation
- * systems to orient an entity in world space.
+ * systems to orient an entity in world space, and the speed at which the
+ * angle changes.
  */
 struct RotationComponent {
   using tag = tag::Rotation;
+  static constexpr std::string_view layoutId = "Rotation/2";
 
   float m_rotationAngle{0.0f}; /**< Rotation angle, typically in radians. */
   glm::vec3 m_rotation{0.0f, 1.0f, 0.0f}; /**< Rotation axis vector. */
+  float m_rotationSpeed{0.0f};            /**< Angular rotation speed. */
 };
 
 } // namespace pain
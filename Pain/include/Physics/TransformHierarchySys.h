@@ -0,0 +1,143 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * @file TransformHierarchySys.h
+ * @brief System propagating world transforms from parents to children.
+ *
+ * This system updates:
+ *  - WorldTransform2dComponent of roots, from their LocalTransform2dComponent
+ *    and, when present, their Transform2dComponent.
+ *  - WorldTransform2dComponent of children, one hierarchy level at a time.
+ *  - Transform2dComponent of children, so renderers and colliders follow them.
+ *
+ * @note As with any systems in the engine, system headers follow the naming
+ * convention and end with the suffix "Sys.h".
+ *
+ * @note As with any system, the callback execution is only enabled because the
+ * system inherits the corresponding interface:
+ *  - IOnUpdate  → enables onUpdate() callbacks.
+ *
+ * If the interface is removed, the engine will no longer invoke the associated
+ * callback.
+ */
+
+#pragma once
+#include "Assets/DeltaTime.h"
+#include "ECS/Components/ComponentManager.h"
+#include "ECS/Systems.h"
+#include "Physics/HierarchyComponent.h"
+#include "Physics/MovementComponent.h"
+
+namespace pain
+{
+namespace Systems
+{
+
+/**
+ * @brief Computes the world transform of every hierarchy node.
+ *
+ * A root is any entity with LocalTransform2dComponent and
+ * WorldTransform2dComponent but no ParentComponent. Its world matrix is its
+ * local one, placed at its Transform2dComponent position when it has one, so
+ * roots moved by Kinematics drag their children along. A child's world matrix
+ * is the world matrix of its parent times its local one. Parents must be
+ * hierarchy nodes themselves, i.e. carry a WorldTransform2dComponent.
+ *
+ * Children are stored sorted by depth (see reg::ArcheRegistry::sort), so
+ * each level is a few contiguous ranges per archetype. Levels run one after
+ * the other, the ranges of a level run on the scene thread pool. Only nodes
+ * whose local transform changed, or whose parent's matrix changed, are
+ * recomputed: a static subtree costs a flag test per node.
+ *
+ * Add this system after the ones moving roots, e.g. Kinematics.
+ *
+ * @note As with any system, the callback execution is only enabled because the
+ * system inherits the corresponding interface:
+ *  - IOnUpdate  → enables onUpdate() callbacks.
+ *
+ * @see ParentComponent
+ * @see LocalTransform2dComponent
+ * @see WorldTransform2dComponent
+ * @see System
+ * @see IOnUpdate
+ */
+struct TransformHierarchy : public System<WorldComponents>, IOnUpdate {
+  /**
+   * @brief Component tags required by this system.
+   *
+   * Declares that this system operates on entities containing:
+   *  - ParentComponent
+   *  - LocalTransform2dComponent
+   *  - WorldTransform2dComponent
+   *  - Transform2dComponent
+   */
+  using Tags = TypeList<ParentComponent,           //
+                        LocalTransform2dComponent, //
+                        WorldTransform2dComponent, //
+                        Transform2dComponent>;
+
+  /** @brief Inherit base System constructors. */
+  using System<WorldComponents>::System;
+
+  /** @brief Prevent default construction. */
+  TransformHierarchy() = delete;
+
+  /**
+   * @brief Propagates the transforms changed since the previous update.
+   *
+   * @param deltaTime Frame delta time, unused.
+   *
+   * @note This method is invoked only because the system inherits from
+   * IOnUpdate.
+   */
+  void onUpdate(DeltaTime deltaTime) override;
+
+private:
+  using ChildChunk = reg::ChunkView<const ParentComponent,           //
+                                    const LocalTransform2dComponent, //
+                                    WorldTransform2dComponent>;
+  /** @brief Rows [begin, begin + count) of a chunk, all at the same depth. */
+  struct LevelRange {
+    ChildChunk chunk;
+    size_t begin;
+    size_t count;
+  };
+
+  /**
+   * @brief Per entity index, set when the local transform or the parent
+   * changed, then kept only if the world matrix changed.
+   */
+  std::vector<std::uint8_t> m_dirty = {};
+  /** @brief Ranges of children, indexed by depth. */
+  std::vector<std::vector<LevelRange>> m_levels = {};
+  /** @brief Scratch space of updateDepths(), indexed by entity index. */
+  std::vector<std::uint32_t> m_depths = {};
+  std::vector<reg::Entity> m_chain = {};
+  /** @brief Children whose ParentComponent changed this update. */
+  std::vector<reg::Entity> m_attached = {};
+  /** @brief Queries run every update, resolved once. */
+  reg::CachedQuery<reg::Archetype<WorldComponents>, ParentComponent>
+      m_parentQuery = makeQuery<ParentComponent>();
+  reg::CachedQuery<reg::Archetype<WorldComponents>, const ParentComponent,
+                   const LocalTransform2dComponent, WorldTransform2dComponent>
+      m_childQuery = makeQuery<const ParentComponent,           //
+                               const LocalTransform2dComponent, //
+                               WorldTransform2dComponent>();
+
+  void updateDepths();
+  void setWorld(WorldTransform2dComponent &world, const glm::mat3 &matrix,
+                reg::Entity entity);
+  void markDirty(reg::Entity entity);
+  bool isDirty(reg::Entity entity) const;
+  void updateRoots();
+  void buildLevels();
+  void updateLevel(const std::vector<LevelRange> &level);
+  void writeBackPositions();
+};
+
+} // namespace Systems
+} // namespace pain
@@ -50,11 +50,13 @@
 
 #include "Physics/Collision/Collider.h"
 #include "Physics/Collision/SweepAndPruneSys.h"
+#include "Physics/HierarchyComponent.h"
 #include "Physics/KinematicsSys.h"
 #include "Physics/Movement3dComponent.h"
 #include "Physics/MovementComponent.h"
 #include "Physics/Particles/ParticleSys.h"
 #include "Physics/RotationComponent.h"
+#include "Physics/TransformHierarchySys.h"
 
 #include <SDL2/SDL_events.h>
 
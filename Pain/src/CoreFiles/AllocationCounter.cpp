@@ -0,0 +1,173 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+// Kept apart from the arena, so the replacements below are never inlined
+// into the code allocating arena blocks, which compilers report as mismatched
+// new and delete
+#include "CoreFiles/FrameArena.h"
+
+#include <atomic>
+#ifdef PAIN_COUNT_ALLOCATIONS
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+#endif
+
+namespace pain
+{
+
+// ---------------------------------------------------- //
+// Global allocation counter
+// ---------------------------------------------------- //
+
+namespace
+{
+// constant initialized, so it is ready before any static constructor allocates
+std::atomic<uint64_t> g_allocations{0};
+} // namespace
+
+uint64_t globalAllocationCount()
+{
+  return g_allocations.load(std::memory_order_relaxed);
+}
+
+} // namespace pain
+
+#ifdef PAIN_COUNT_ALLOCATIONS
+namespace
+{
+void *countedAlloc(std::size_t bytes)
+{
+  pain::g_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (bytes == 0)
+    bytes = 1;
+  for (;;) {
+    if (void *data = std::malloc(bytes))
+      return data;
+    std::new_handler handler = std::get_new_handler();
+    if (handler == nullptr)
+      throw std::bad_alloc();
+    handler();
+  }
+}
+
+void *countedAlignedAlloc(std::size_t bytes, std::align_val_t alignment)
+{
+  pain::g_allocations.fetch_add(1, std::memory_order_relaxed);
+  const std::size_t align = static_cast<std::size_t>(alignment);
+  // aligned_alloc wants a size that is a multiple of the alignment
+  bytes = (std::max<std::size_t>(bytes, 1) + align - 1) / align * align;
+  for (;;) {
+#ifdef _MSC_VER
+    if (void *data = _aligned_malloc(bytes, align))
+      return data;
+#else
+    if (void *data = std::aligned_alloc(align, bytes))
+      return data;
+#endif
+    std::new_handler handler = std::get_new_handler();
+    if (handler == nullptr)
+      throw std::bad_alloc();
+    handler();
+  }
+}
+
+void alignedFree(void *data)
+{
+#ifdef _MSC_VER
+  _aligned_free(data);
+#else
+  std::free(data);
+#endif
+}
+} // namespace
+
+// Replacements of every global operator new and delete, they only add the
+// counter to the default behaviour. All of them are replaced, so memory from
+// one version is never freed by a version the runtime, or a sanitizer, still
+// provides
+void *operator new(std::size_t bytes) { return countedAlloc(bytes); }
+void *operator new[](std::size_t bytes) { return countedAlloc(bytes); }
+void *operator new(std::size_t bytes, const std::nothrow_t &) noexcept
+{
+  try {
+    return countedAlloc(bytes);
+  } catch (...) {
+    return nullptr;
+  }
+}
+void *operator new[](std::size_t bytes, const std::nothrow_t &) noexcept
+{
+  return operator new(bytes, std::nothrow);
+}
+
+void operator delete(void *data) noexcept { std::free(data); }
+void operator delete[](void *data) noexcept { std::free(data); }
+void operator delete(void *data, std::size_t) noexcept { std::free(data); }
+void operator delete[](void *data, std::size_t) noexcept { std::free(data); }
+void operator delete(void *data, const std::nothrow_t &) noexcept
+{
+  std::free(data);
+}
+void operator delete[](void *data, const std::nothrow_t &) noexcept
+{
+  std::free(data);
+}
+
+// Over-aligned versions
+void *operator new(std::size_t bytes, std::align_val_t alignment)
+{
+  return countedAlignedAlloc(bytes, alignment);
+}
+void *operator new[](std::size_t bytes, std::align_val_t alignment)
+{
+  return countedAlignedAlloc(bytes, alignment);
+}
+void *operator new(std::size_t bytes, std::align_val_t alignment,
+                   const std::nothrow_t &) noexcept
+{
+  try {
+    return countedAlignedAlloc(bytes, alignment);
+  } catch (...) {
+    return nullptr;
+  }
+}
+void *operator new[](std::size_t bytes, std::align_val_t alignment,
+                     const std::nothrow_t &) noexcept
+{
+  return operator new(bytes, alignment, std::nothrow);
+}
+
+void operator delete(void *data, std::align_val_t) noexcept
+{
+  alignedFree(data);
+}
+void operator delete[](void *data, std::align_val_t) noexcept
+{
+  alignedFree(data);
+}
+void operator delete(void *data, std::size_t, std::align_val_t) noexcept
+{
+  alignedFree(data);
+}
+void operator delete[](void *data, std::size_t, std::align_val_t) noexcept
+{
+  alignedFree(data);
+}
+void operator delete(void *data, std::align_val_t,
+                     const std::nothrow_t &) noexcept
+{
+  alignedFree(data);
+}
+void operator delete[](void *data, std::align_val_t,
+                       const std::nothrow_t &) noexcept
+{
+  alignedFree(data);
+}
+#endif
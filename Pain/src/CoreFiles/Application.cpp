@@ -97,9 +97,10 @@ Application::Application(sol::state &&luaState, SDL_Window *window,
                          AppContext &&context)
     : m{.context = context}, m_renderers{Renderer2d::createRenderer2d(),
                                          Renderer3d::createRenderer3d()},
-      m_threadPool(ThreadPool{}), m_luaState(std::move(luaState)),
-      m_eventDispatcher(m_luaState),
-      m_worldScene(Scene::create(m_eventDispatcher, m_luaState, m_threadPool)),
+      m_threadPool(ThreadPool{}), m_frameArena(m_threadPool),
+      m_luaState(std::move(luaState)), m_eventDispatcher(m_luaState),
+      m_worldScene(Scene::create(m_eventDispatcher, m_luaState, m_threadPool,
+                                 m_frameArena)),
       m_endGameFlags(), m_window(window), m_sdlContext(sdlContext),
       m_renderPipeline(fbci.swapChainTarget
                            ? RenderPipeline::create(m_eventDispatcher)
@@ -120,7 +121,7 @@ void Application::ensureCamera()
       !m_renderers.renderer3d.hasCamera()) {
     PLOG_I("Camera is missing, searching for 2d camera component");
     bool hasCameraComponent = false;
-    for (auto &chunk : m_worldScene.query<cmp::OrthoCamera>()) {
+    for (auto chunk : m_worldScene.query<cmp::OrthoCamera>()) {
       auto *c = std::get<0>(chunk.arrays);
       for (size_t i = 0; i < chunk.count; i++) {
         hasCameraComponent = true;
@@ -128,7 +129,7 @@ void Application::ensureCamera()
                             m.context.defaultHeight);
       }
     }
-    for (auto &chunk : m_worldScene.query<cmp::PerspCamera>()) {
+    for (auto chunk : m_worldScene.query<cmp::PerspCamera>()) {
       auto *c = std::get<0>(chunk.arrays);
       for (size_t i = 0; i < chunk.count; i++) {
         hasCameraComponent = true;
@@ -166,6 +167,15 @@ EndGameFlags Application::run()
     DeltaTime deltaTime = frameTimer.tick();
     uint64_t elapsedTime = frameTimer.elapsedNanos();
 
+    // =============================================================== //
+    // Start a new frame, memory of the frame arena is released
+    // =============================================================== //
+    const uint64_t allocated = globalAllocationCount();
+    m.frameAllocations = allocated - m.frameStartAllocations;
+    m.frameStartAllocations = allocated;
+    m.frameArenaBytes = m_frameArena.stats().bytesUsed;
+    m_frameArena.reset();
+
     // =============================================================== //
     // Calculate FPS sample
     // =============================================================== //
@@ -185,6 +195,13 @@ EndGameFlags Application::run()
         const std::string fps = "FPS: " + std::to_string(currentTPS);
         ImGui::TextColored(ImVec4(1, 1, 0, 1), "%s", fps.c_str());
       });
+      auto frameMemory = [allocations = m.frameAllocations,
+                          arenaBytes = m.frameArenaBytes]() {
+        ImGui::Text("Heap allocations: %llu",
+                    static_cast<unsigned long long>(allocations));
+        ImGui::Text("Frame arena: %zu bytes", arenaBytes);
+      };
+      IMGUI_PLOG_NAME("Frame memory", frameMemory);
     }
 
     // =============================================================== //
@@ -232,6 +249,16 @@ EndGameFlags Application::run()
       }
     }
 
+    // =============================================================== //
+    // Apply structural changes recorded during updates and events
+    // =============================================================== //
+    {
+      PROFILE_SCOPE("Application::run - Playback Commands");
+      m_worldScene.playbackCommands();
+      if (m_uiScene != nullptr)
+        m_uiScene->playbackCommands();
+    }
+
     // =============================================================== //
     // Handle rendering
     // =============================================================== //
@@ -0,0 +1,144 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include "CoreFiles/FrameArena.h"
+#include "CoreFiles/ThreadPool.h"
+
+#include <algorithm>
+
+namespace pain
+{
+
+// ---------------------------------------------------- //
+// Sub-arena
+// ---------------------------------------------------- //
+
+// Bump allocator over one block. When the block is full, extra blocks are
+// taken from the heap until the reset, which replaces everything with a single
+// block holding the whole frame. Aligned on a cache line, so threads bumping
+// their own sub-arena don't share one
+class alignas(64) FrameArena::Block final : public std::pmr::memory_resource
+{
+public:
+  explicit Block(size_t bytes)
+      : m_memory(new std::byte[bytes]), m_capacity(bytes),
+        m_current(m_memory.get()), m_currentCapacity(bytes)
+  {
+  }
+
+  void reset()
+  {
+    if (!m_extra.empty()) {
+      m_capacity += m_extraBytes;
+      m_memory.reset(new std::byte[m_capacity]);
+      ++m_heapAllocations;
+      m_extra.clear();
+      m_extraBytes = 0;
+    }
+    m_current = m_memory.get();
+    m_currentCapacity = m_capacity;
+    m_offset = 0;
+    m_used = 0;
+  }
+
+  void addStats(Stats &stats) const
+  {
+    stats.bytesUsed += m_used;
+    stats.bytesReserved += m_capacity + m_extraBytes;
+    stats.heapAllocations += m_heapAllocations;
+  }
+
+private:
+  std::unique_ptr<std::byte[]> m_memory;
+  size_t m_capacity;
+  // block being bumped, m_memory or the last extra block
+  std::byte *m_current;
+  size_t m_currentCapacity;
+  size_t m_offset = 0;
+  std::vector<std::unique_ptr<std::byte[]>> m_extra = {};
+  size_t m_extraBytes = 0;
+  size_t m_used = 0;
+  size_t m_heapAllocations = 1;
+
+  void *do_allocate(size_t bytes, size_t alignment) override
+  {
+    size_t padding = paddingAt(m_current + m_offset, alignment);
+    if (m_offset + padding + bytes > m_currentCapacity) {
+      // each extra block at least doubles what the frame can hold
+      const size_t size =
+          std::max(bytes + alignment, m_capacity + m_extraBytes);
+      m_extra.emplace_back(new std::byte[size]);
+      ++m_heapAllocations;
+      m_extraBytes += size;
+      m_current = m_extra.back().get();
+      m_currentCapacity = size;
+      m_offset = 0;
+      padding = paddingAt(m_current, alignment);
+    }
+    void *data = m_current + m_offset + padding;
+    m_offset += padding + bytes;
+    m_used += bytes;
+    return data;
+  }
+  // memory is only given back by reset
+  void do_deallocate(void *, size_t, size_t) override {}
+  bool do_is_equal(const std::pmr::memory_resource &other) const
+      noexcept override
+  {
+    return this == &other;
+  }
+
+  static size_t paddingAt(const std::byte *address, size_t alignment)
+  {
+    const uintptr_t value = reinterpret_cast<uintptr_t>(address);
+    return (alignment - value % alignment) % alignment;
+  }
+};
+
+// ---------------------------------------------------- //
+// Arena
+// ---------------------------------------------------- //
+
+FrameArena::FrameArena(const ThreadPool &pool, size_t blockBytes)
+    : m_pool(pool)
+{
+  // the workers and the thread owning the pool
+  m_blocks.reserve(pool.size() + 1);
+  for (size_t i = 0; i < pool.size() + 1; ++i)
+    m_blocks.push_back(std::make_unique<Block>(blockBytes));
+}
+
+FrameArena::~FrameArena() = default;
+
+std::pmr::memory_resource *FrameArena::resource()
+{
+  return resource(m_pool.threadIndex());
+}
+
+std::pmr::memory_resource *FrameArena::resource(size_t thread)
+{
+  // a thread outside the pool, e.g. a worker of another pool, can't share a
+  // sub-arena without a lock. It gets the heap, visible in the counter
+  if (thread == ThreadPool::NotInPool || thread >= m_blocks.size())
+    return std::pmr::new_delete_resource();
+  return m_blocks[thread].get();
+}
+
+void FrameArena::reset()
+{
+  for (std::unique_ptr<Block> &block : m_blocks)
+    block->reset();
+}
+
+FrameArena::Stats FrameArena::stats() const
+{
+  Stats stats;
+  for (const std::unique_ptr<Block> &block : m_blocks)
+    block->addStats(stats);
+  return stats;
+}
+
+} // namespace pain
@@ -48,7 +48,7 @@ void RenderPipeline::subscribeToViewportChange(Scene &scene)
   m_eventDispatcher.subscribe<ImGuiViewportChangeEvent>(
       [&](const ImGuiViewportChangeEvent &e) {
         auto chunks = scene.query<Component::OrthoCamera>();
-        for (auto &chunk : chunks) {
+        for (auto chunk : chunks) {
           auto *c = std::get<0>(chunk.arrays);
 
           for (size_t i = 0; i < chunk.count; ++i) {
@@ -100,7 +100,7 @@ void RenderPipeline::onWindowResized(const SDL_Event &event,
 {
   {
     auto chunks = scene.query<Component::OrthoCamera>();
-    for (auto &chunk : chunks) {
+    for (auto chunk : chunks) {
       auto *c = std::get<0>(chunk.arrays);
 
       for (size_t i = 0; i < chunk.count; ++i) {
@@ -114,7 +114,7 @@ void RenderPipeline::onWindowResized(const SDL_Event &event,
   }
   {
     auto chunks = scene.query<Component::PerspCamera>();
-    for (auto &chunk : chunks) {
+    for (auto chunk : chunks) {
       auto *c = std::get<0>(chunk.arrays);
 
       for (size_t i = 0; i < chunk.count; ++i) {
@@ -6,7 +6,16 @@
 
 #include "CoreFiles/ThreadPool.h"
 
+namespace
+{
+// pool the calling thread works for, and its index there. Threads no pool
+// started keep the sentinel
+thread_local const ThreadPool *t_pool = nullptr;
+thread_local size_t t_threadIndex = ThreadPool::NotInPool;
+} // namespace
+
 ThreadPool::ThreadPool(size_t threadCount)
+    : m_owner(std::this_thread::get_id())
 {
   if (threadCount == 0)
     threadCount = 1;
@@ -16,7 +25,7 @@ ThreadPool::ThreadPool(size_t threadCount)
     threadCount -= 1;
 
   for (size_t i = 0; i < threadCount; ++i) {
-    m_workers.emplace_back(&ThreadPool::workerLoop, this);
+    m_workers.emplace_back(&ThreadPool::workerLoop, this, i);
   }
 }
 
@@ -45,6 +54,13 @@ void ThreadPool::enqueue(Job job)
   m_cv.notify_one();
 }
 
+size_t ThreadPool::threadIndex() const
+{
+  if (t_pool == this)
+    return t_threadIndex;
+  return std::this_thread::get_id() == m_owner ? 0 : NotInPool;
+}
+
 void ThreadPool::wait()
 {
   std::unique_lock lock(m_mutex);
@@ -52,15 +68,86 @@ void ThreadPool::wait()
                 [this] { return m_jobs.empty() && m_activeJobs.load() == 0; });
 }
 
-void ThreadPool::workerLoop()
+void ThreadPool::runParallel(size_t count, ParallelJob job)
+{
+  if (count == 0)
+    return;
+  ParallelRun run{job, count};
+  bool published = false;
+  if (count > 1 && !m_workers.empty()) {
+    std::lock_guard lock(m_mutex);
+    // one run at a time, a nested or concurrent call works alone
+    if (m_parallel == nullptr) {
+      m_parallel = &run;
+      ++m_parallelGeneration;
+      published = true;
+    }
+  }
+  if (!published) {
+    if (std::exception_ptr error = drain(run))
+      std::rethrow_exception(error);
+    return;
+  }
+  m_cv.notify_all();
+  std::exception_ptr error = drain(run);
+
+  // every index is taken, wait for the workers still running one. run lives
+  // on this stack, so no worker may touch it once this returns, even when a
+  // job threw
+  {
+    std::unique_lock lock(m_mutex);
+    m_parallel = nullptr;
+    m_doneCv.wait(lock, [&run] { return run.helpers == 0; });
+  }
+  if (error == nullptr)
+    error = run.error;
+  if (error != nullptr)
+    std::rethrow_exception(error);
+}
+
+std::exception_ptr ThreadPool::drain(ParallelRun &run)
+{
+  try {
+    for (size_t i = run.next++; i < run.count; i = run.next++)
+      run.job.call(run.job.fn, i);
+  } catch (...) {
+    // the indices left are skipped
+    run.next = run.count;
+    return std::current_exception();
+  }
+  return nullptr;
+}
+
+void ThreadPool::workerLoop(size_t index)
 {
+  t_pool = this;
+  t_threadIndex = index + 1;
+  uint64_t joined = 0;
   for (;;) {
     Job job;
 
     {
       std::unique_lock lock(m_mutex);
 
-      m_cv.wait(lock, [this] { return m_stopping || !m_jobs.empty(); });
+      auto canJoin = [&] {
+        return m_parallel != nullptr && m_parallelGeneration != joined;
+      };
+      m_cv.wait(lock,
+                [&] { return m_stopping || !m_jobs.empty() || canJoin(); });
+
+      if (canJoin()) {
+        ParallelRun &run = *m_parallel;
+        joined = m_parallelGeneration;
+        ++run.helpers;
+        lock.unlock();
+        std::exception_ptr error = drain(run);
+        lock.lock();
+        if (error != nullptr && run.error == nullptr)
+          run.error = error;
+        if (--run.helpers == 0)
+          m_doneCv.notify_all();
+        continue;
+      }
 
       if (m_stopping && m_jobs.empty())
         return;
@@ -16,6 +16,37 @@ namespace pain
 {
 namespace Systems
 {
+namespace
+{
+const std::array<glm::vec2, 4> WholeTexture = {
+    glm::vec2(0.0f, 0.0f), glm::vec2(1.0f, 0.0f), glm::vec2(1.0f, 1.0f),
+    glm::vec2(0.0f, 1.0f)};
+
+// Every sprite of a view has the same material, so its texture is resolved
+// once for the whole view. r is null for sprites without rotation
+template <typename Chunk>
+void drawBatchedSprites(Renderer2d &renderer2d, const Chunk &chunk,
+                        const RotationComponent *r)
+{
+  const Transform2dComponent *t = std::get<0>(chunk.arrays);
+  const BatchedSpriteComponent *s = std::get<1>(chunk.arrays);
+  const SpriteMaterialComponent &material = std::get<2>(chunk.arrays)[0];
+  const float texIndex = renderer2d.textureIndex(*material.m_texture);
+  for (size_t i = 0; i < chunk.count; ++i) {
+    const std::array<glm::vec2, 4> &coords =
+        material.m_sheet != nullptr ? (*material.m_sheet)[s[i].m_sheetId]
+                                    : WholeTexture;
+    if (r != nullptr)
+      renderer2d.drawQuad(t[i].m_position, s[i].m_size, s[i].color,
+                          r[i].m_rotationAngle, material.layer, texIndex,
+                          material.m_tilingFactor, coords);
+    else
+      renderer2d.drawQuad(t[i].m_position, s[i].m_size, s[i].color,
+                          material.layer, texIndex, material.m_tilingFactor,
+                          coords);
+  }
+}
+} // namespace
 
 // =============================================================== //
 // Render Components
@@ -31,7 +62,7 @@ void Render::onRender(Renderers &renderer, bool isMinimized,
 
     auto chunks =
         queryConst<Transform2dComponent, SpriteComponent, RotationComponent>();
-    for (auto &chunk : chunks) {
+    for (auto chunk : chunks) {
       auto *t = std::get<0>(chunk.arrays);
       auto *s = std::get<1>(chunk.arrays);
       auto *r = std::get<2>(chunk.arrays);
@@ -60,7 +91,7 @@ void Render::onRender(Renderers &renderer, bool isMinimized,
     PROFILE_SCOPE("Scene::renderSystems - texture quads");
     auto chunks = queryConst<Transform2dComponent, SpriteComponent>(
         exclude<RotationComponent>);
-    for (auto &chunk : chunks) {
+    for (auto chunk : chunks) {
       auto *t = std::get<0>(chunk.arrays);
       auto *s = std::get<1>(chunk.arrays);
       for (size_t i = 0; i < chunk.count; ++i) {
@@ -82,10 +113,20 @@ void Render::onRender(Renderers &renderer, bool isMinimized,
       }
     }
   }
+  {
+    PROFILE_SCOPE("Scene::renderSystems - batched sprites");
+    for (auto chunk : queryConst<Transform2dComponent, BatchedSpriteComponent,
+                                 SpriteMaterialComponent, RotationComponent>())
+      drawBatchedSprites(renderer.renderer2d, chunk, std::get<3>(chunk.arrays));
+    for (auto chunk : queryConst<Transform2dComponent, BatchedSpriteComponent,
+                                 SpriteMaterialComponent>(
+             exclude<RotationComponent>))
+      drawBatchedSprites(renderer.renderer2d, chunk, nullptr);
+  }
   {
     PROFILE_SCOPE("Scene::renderSystems - spriteless quads");
     auto chunks = queryConst<Transform2dComponent, SpritelessComponent>();
-    for (auto &chunk : chunks) {
+    for (auto chunk : chunks) {
       auto *t = std::get<0>(chunk.arrays);
       auto *s = std::get<1>(chunk.arrays);
       for (size_t i = 0; i < chunk.count; ++i) {
@@ -109,7 +150,7 @@ void Render::onRender(Renderers &renderer, bool isMinimized,
   {
     PROFILE_SCOPE("Scene::renderSystems - triangles");
     auto chunks = queryConst<Transform2dComponent, TrianguleComponent>();
-    for (auto &chunk : chunks) {
+    for (auto chunk : chunks) {
       auto *t = std::get<0>(chunk.arrays);
       auto *tri = std::get<1>(chunk.arrays);
       for (size_t i = 0; i < chunk.count; ++i) {
@@ -133,6 +133,25 @@ void Renderer2d::drawQuad(const glm::vec2 &position, const glm::vec2 &size,
                           const Color &tintColor, RenderLayer layer,
                           Texture &texture, float tilingFactor,
                           const std::array<glm::vec2, 4> &textureCoordinate)
+{
+  drawQuad(position, size, tintColor, layer, allocateTextures(texture),
+           tilingFactor, textureCoordinate);
+}
+
+void Renderer2d::drawQuad(const glm::vec2 &position, const glm::vec2 &size,
+                          const Color &tintColor, const float rotationRadians,
+                          RenderLayer layer, Texture &texture,
+                          float tilingFactor,
+                          const std::array<glm::vec2, 4> &textureCoordinate)
+{
+  drawQuad(position, size, tintColor, rotationRadians, layer,
+           allocateTextures(texture), tilingFactor, textureCoordinate);
+}
+
+void Renderer2d::drawQuad(const glm::vec2 &position, const glm::vec2 &size,
+                          const Color &tintColor, RenderLayer layer,
+                          float texIndex, float tilingFactor,
+                          const std::array<glm::vec2, 4> &textureCoordinate)
 {
   PROFILE_FUNCTION();
   QuadBatch &batch = m.quadBatches[static_cast<uint8_t>(layer)];
@@ -142,7 +161,6 @@ void Renderer2d::drawQuad(const glm::vec2 &position, const glm::vec2 &size,
     batch.resetPtr();
   }
 
-  const float texIndex = allocateTextures(texture);
   const glm::mat4 transform = getTransform(position, size);
   batch.allocateQuad(transform, tintColor, tilingFactor, texIndex,
                      textureCoordinate);
@@ -150,7 +168,7 @@ void Renderer2d::drawQuad(const glm::vec2 &position, const glm::vec2 &size,
 
 void Renderer2d::drawQuad(const glm::vec2 &position, const glm::vec2 &size,
                           const Color &tintColor, const float rotationRadians,
-                          RenderLayer layer, Texture &texture,
+                          RenderLayer layer, float texIndex,
                           float tilingFactor,
                           const std::array<glm::vec2, 4> &textureCoordinate)
 {
@@ -162,7 +180,6 @@ void Renderer2d::drawQuad(const glm::vec2 &position, const glm::vec2 &size,
     batch.resetPtr();
   }
 
-  const float texIndex = allocateTextures(texture);
   const glm::mat4 transform = getTransform(position, size, rotationRadians);
   batch.allocateQuad(transform, tintColor, tilingFactor, texIndex,
                      textureCoordinate);
@@ -14,7 +14,6 @@
 #include "GUI/ImGuiSys.h"
 #include "Misc/Events.h"
 #include "Physics/Collision/Collider.h"
-#include "Physics/Collision/SweepAndPruneSys.h"
 #include "Physics/MovementComponent.h"
 #include "Physics/RotationComponent.h"
 #include "Scripting/LuaScriptComponent.h"
@@ -26,10 +25,16 @@
 
 namespace
 {
-struct LuaComponentDesc {
-  reg::Bitmask bit;
-  std::function<void(reg::Entity, reg::Bitmask)> emplace;
-  std::function<void(reg::Entity)> onEmplace = nullptr;
+template <reg::CompileTimeBitMaskType Manager> struct LuaComponentDesc {
+  using Bitmask = typename Manager::Bitmask;
+  Bitmask bit;
+  // size of the component, an entity row is the sum of its descriptors
+  std::size_t rowBytes;
+  std::function<void(reg::Entity, Bitmask)> emplace;
+  // the component in a prefab row, and how to build it in place there. Null
+  // construct for components that can't be copied into a prefab
+  typename reg::Prefab<Manager>::Field field;
+  std::function<void(void *slot)> construct;
 };
 } // namespace
 namespace pain
@@ -38,35 +43,63 @@ namespace pain
 // event - lua bridge
 // ------------------------------------------------
 
-// Allow components to have logic when they are added (to an entity)
-template <typename Component, reg::CompileTimeBitMaskType Manager>
-void onComponentAdded(AbstractScene<Manager> &scene, reg::Entity entity)
-{
-  if constexpr (std::is_same_v<Component, SAPCollider>) {
-    Systems::SweepAndPruneSys *s =
-        scene.template getSys<Systems::SweepAndPruneSys>();
-    if (s) {
-      s->insertCollider(entity);
-    } else {
-      PLOG_W(
-          "You are trying to create Sweep and Prune component without adding "
-          "a proper Sweep and Prune system");
-    }
-  }
-}
-
 // add component to an already existing archetype
 template <typename T, reg::CompileTimeBitMaskType Manager>
 void pushComponentInto(reg::ArcheRegistry<Manager> &registry,
-                       reg::Entity entity, reg::Bitmask bitmask, T &&t)
+                       reg::Entity entity, typename Manager::Bitmask bitmask,
+                       T &&t)
 {
   registry.manualPush(entity, bitmask, std::move(t));
 }
 
+// Descriptor of the component C returned by make, either pushed onto an
+// entity or built straight into the row of a prefab
+template <typename C, reg::CompileTimeBitMaskType Manager, typename MakeFn>
+LuaComponentDesc<Manager>
+describeComponent(reg::ArcheRegistry<Manager> &registry, MakeFn make)
+{
+  using Bitmask = typename Manager::Bitmask;
+  constexpr std::size_t component = Manager::template componentIndex<C>();
+  LuaComponentDesc<Manager> desc{
+      Bitmask::bit(component), sizeof(C),
+      [&registry, make](reg::Entity e, Bitmask b) {
+        registry.manualPush(e, b, make());
+      },
+      {component, 0, &reg::Archetype<Manager>::template columnOpsOf<C>},
+      nullptr};
+  if constexpr (std::is_copy_constructible_v<C>)
+    desc.construct = [make](void *slot) { reg::copyIntoPrefab(slot, make()); };
+  return desc;
+}
+
+// Components a prefab file loaded from Lua may hold, the plain data ones of
+// the bindings below
+template <reg::CompileTimeBitMaskType Manager> auto luaPrefabComponents()
+{
+  using Prefab = reg::Prefab<Manager>;
+  std::array<const typename Prefab::ColumnOps *, Prefab::NumberOfColumns>
+      table = {};
+  auto add = [&table]<typename C>() {
+    if constexpr (Manager::template isRegistered<C>()) {
+      static_assert(std::is_trivially_copyable_v<C> && reg::HasLayoutId<C>);
+      table[Manager::template componentIndex<C>()] =
+          &reg::Archetype<Manager>::template columnOpsOf<C>;
+    }
+  };
+  add.template operator()<Transform2dComponent>();
+  add.template operator()<Movement2dComponent>();
+  add.template operator()<RotationComponent>();
+  add.template operator()<SAPCollider>();
+  return table;
+}
+
 template <reg::CompileTimeBitMaskType Manager>
 void AbstractScene<Manager>::addEntityFunctions(const char *sceneName,
                                                 sol::state &lua)
 {
+  using Bitmask = typename Manager::Bitmask;
+  using ComponentDesc = LuaComponentDesc<Manager>;
+
   // ------------------------------------------------------------
   //  Spriteless Component bind
   // ------------------------------------------------------------
@@ -77,31 +110,20 @@ void AbstractScene<Manager>::addEntityFunctions(const char *sceneName,
         "Spriteless",
         sol::overload(
             [&](glm::vec2 size, sol::optional<Color> oColor) {
-              return LuaComponentDesc{
-                  getSingleBitmask<SpritelessComponent>(),
-                  [=, this](reg::Entity e, reg::Bitmask b) {
-                    if (oColor) {
-                      m_registry.manualPush(
-                          e, b, SpritelessComponent::createQuad(size, *oColor));
-                    } else {
-                      m_registry.manualPush(
-                          e, b, SpritelessComponent::createQuad(size));
-                    }
-                  }};
+              return describeComponent<SpritelessComponent>(
+                  m_registry, [=]() {
+                    return oColor
+                               ? SpritelessComponent::createQuad(size, *oColor)
+                               : SpritelessComponent::createQuad(size);
+                  });
             },
             [&](float radius, sol::optional<Color> oColor) {
-              return LuaComponentDesc{
-                  getSingleBitmask<SpritelessComponent>(),
-                  [=, this](reg::Entity e, reg::Bitmask b) {
-                    if (oColor) {
-                      m_registry.manualPush(
-                          e, b,
-                          SpritelessComponent::createCircle(radius, *oColor));
-                    } else {
-                      m_registry.manualPush(
-                          e, b, SpritelessComponent::createCircle(radius));
-                    }
-                  }};
+              return describeComponent<SpritelessComponent>(
+                  m_registry, [=]() {
+                    return oColor ? SpritelessComponent::createCircle(radius,
+                                                                      *oColor)
+                                  : SpritelessComponent::createCircle(radius);
+                  });
             }));
   // ------------------------------------------------------------
   //  Sprite Component bind
@@ -112,51 +134,40 @@ void AbstractScene<Manager>::addEntityFunctions(const char *sceneName,
         sol::overload(
             [&](const char *path, sol::optional<glm::vec2> oSize) {
               glm::vec2 size = oSize.value_or(glm::vec2{0.1f, 0.1f});
-              return LuaComponentDesc{
-                  getSingleBitmask<SpriteComponent>(),
-                  [=, this](reg::Entity e, reg::Bitmask b) { //
-                    m_registry.manualPush(
-                        e, b, SpriteComponent::create({.m_size = size}, path));
-                  }};
+              return describeComponent<SpriteComponent>(
+                  m_registry, [=]() { //
+                    return SpriteComponent::create({.m_size = size}, path);
+                  });
             },
             [&](const char *path, unsigned short id,
                 sol::optional<glm::vec2> oSize) {
               glm::vec2 size = oSize.value_or(glm::vec2{0.1f, 0.1f});
-              return LuaComponentDesc{
-                  getSingleBitmask<SpriteComponent>(),
-                  [=, this](reg::Entity e, reg::Bitmask b) {
-                    m_registry.manualPush(
-                        e, b,
-                        SpriteComponent::create({.m_size = size}, path, id));
-                  }};
+              return describeComponent<SpriteComponent>(m_registry, [=]() {
+                return SpriteComponent::create({.m_size = size}, path, id);
+              });
             }));
   // ------------------------------------------------------------
   //  Movement2d Component bind
   // ------------------------------------------------------------
   if constexpr (Manager::template isRegistered<Movement2dComponent>())
-    scene["Movement2d"] = [&](sol::optional<glm::vec2> oVel,
-                              sol::optional<float> oRotationSpeed) {
-      float rotationSpeed = oRotationSpeed.value_or(1.f);
+    scene["Movement2d"] = [&](sol::optional<glm::vec2> oVel) {
       glm::vec2 vel = oVel.value_or(glm::vec2(0.f, 0.f));
-      return LuaComponentDesc{
-          getSingleBitmask<Movement2dComponent>(),
-          [vel, rotationSpeed, this](reg::Entity e, reg::Bitmask b) {
-            m_registry.manualPush(e, b,
-                                  Movement2dComponent{vel, rotationSpeed});
-          }};
+      return describeComponent<Movement2dComponent>(
+          m_registry, [vel]() { return Movement2dComponent{vel}; });
     };
   // ------------------------------------------------------------
   //  Rotation Component bind
   // ------------------------------------------------------------
   if constexpr (Manager::template isRegistered<RotationComponent>())
-    scene["Rotation"] = [&](sol::optional<float> oInitialAngle) { //
+    scene["Rotation"] = [&](sol::optional<float> oInitialAngle,
+                            sol::optional<float> oRotationSpeed) { //
       float rot = oInitialAngle.value_or(1.f);
-      return LuaComponentDesc{
-          getSingleBitmask<Transform2dComponent>(),
-          [rot, this](reg::Entity e, reg::Bitmask b) {
-            m_registry.manualPush(e, b, RotationComponent{rot});
-          } //
-      };
+      float rotationSpeed = oRotationSpeed.value_or(1.f);
+      return describeComponent<RotationComponent>(
+          m_registry, [rot, rotationSpeed]() {
+            return RotationComponent{.m_rotationAngle = rot,
+                                     .m_rotationSpeed = rotationSpeed};
+          });
     };
 
   // ------------------------------------------------------------
@@ -165,12 +176,8 @@ void AbstractScene<Manager>::addEntityFunctions(const char *sceneName,
   if constexpr (Manager::template isRegistered<Transform2dComponent>())
     scene["Transform2d"] = [&](sol::optional<glm::vec2> oPos) { //
       glm::vec2 pos = oPos.value_or(glm::vec2(0.f, 0.f));
-      return LuaComponentDesc{
-          getSingleBitmask<Transform2dComponent>(),
-          [pos, this](reg::Entity e, reg::Bitmask b) {
-            m_registry.manualPush(e, b, Transform2dComponent{pos});
-          } //
-      };
+      return describeComponent<Transform2dComponent>(
+          m_registry, [pos]() { return Transform2dComponent{pos}; });
     };
   // ------------------------------------------------------------
   //  Sweep and Prune Component bind
@@ -184,15 +191,9 @@ void AbstractScene<Manager>::addEntityFunctions(const char *sceneName,
               bool isTrigger = oTrigger.value_or(false);
               glm::vec2 offset = oOffset.value_or(glm::vec2{0.f, 0.f});
 
-              return LuaComponentDesc{
-                  getSingleBitmask<SAPCollider>(),
-                  [=, this](reg::Entity e, reg::Bitmask b) {
-                    m_registry.manualPush(
-                        e, b, SAPCollider::createAABB(size, isTrigger, offset));
-                  },
-                  [this](reg::Entity e) {
-                    onComponentAdded<SAPCollider>(*this, e);
-                  }};
+              return describeComponent<SAPCollider>(m_registry, [=]() {
+                return SAPCollider::createAABB(size, isTrigger, offset);
+              });
             },
 
             [&](float radius, sol::optional<bool> oTrigger,
@@ -200,39 +201,95 @@ void AbstractScene<Manager>::addEntityFunctions(const char *sceneName,
               bool isTrigger = oTrigger.value_or(false);
               glm::vec2 offset = oOffset.value_or(glm::vec2{0.f, 0.f});
 
-              return LuaComponentDesc{
-                  getSingleBitmask<SAPCollider>(),
-                  [=, this](reg::Entity e, reg::Bitmask b) {
-                    m_registry.manualPush(
-                        e, b,
-                        SAPCollider::createCircle(radius, isTrigger, offset));
-                  },
-                  [this](reg::Entity e) {
-                    onComponentAdded<SAPCollider>(*this, e);
-                  }};
+              return describeComponent<SAPCollider>(m_registry, [=]() {
+                return SAPCollider::createCircle(radius, isTrigger, offset);
+              });
             }));
   // scene.new_usertype<LuaComponentDesc>("Component", sol::no_constructor);
   scene["create_entity"] = [&](sol::table components) {
-    reg::Bitmask archetype{};
+    Bitmask archetype{};
+    std::size_t rowBytes = 0;
 
     for (const auto &kv : components) {
-      const auto &d = kv.second.as<LuaComponentDesc>();
+      const auto &d = kv.second.as<ComponentDesc>();
       archetype |= d.bit;
+      rowBytes += d.rowBytes;
     }
+    // the components are pushed one at a time, so the archetype is told the
+    // size of the whole row before the first one
+    m_registry.declareRowBytes(archetype, rowBytes);
 
     reg::Entity e = m_registry.createEntity(archetype);
 
     for (auto &kv : components) {
-      auto &d = kv.second.as<LuaComponentDesc>();
+      auto &d = kv.second.as<ComponentDesc>();
       d.emplace(e, archetype);
     }
-    for (auto &kv : components) {
-      auto &d = kv.second.as<LuaComponentDesc>();
-      if (d.onEmplace)
-        d.onEmplace(e);
-    }
     return e;
   };
+  // ------------------------------------------------------------
+  //  Prefabs
+  // ------------------------------------------------------------
+  // Components are marshalled once, built straight into the row of the
+  // prefab. No entity is made for it, so observers aren't told about it.
+  // Instances are then copied from its row without going through Lua
+  using Prefab = reg::Prefab<Manager>;
+  scene["prefab"] = [](sol::table components) {
+    std::vector<typename Prefab::Field> fields;
+    std::array<std::function<void(void *)>, Prefab::NumberOfColumns>
+        constructs = {};
+    for (const auto &kv : components) {
+      const auto &d = kv.second.as<ComponentDesc>();
+      if (!d.construct) {
+        PLOG_W("Component {} can't be copied, it is left out of the prefab",
+               d.field.component);
+        continue;
+      }
+      fields.push_back(d.field);
+      constructs[d.field.component] = d.construct;
+    }
+    return Prefab::assemble(
+        std::move(fields),
+        [&constructs](const typename Prefab::Field &field, void *slot) {
+          constructs[field.component](slot);
+        });
+  };
+  // positions, a table of vec2, overrides the Transform2d of each instance
+  scene["instantiate"] = [&](const Prefab &prefab, std::size_t count,
+                             sol::optional<sol::table> oPositions) {
+    std::vector<reg::Entity> entities;
+    if constexpr (Manager::template isRegistered<Transform2dComponent>()) {
+      if (oPositions && prefab.template has<Transform2dComponent>()) {
+        std::vector<Transform2dComponent> transforms(
+            count, prefab.template get<Transform2dComponent>());
+        for (std::size_t i = 0; i < count; ++i)
+          transforms[i].m_position =
+              oPositions->get_or(i + 1, transforms[i].m_position);
+        entities = m_registry.instantiate(prefab, count, std::span(transforms));
+      }
+    }
+    if (entities.empty())
+      entities = m_registry.instantiate(prefab, count);
+    return sol::as_table(std::move(entities));
+  };
+  scene["save_prefab"] = [](const Prefab &prefab, const std::string &path) {
+    return prefab.save(path);
+  };
+  scene["load_prefab"] = [](const char *path) -> sol::optional<Prefab> {
+    reg::SnapshotFile file(path);
+    if (file.bytes().empty())
+      return sol::nullopt;
+    std::optional<Prefab> prefab =
+        Prefab::load(file.bytes(), luaPrefabComponents<Manager>());
+    if (!prefab)
+      return sol::nullopt;
+    return std::move(*prefab);
+  };
+  // pausing keeps the id valid on the Lua side, unlike removing
+  scene["set_enabled"] = [&](reg::Entity e, bool enabled) {
+    m_registry.setEnabled(e, enabled);
+  };
+  scene["is_enabled"] = [&](reg::Entity e) { return m_registry.isEnabled(e); };
   lua[sceneName] = scene;
 }
 
@@ -286,6 +343,14 @@ void AbstractScene<Manager>::flushMainThreadJobs()
   }
 }
 
+template <reg::CompileTimeBitMaskType Manager>
+void AbstractScene<Manager>::playbackCommands()
+{
+  PROFILE_FUNCTION();
+  m_commands.playback(m_registry);
+  m_registry.deliverEvents();
+}
+
 // =============================================================== //
 // Constructors
 // =============================================================== //
@@ -293,18 +358,27 @@ void AbstractScene<Manager>::flushMainThreadJobs()
 template <reg::CompileTimeBitMaskType Manager>
 AbstractScene<Manager>::AbstractScene(reg::EventDispatcher &ed,
                                       sol::state &solState,
-                                      ThreadPool &threadPool)
+                                      ThreadPool &threadPool,
+                                      FrameArena &frameArena)
     : m_registry(), m_entity(createEntity()),
       m_luaState(enchanceLuaState(solState)), m_threadPool(threadPool),
-      m_eventDispatcher(ed){};
+      m_frameArena(frameArena), m_eventDispatcher(ed){};
 
 template <reg::CompileTimeBitMaskType Manager>
 void AbstractScene<Manager>::updateSystems(DeltaTime deltaTime)
 {
   PROFILE_FUNCTION();
   flushMainThreadJobs();
-  for (auto *sys : m_updateSystems)
+  // every system runs at its own change tick, so it can tell the writes made
+  // since its previous run from its own. Component events are delivered
+  // before, so no system sees an entity its observers weren't told about
+  for (auto *sys : m_updateSystems) {
+    m_registry.deliverEvents();
+    m_registry.advanceChangeTick();
     static_cast<IOnUpdate *>(sys)->onUpdate(deltaTime);
+  }
+  // writes made outside of update systems come after all of them
+  m_registry.advanceChangeTick();
   m_eventDispatcher.update();
 }
 
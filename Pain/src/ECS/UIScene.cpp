@@ -10,9 +10,10 @@ namespace pain
 {
 
 UIScene UIScene::create(reg::EventDispatcher &eventDispatcher,
-                        sol::state &solState, ThreadPool &threadPool)
+                        sol::state &solState, ThreadPool &threadPool,
+                        FrameArena &frameArena)
 {
-  return UIScene(eventDispatcher, solState, threadPool);
+  return UIScene(eventDispatcher, solState, threadPool, frameArena);
 }
 
 } // namespace pain
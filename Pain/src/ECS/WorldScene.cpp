@@ -10,9 +10,9 @@ namespace pain
 {
 
 Scene Scene::create(reg::EventDispatcher &eventDispatcher, sol::state &solState,
-                    ThreadPool &threadPool)
+                    ThreadPool &threadPool, FrameArena &frameArena)
 {
-  return Scene(eventDispatcher, solState, threadPool);
+  return Scene(eventDispatcher, solState, threadPool, frameArena);
 }
 
 } // namespace pain
@@ -48,7 +48,7 @@ void ImGuiSys::onEvent(const SDL_Event &event)
 {
   ImGui_ImplSDL2_ProcessEvent(&event);
   auto chunks = query<ImGuiComponent>();
-  for (auto &chunk : chunks) {
+  for (auto chunk : chunks) {
     auto *__restrict nsc = std::get<0>(chunk.arrays);
     for (size_t i = 0; i < chunk.count; ++i) {
       if (nsc[i].instance && nsc[i].onEventFunction)
@@ -68,7 +68,7 @@ void ImGuiSys::onRender(Renderers &renderer, bool isMinimized,
     // ::ImGui::ShowDemoWindow(); // Show demo window! :)
 
     auto chunks = query<ImGuiComponent>();
-    for (auto &chunk : chunks) {
+    for (auto chunk : chunks) {
       auto *__restrict nscs = std::get<0>(chunk.arrays);
       for (size_t i = 0; i < chunk.count; ++i) {
         auto &nsc = nscs[i];
@@ -32,7 +32,7 @@ void Systems::CameraSys::onEvent(const SDL_Event &event)
 
   auto chunks = query<Component::OrthoCamera>();
 
-  for (auto &chunk : chunks) {
+  for (auto chunk : chunks) {
     auto *__restrict c = std::get<0>(chunk.arrays);
 
     for (size_t i = 0; i < chunk.count; ++i) {
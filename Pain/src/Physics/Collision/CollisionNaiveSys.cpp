@@ -129,22 +129,22 @@ void NaiveCollisionSys::onUpdate(DeltaTime deltaTime)
     auto chunks =
         query<Transform2dComponent, ColliderComponent, Movement2dComponent>();
 
-    for (size_t ci = 0; ci < chunks.size(); ++ci) {
-      auto &chunk_i = chunks[ci];
+    for (auto it_i = chunks.begin(); it_i != chunks.end(); ++it_i) {
+      auto chunk_i = *it_i;
 
       auto *t_chunk_i = std::get<0>(chunk_i.arrays);
       auto *c_chunk_i = std::get<1>(chunk_i.arrays);
       auto *m_chunk_i = std::get<2>(chunk_i.arrays);
 
-      for (size_t cj = ci; cj < chunks.size(); ++cj) {
-        auto &chunk_j = chunks[cj];
+      for (auto it_j = it_i; it_j != chunks.end(); ++it_j) {
+        auto chunk_j = *it_j;
 
         auto *t_chunk_j = std::get<0>(chunk_j.arrays);
         auto *c_chunk_j = std::get<1>(chunk_j.arrays);
         auto *m_chunk_j = std::get<2>(chunk_j.arrays);
 
         // Compare against different chunks, i.e: i ∈ chunk_i and j ∈ chunk_j
-        const bool same_chunk = (ci == cj);
+        const bool same_chunk = (it_i == it_j);
         for (size_t i = 0; i < chunk_i.count; ++i) {
           // NOTE: If same chunk, start at i+1 to avoid duplicates
           // Why? Bc if there are in the same chunk, then i = j at first
@@ -167,15 +167,12 @@ void NaiveCollisionSys::onUpdate(DeltaTime deltaTime)
     auto chunksStatic = query<Transform2dComponent, ColliderComponent>(
         exclude<Movement2dComponent>);
 
-    for (size_t ci = 0; ci < chunks.size(); ++ci) {
-      auto &chunk_i = chunks[ci];
-
+    for (auto chunk_i : chunks) {
       auto *t_chunk_i = std::get<0>(chunk_i.arrays);
       auto *c_chunk_i = std::get<1>(chunk_i.arrays);
       auto *m_chunk_i = std::get<2>(chunk_i.arrays);
 
-      for (size_t cj = 0; cj < chunksStatic.size(); ++cj) {
-        auto &chunk_j = chunksStatic[cj];
+      for (auto chunk_j : chunksStatic) {
 
         auto *t_chunk_j = std::get<0>(chunk_j.arrays);
         auto *c_chunk_j = std::get<1>(chunk_j.arrays);
@@ -168,6 +168,51 @@ size_t insertEndPoint(reg::Entity entity, std::vector<EndPoint> &vecX,
   colComp.m_index = static_cast<int>(key_index);
   return key_index;
 }
+// Drop the endpoints of the keys whose entity is in removed, which must be
+// sorted. Endpoints keep their order, keys are renumbered and remap[old key]
+// tells the new one, or NoKey. Returns false when none was dropped
+constexpr size_t NoKey = static_cast<size_t>(-1);
+bool eraseEndPoints(std::span<const reg::Entity> removed,
+                    std::vector<EndPoint> &vecX, std::vector<EndPoint> &vecY,
+                    std::vector<EndPointKey> &vecKeys,
+                    std::vector<size_t> &remap)
+{
+  remap.resize(vecKeys.size());
+  size_t kept = 0;
+  for (size_t key = 0; key < vecKeys.size(); ++key) {
+    if (std::binary_search(removed.begin(), removed.end(),
+                           vecKeys[key].entity)) {
+      remap[key] = NoKey;
+      continue;
+    }
+    remap[key] = kept;
+    vecKeys[kept++] = vecKeys[key];
+  }
+  if (kept == vecKeys.size())
+    return false;
+  vecKeys.resize(kept);
+
+  auto compact = [&](std::vector<EndPoint> &endPoints, bool isX) {
+    size_t out = 0;
+    for (const EndPoint &endPoint : endPoints) {
+      const size_t key = remap[endPoint.key];
+      if (key == NoKey)
+        continue;
+      endPoints[out] = {key, endPoint.valueOnAxis, endPoint.isMin};
+      EndPointKey &proxy = vecKeys[key];
+      if (isX)
+        (endPoint.isMin ? proxy.index_minX : proxy.index_maxX) = out;
+      else
+        (endPoint.isMin ? proxy.index_minY : proxy.index_maxY) = out;
+      ++out;
+    }
+    endPoints.resize(out);
+  };
+  compact(vecX, true);
+  compact(vecY, false);
+  return true;
+}
+
 size_t SweepAndPruneSys::insertColliderDirectly(reg::Entity entity,
                                                 const Transform2dComponent &tc,
                                                 SAPCollider &sc)
@@ -202,6 +247,75 @@ void SweepAndPruneSys::sortAfterInsertion()
   m_firstTime = false;
 }
 
+SweepAndPruneSys::SweepAndPruneSys(
+    reg::ArcheRegistry<WorldComponents> &registry,
+    reg::EventDispatcher &eventDispatcher)
+    : System<WorldComponents>(registry, eventDispatcher)
+{
+  onAdded<SAPCollider>([this](std::span<const reg::Entity> entities) {
+    onCollidersAdded(entities);
+  });
+  onRemoved<SAPCollider>([this](std::span<const reg::Entity> entities) {
+    removeColliders(entities);
+  });
+}
+
+bool SweepAndPruneSys::hasEndPoints(reg::Entity entity) const
+{
+  const SAPCollider &collider = getComponent<SAPCollider>(entity);
+  const auto &endPointKeys = hasAnyComponents<Movement2dComponent>(entity)
+                                 ? m_endPointKeys
+                                 : m_staticEndPointKeys;
+  // a collider listed twice holds its own index already, one copied by hand
+  // from another entity holds the index of that entity
+  return collider.m_index >= 0 &&
+         static_cast<size_t>(collider.m_index) < endPointKeys.size() &&
+         endPointKeys[static_cast<size_t>(collider.m_index)].entity == entity;
+}
+
+void SweepAndPruneSys::onCollidersAdded(std::span<const reg::Entity> entities)
+{
+  // the first update inserts every collider at once
+  if (m_firstTime)
+    return;
+  size_t inserted = 0;
+  for (reg::Entity entity : entities) {
+    // the collider may be gone already, or listed twice if it came back
+    if (!isAlive(entity) || !hasAnyComponents<SAPCollider>(entity) ||
+        !hasAnyComponents<Transform2dComponent>(entity) ||
+        hasEndPoints(entity))
+      continue;
+    insertCollider(entity);
+    ++inserted;
+  }
+  if (inserted != 0)
+    sortAfterInsertion();
+}
+
+void SweepAndPruneSys::removeColliders(std::span<const reg::Entity> entities)
+{
+  std::vector<reg::Entity> removed(entities.begin(), entities.end());
+  std::sort(removed.begin(), removed.end());
+  std::vector<size_t> remap;
+
+  auto erase = [&](std::vector<EndPoint> &vecX, std::vector<EndPoint> &vecY,
+                   std::vector<EndPointKey> &vecKeys) {
+    if (!eraseEndPoints(removed, vecX, vecY, vecKeys, remap))
+      return;
+    // colliders whose key moved point to the new one
+    for (size_t key = 0; key < remap.size(); ++key) {
+      if (remap[key] == NoKey || remap[key] == key)
+        continue;
+      const reg::Entity entity = vecKeys[remap[key]].entity;
+      if (isAlive(entity) && hasAnyComponents<SAPCollider>(entity))
+        getComponent<SAPCollider>(entity).m_index =
+            static_cast<int>(remap[key]);
+    }
+  };
+  erase(m_endPointsX, m_endPointsY, m_endPointKeys);
+  erase(m_staticEndPointsX, m_staticEndPointsY, m_staticEndPointKeys);
+}
+
 void SweepAndPruneSys::onUpdate(DeltaTime deltaTime)
 {
   UNUSED(deltaTime)
@@ -211,7 +325,7 @@ void SweepAndPruneSys::onUpdate(DeltaTime deltaTime)
     auto chunks =
         query<Transform2dComponent, SAPCollider, Movement2dComponent>();
     m_firstTime = false;
-    for (auto &chunk : chunks) {
+    for (auto chunk : chunks) {
       auto *t = std::get<0>(chunk.arrays);
       auto *c = std::get<1>(chunk.arrays);
       auto &e = chunk.entities;
@@ -222,7 +336,7 @@ void SweepAndPruneSys::onUpdate(DeltaTime deltaTime)
     }
     auto chunks2 =
         query<Transform2dComponent, SAPCollider>(exclude<Movement2dComponent>);
-    for (auto &chunk : chunks2) {
+    for (auto chunk : chunks2) {
       auto *t = std::get<0>(chunk.arrays);
       auto *c = std::get<1>(chunk.arrays);
       auto &e = chunk.entities;
@@ -237,16 +351,19 @@ void SweepAndPruneSys::onUpdate(DeltaTime deltaTime)
     sortSAP(m_staticEndPointsY, m_staticEndPointKeys, false);
   }
 
-  // Step 1: Update all moving endpoints with new data from the components
-  auto chunks = query<Transform2dComponent, SAPCollider, Movement2dComponent>();
+  // Step 1: Update the moving endpoints with new data from the components.
+  // Only chunks written since the last update are read, colliders that
+  // didn't move keep their endpoints
+  auto chunks = queryChanged<const Transform2dComponent, const SAPCollider,
+                             const Movement2dComponent>();
 
-  for (auto &chunk : chunks) {
+  for (auto chunk : chunks) {
     auto *t = std::get<0>(chunk.arrays);
     auto *c = std::get<1>(chunk.arrays);
 
     for (size_t i = 0; i < chunk.count; ++i) {
 
-      SAPCollider &collider = c[i];
+      const SAPCollider &collider = c[i];
       EndPointKey &proxy =
           collider.m_index >= 0
               ? m_endPointKeys[static_cast<unsigned>(collider.m_index)]
@@ -299,7 +416,8 @@ void SweepAndPruneSys::onUpdate(DeltaTime deltaTime)
   // --------------------------------------------------------------------------
   // Step 3: Sweep and build active list to find overlapping pairs
   // --------------------------------------------------------------------------
-  std::vector<std::pair<size_t, long>> potential_pairs;
+  // pairs only live during this update, they go to the frame arena
+  std::pmr::vector<std::pair<size_t, long>> potential_pairs(frameResource());
   potential_pairs.reserve(m_endPointKeys.size());
 
   size_t staticIdx = 0;
@@ -386,7 +504,8 @@ void SweepAndPruneSys::onUpdate(DeltaTime deltaTime)
   // Step 4: Get the indexes from potential_pairs and check if those entities
   // also check for Y
   // --------------------------------------------------------------------------
-  std::vector<std::pair<size_t, long>> validPairs;
+  std::pmr::vector<std::pair<size_t, long>> validPairs(frameResource());
+  validPairs.reserve(potential_pairs.size());
   for (const std::pair<size_t, long> &pair : potential_pairs) {
     EndPointKey entityProxy1 = m_endPointKeys[pair.first];
     const float minY1 = m_endPointsY[entityProxy1.index_minY].valueOnAxis;
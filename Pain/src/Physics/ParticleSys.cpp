@@ -20,13 +20,12 @@ namespace Systems
 {
 void Systems::ParticleSys::onUpdate(DeltaTime deltaTime)
 {
-  auto chunks = query<ParticleSprayComponent>();
-  for (auto &chunk : chunks) {
+  forEachParallel<ParticleSprayComponent>([deltaTime](auto chunk) {
     auto *__restrict pc = std::get<0>(chunk.arrays);
     for (size_t i = 0; i < chunk.count; i++) {
       pc[i].elapsed += deltaTime;
     }
-  }
+  });
 }
 
 void Systems::ParticleSys::onRender(pain::Renderers &renderer, bool isMinimized,
@@ -42,7 +41,7 @@ void Systems::ParticleSys::onRender(pain::Renderers &renderer, bool isMinimized,
     auto chunks = query<Transform2dComponent, ParticleSprayComponent,
                         RotationComponent>();
 
-    for (auto &chunk : chunks) {
+    for (auto chunk : chunks) {
       auto *__restrict tc = std::get<0>(chunk.arrays);
       auto *__restrict psc = std::get<1>(chunk.arrays);
       auto *__restrict rc = std::get<2>(chunk.arrays);
@@ -0,0 +1,233 @@
+/*
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/.
+ */
+
+#include "Physics/TransformHierarchySys.h"
+#include "CoreFiles/ThreadPool.h"
+#include "Debugging/Profiling.h"
+
+namespace pain
+{
+
+namespace Systems
+{
+void TransformHierarchy::onUpdate(DeltaTime deltaTime)
+{
+  PROFILE_FUNCTION();
+  (void)deltaTime;
+  std::fill(m_dirty.begin(), m_dirty.end(), 0);
+  m_attached.clear();
+
+  // =============================================================== //
+  // Find the children to recompute
+  // =============================================================== //
+  {
+    PROFILE_SCOPE("TransformHierarchy::onUpdate - dirty");
+    // their subtrees are reached through the flags of their parents
+    for (auto chunk : queryChanged<const ParentComponent,
+                                   const LocalTransform2dComponent>())
+      for (size_t i = 0; i < chunk.count; ++i)
+        markDirty(chunk.entities[i]);
+    // a new or re-parented child changes the depths, sort the rows again.
+    // Flags are taken first, the rows moved by the sort aren't changes
+    for (auto chunk : queryChanged<const ParentComponent>())
+      m_attached.insert(m_attached.end(), chunk.entities.begin(),
+                        chunk.entities.end());
+    if (!m_attached.empty())
+      updateDepths();
+  }
+
+  // =============================================================== //
+  // Propagate level by level
+  // =============================================================== //
+  {
+    PROFILE_SCOPE("TransformHierarchy::onUpdate - propagate");
+    updateRoots();
+    buildLevels();
+    for (const std::vector<LevelRange> &level : m_levels)
+      if (!level.empty())
+        updateLevel(level);
+  }
+  writeBackPositions();
+}
+
+// Roots whose chunk changed. Only the ones whose matrix really changed are
+// flagged, so moving one root doesn't recompute the subtrees of its chunk
+void TransformHierarchy::updateRoots()
+{
+  for (auto chunk : queryChanged<const Transform2dComponent,
+                                 const LocalTransform2dComponent,
+                                 WorldTransform2dComponent>(
+           exclude<ParentComponent>)) {
+    auto [transforms, locals, worlds] = chunk.arrays;
+    for (size_t i = 0; i < chunk.count; ++i) {
+      glm::mat3 world = locals[i].matrix();
+      world[2] += glm::vec3(transforms[i].m_position, 0.0f);
+      setWorld(worlds[i], world, chunk.entities[i]);
+    }
+  }
+  for (auto chunk :
+       queryChanged<const LocalTransform2dComponent, WorldTransform2dComponent>(
+           exclude<ParentComponent, Transform2dComponent>)) {
+    auto [locals, worlds] = chunk.arrays;
+    for (size_t i = 0; i < chunk.count; ++i)
+      setWorld(worlds[i], locals[i].matrix(), chunk.entities[i]);
+  }
+}
+
+// Split every chunk of children into runs of the same depth. Rows are sorted
+// by depth, so that is a few ranges per archetype and level
+void TransformHierarchy::buildLevels()
+{
+  for (std::vector<LevelRange> &level : m_levels)
+    level.clear();
+  for (ChildChunk chunk : query(m_childQuery)) {
+    const ParentComponent *parents = std::get<0>(chunk.arrays);
+    size_t begin = 0;
+    for (size_t i = 1; i <= chunk.count; ++i) {
+      if (i < chunk.count && parents[i].m_depth == parents[begin].m_depth)
+        continue;
+      const size_t depth = parents[begin].m_depth;
+      if (depth >= m_levels.size())
+        m_levels.resize(depth + 1);
+      m_levels[depth].push_back({chunk, begin, i - begin});
+      begin = i;
+    }
+    // flags are written concurrently later, they must not grow by then
+    for (size_t i = 0; i < chunk.count; ++i)
+      if (reg::entityIndex(chunk.entities[i]) >= m_dirty.size())
+        m_dirty.resize(reg::entityIndex(chunk.entities[i]) + 1, 0);
+  }
+}
+
+// Every parent of this level was finished by the previous one, so the ranges
+// of a level are independent and run in parallel. A recomputed child stays
+// flagged only if its matrix changed, which is what its own children test
+void TransformHierarchy::updateLevel(const std::vector<LevelRange> &level)
+{
+  const reg::ArcheRegistry<WorldComponents> &registry = m_registry;
+  auto job = [this, &registry, &level](size_t index) {
+    const LevelRange &range = level[index];
+    auto [parents, locals, worlds] = range.chunk.arrays;
+    for (size_t i = range.begin; i < range.begin + range.count; ++i) {
+      const reg::Entity entity = range.chunk.entities[i];
+      const reg::Entity parent = parents[i].m_parent;
+      if (!(isDirty(entity) || isDirty(parent)) || !registry.isAlive(parent))
+        continue;
+      const glm::mat3 world =
+          registry.getComponent<WorldTransform2dComponent>(parent).m_matrix *
+          locals[i].matrix();
+      const bool changed = world != worlds[i].m_matrix;
+      if (changed)
+        worlds[i].m_matrix = world;
+      m_dirty[reg::entityIndex(entity)] = changed;
+    }
+  };
+  if (m_threadPool != nullptr)
+    m_threadPool->parallelFor(level.size(), job);
+  else
+    for (size_t index = 0; index < level.size(); ++index)
+      job(index);
+}
+
+// Children drawn or collided through Transform2dComponent follow their world
+// position. Only the moved ones are written, so the chunks of static children
+// keep their change ticks. New children are written even if they didn't move
+void TransformHierarchy::writeBackPositions()
+{
+  for (auto chunk : queryConst<ParentComponent, WorldTransform2dComponent,
+                               Transform2dComponent>()) {
+    const WorldTransform2dComponent *worlds = std::get<1>(chunk.arrays);
+    for (size_t i = 0; i < chunk.count; ++i)
+      if (isDirty(chunk.entities[i]))
+        m_registry.getComponent<Transform2dComponent>(chunk.entities[i])
+            .m_position = worlds[i].position();
+  }
+  for (reg::Entity entity : m_attached)
+    if (m_registry.hasAny<Transform2dComponent>(entity) && !isDirty(entity))
+      m_registry.getComponent<Transform2dComponent>(entity).m_position =
+          std::as_const(m_registry)
+              .getComponent<WorldTransform2dComponent>(entity)
+              .position();
+}
+
+// Depth of every child, 1 for the children of a root. A parent that was
+// removed counts as a root, its children stay where they were
+void TransformHierarchy::updateDepths()
+{
+  const reg::ArcheRegistry<WorldComponents> &registry = m_registry;
+  std::fill(m_depths.begin(), m_depths.end(), 0);
+  size_t children = 0;
+  for (auto chunk : queryConst(m_parentQuery))
+    children += chunk.count;
+
+  for (auto chunk : queryConst(m_parentQuery)) {
+    for (size_t i = 0; i < chunk.count; ++i) {
+      // walk up until a node of known depth, or a root
+      m_chain.clear();
+      reg::Entity node = chunk.entities[i];
+      std::uint32_t depth = 0;
+      while (registry.isAlive(node) &&
+             registry.hasAny<ParentComponent>(node)) {
+        const size_t index = reg::entityIndex(node);
+        if (index < m_depths.size() && m_depths[index] != 0) {
+          depth = m_depths[index];
+          break;
+        }
+        m_chain.push_back(node);
+        P_ASSERT(m_chain.size() <= children,
+                 "Entity {} is its own ancestor, parents form a cycle", node);
+        node = registry.getComponent<ParentComponent>(node).m_parent;
+      }
+      for (auto it = m_chain.rbegin(); it != m_chain.rend(); ++it) {
+        const size_t index = reg::entityIndex(*it);
+        if (index >= m_depths.size())
+          m_depths.resize(index + 1, 0);
+        m_depths[index] = ++depth;
+      }
+    }
+  }
+
+  // only write real changes, a write counts as a new change for other readers
+  for (auto chunk : queryConst(m_parentQuery)) {
+    const ParentComponent *parents = std::get<0>(chunk.arrays);
+    for (size_t i = 0; i < chunk.count; ++i) {
+      const std::uint32_t depth = m_depths[reg::entityIndex(chunk.entities[i])];
+      if (parents[i].m_depth != depth)
+        m_registry.getComponent<ParentComponent>(chunk.entities[i]).m_depth =
+            depth;
+    }
+  }
+  m_registry.sort<ParentComponent>(
+      [](const ParentComponent &lhs, const ParentComponent &rhs) {
+        return lhs.m_depth < rhs.m_depth;
+      });
+}
+
+void TransformHierarchy::setWorld(WorldTransform2dComponent &world,
+                                  const glm::mat3 &matrix, reg::Entity entity)
+{
+  if (world.m_matrix == matrix)
+    return;
+  world.m_matrix = matrix;
+  markDirty(entity);
+}
+
+void TransformHierarchy::markDirty(reg::Entity entity)
+{
+  const size_t index = reg::entityIndex(entity);
+  if (index >= m_dirty.size())
+    m_dirty.resize(index + 1, 0);
+  m_dirty[index] = 1;
+}
+
+bool TransformHierarchy::isDirty(reg::Entity entity) const
+{
+  const size_t index = reg::entityIndex(entity);
+  return index < m_dirty.size() && m_dirty[index] != 0;
+}
+
+} // namespace Systems
+} // namespace pain
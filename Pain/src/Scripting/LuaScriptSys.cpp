@@ -24,7 +24,7 @@ void LuaScript::onUpdate(DeltaTime deltaTime)
 
   auto chunks = query<LuaScriptComponent>();
 
-  for (auto &chunk : chunks) {
+  for (auto chunk : chunks) {
     auto *scripts = std::get<0>(chunk.arrays);
 
     for (size_t i = 0; i < chunk.count; ++i) {
@@ -49,7 +49,7 @@ void LuaScript::onEvent(const SDL_Event &e)
 
   auto chunks = query<LuaScriptComponent>();
 
-  for (auto &chunk : chunks) {
+  for (auto chunk : chunks) {
     auto *scripts = std::get<0>(chunk.arrays);
 
     for (size_t i = 0; i < chunk.count; ++i) {
@@ -75,7 +75,7 @@ void LuaScript::onRender(Renderers &renderer, bool isMinimized,
 
   auto chunks = query<LuaScriptComponent>();
 
-  for (auto &chunk : chunks) {
+  for (auto chunk : chunks) {
     auto *scripts = std::get<0>(chunk.arrays);
 
     for (size_t i = 0; i < chunk.count; ++i) {
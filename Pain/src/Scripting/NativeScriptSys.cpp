@@ -19,7 +19,7 @@ void NativeScript::onUpdate(DeltaTime deltaTime)
 
   auto chunks = query<NativeScriptComponent>();
 
-  for (auto &chunk : chunks) {
+  for (auto chunk : chunks) {
     auto *scripts = std::get<0>(chunk.arrays);
 
     for (size_t i = 0; i < chunk.count; ++i) {
@@ -36,7 +36,7 @@ void NativeScript::onEvent(const SDL_Event &e)
 {
   auto chunks = query<NativeScriptComponent>();
 
-  for (auto &chunk : chunks) {
+  for (auto chunk : chunks) {
     auto *scripts = std::get<0>(chunk.arrays);
 
     for (size_t i = 0; i < chunk.count; ++i) {
@@ -56,7 +56,7 @@ void NativeScript::onRender(Renderers &renderer, bool isMinimized,
 
   auto chunks = query<NativeScriptComponent>();
 
-  for (auto &chunk : chunks) {
+  for (auto chunk : chunks) {
     auto *scripts = std::get<0>(chunk.arrays);
 
     for (size_t i = 0; i < chunk.count; ++i) {
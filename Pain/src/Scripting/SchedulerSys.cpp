@@ -19,7 +19,7 @@ void LuaSchedulerSys::onUpdate(DeltaTime deltaTime)
 
   auto chunks = query<cmp::LuaScheduleTask>();
   float deltaTimef = deltaTime.getSecondsf();
-  for (auto &chunk : chunks) {
+  for (auto chunk : chunks) {
     auto *scripts = std::get<0>(chunk.arrays);
 
     for (size_t i = 0; i < chunk.count; ++i) {
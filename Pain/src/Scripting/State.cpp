@@ -73,9 +73,9 @@ sol::state createLuaState()
   );
   // type returned by get_movement(self)
   lua.new_usertype<Movement2dComponent>(
-      "Movement2dComponent", sol::no_constructor,     //
-      "m_velocity", &Movement2dComponent::m_velocity, //
-      "m_rotationSpeed", &Movement2dComponent::m_rotationSpeed);
+      "Movement2dComponent", sol::no_constructor,    //
+      "m_velocity", &Movement2dComponent::m_velocity //
+  );
 
   // type returned by get_position(self)
   lua.new_usertype<Transform2dComponent>(             //